@@ -1,6 +1,14 @@
 ﻿#include <iostream>         // cout, cerr
 #include <cstdlib>          // EXIT_FAILURE
-#include <GL/glew.h>        // GLEW library
+#include <string>           // window title stats
+#include <vector>           // scene tables
+#include <thread>           // hardware_concurrency
+#include <chrono>           // steady_clock
+#include <cstdio>           // snprintf
+#include <cstring>          // memcpy
+#include <algorithm>        // max
+#include <cmath>            // flythrough path
+#include "gl_loader.h"       // OpenGL entry points
 #include <GLFW/glfw3.h>     // GLFW library
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"      // Image loading Utility functions
@@ -11,6 +19,25 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include "camera.h"
+#include "bounds.h"
+#include "scene.h"
+#include "occlusion.h"
+#include "hiz.h"
+#include "lod.h"
+#include "jobs.h"
+#include "renderqueue.h"
+#include "simulation.h"
+#include "timing.h"
+#include "profiler.h"
+#include "glstats.h"
+#include "overlay.h"
+#include "streamring.h"
+#include "gpucull.h"
+#include "gbuffer.h"
+#include "shadows.h"
+#include "resolution.h"
+#include "framebuffers.h"
+#include "regression.h"
 
 using namespace std; // Standard namespace
 
@@ -33,7 +60,11 @@ namespace
     {
         GLuint vao;         // Handle for the vertex array object
         GLuint vbo;         // Handle for the vertex buffer object
+        GLuint ebo;         // Handle for the index buffer holding every level of detail
         GLuint nVertices;    // Number of indices of the mesh
+        vector<LodLevel> lods;  // Index ranges of the detail levels, full detail first
+        BoundingBox bounds;     // Model space bounding box
+        BoundingSphere sphere;  // Model space bounding sphere
     };
 
     // Main GLFW window
@@ -44,7 +75,8 @@ namespace
     GLuint gTextureId1, gTextureId2, gTextureId3;
     glm::vec2 gUVScale(5.0f, 5.0f);
     // Shader program
-    GLuint gObjectProgramId, gLightProgramId;
+    GLuint gObjectProgramId, gLightProgramId, gHiZProgramId, gTextProgramId, gCullProgramId, gDepthProgramId;
+    GLuint gGBufferProgramId, gDeferredLightProgramId, gUpscaleProgramId;
 
     // variable to handle ortho change
     bool perspective = false;
@@ -58,14 +90,37 @@ namespace
     glm::vec3 gCameraFront = glm::vec3(0.0f, 0.0f, -1.0f);
     glm::vec3 gCameraUp = glm::vec3(0.0f, 1.0f, 0.0f);
 
-    // timing
-    float gDeltaTime = 0.0f; // time between current frame and last frame
-    float gLastFrame = 0.0f;
+    // Fixed timestep simulation thread moving the camera; gCamera holds the interpolated camera of the current frame
+    Simulation gSimulation;
 
-    // Subject position and scale
-    glm::vec3 gObjectPosition(0.0f, 0.0f, 0.0f);
-    glm::vec3 gObjectScale(1.0f);
-    glm::vec3 gObjectRotation(1.0, 1.0f, 1.0f);
+    // timing
+    FrameClock gFrameClock;     // monotonic 64-bit nanosecond clock
+    double gDeltaTime = 0.0;    // time between current frame and last frame, in seconds
+    int64_t gLastStatsTime = 0; // frame clock time the title stats were last refreshed
+    int64_t gWorstFrame = 0;    // longest frame since then
+    uint64_t gStatsFrames = 0;  // frame count at that time
+    // Optional frame rate cap independent of vsync (--fps <rate> on the command line)
+    FramePacer gFramePacer;
+
+    // CPU/GPU pass timings; T dumps a summary and a Chrome trace
+    Profiler gProfiler;
+    bool gTraceKeyDown = false;
+
+    // GL call counters: I toggles the on-screen overlay, --stats-log <file.csv|file.json> logs them every frame
+    TextOverlay gOverlay;
+    bool gShowOverlay = false;
+    bool gOverlayKeyDown = false;
+    StatsLog gStatsLog;
+
+    // Headless regression run (--regression <results dir>), see URunRegression; the goldens are committed
+    string gRegressionDir;
+    string gGoldenDir = "regression/goldens";
+    bool gRecordGoldens = false;
+    bool gRecordBaselines = false;
+    // When set, URender reads the finished frame back into it before presenting
+    RegressionImage* gCapture = nullptr;
+    // Canned camera flythrough of this many frames (--flythrough <frames>), the PGO training and timing workload
+    int gFlythroughFrames = 0;
 
     // Subject and light color
     glm::vec3 gObjectColor(1.f, 0.2f, 0.0f);
@@ -73,20 +128,145 @@ namespace
     glm::vec3 gFillLightColor(1.0f, 1.0f, 1.0f);
     glm::vec3 gPyramidLightColor(1.0f, 1.0f, 1.0f);
 
-    // Key light position and scale
+    // Light positions (also used to place the lamp nodes of the scene)
     glm::vec3 gKeyLightPosition(10.0f, 0.0f, -10.0f);
-    glm::vec3 gKeyLightScale(1.0f);
-    glm::vec3 gKeyLightRotation(0.0, 1.0f, 0.0f);
-
-    // Fill light position and scale
     glm::vec3 gFillLightPosition(-10.0f, 0.0f, 10.0f);
-    glm::vec3 gFillLightScale(1.0f);
-    glm::vec3 gFillLightRotation(0.0, 1.0f, 0.0f);
-
-    // Pyramid light position and scale
     glm::vec3 gPyramidLightPosition(1.0f, 2.15f, -0.4f);
-    glm::vec3 gPyramidLightScale(0.75f);
-    glm::vec3 gPyramidLightRotation(0.0, 1.0f, 0.0f);
+
+    // Draw data referenced by the scene nodes
+    struct Renderable
+    {
+        GLMesh* mesh;       // Geometry to draw
+        GLuint texture;     // Texture bound to unit 0 (unused by lamps)
+        bool lamp;          // Drawn with the unlit lamp shader
+    };
+
+    // Scene graph and the table of things its nodes draw
+    Scene gScene;
+    vector<Renderable> gRenderables;
+    // Work-stealing job system running the per-frame task graph and asset decoding
+    JobSystem gJobs;
+    TaskGraph gFrameGraph;
+    // Camera matrices of the frame the task graph is working on
+    glm::mat4 gFrameView, gFrameProjection;
+
+    // Draw packets recorded on the job system while culling BVH subtrees, and per-thread scratch data
+    RenderQueue gRenderQueue;
+    vector<int> gCullRoots;
+    vector<vector<int>> gSlotVisibleNodes;
+    vector<LodStats> gSlotLodStats;
+
+    // Occlusion culling, either with temporally coherent hardware queries or against a Hi-Z depth pyramid
+    enum OcclusionMode { OCCLUSION_OFF, OCCLUSION_QUERIES, OCCLUSION_HIZ };
+    OcclusionMode gOcclusionMode = OCCLUSION_HIZ;
+    OcclusionCuller gOcclusion;
+    vector<int> gHiddenNodes;
+    vector<BoundingBox> gHiddenBounds;
+    HiZBuffer gHiZ;
+    unsigned int gHiZOccluded = 0;
+
+    // GPU driven submission (G toggles it, --gpu-cull starts with it): a compute pass culls the objects and
+    // writes their draw commands, drawn with one multi draw per vertex array and texture. The CPU only records
+    // the lamps, which the compute pass leaves out. Occlusion culling doesn't apply to objects drawn this way.
+    GpuCuller gGpuCuller;
+    vector<int> gLampNodes;
+    bool gGpuCullSupported = false;
+    bool gGpuDriven = false;
+    bool gGpuDrivenKeyDown = false;
+
+    // Depth pre-pass (Z toggles it, --depth-prepass starts with it): a depth only pass lays down the nearest
+    // surfaces front to back, then the object shader runs with GL_EQUAL and shades each pixel once. Without it
+    // the objects are drawn front to back instead of grouped by texture and vertex array. On llvmpipe the 200
+    // frame flythrough shades 1.49 fragments per pixel without it and 0.76 with it.
+    bool gDepthPrePass = false;
+    bool gDepthPrePassKeyDown = false;
+    vector<int> gPrePassOrder;
+    // Fragments the object shader ran for, read back a few frames late. Overdraw is that count per framebuffer
+    // pixel; it isn't measured while occlusion queries are running.
+    FragmentCounter gFragmentCounter;
+    double gOverdraw = 0.0;
+    double gOverdrawSum = 0.0;
+    int gOverdrawSamples = 0;
+
+    // Deferred shading (F toggles it, --deferred starts with it): the object pass fills the G-buffer and the
+    // lighting pass shades each visible pixel once per light, where the forward object shader lights every
+    // fragment it runs for with all three lights
+    GBuffer gGBuffer;
+    bool gDeferred = false;
+    bool gDeferredKeyDown = false;
+
+    // Shadow maps of the three lights in one atlas (K toggles shadows, --no-shadow-cache redraws every map every
+    // frame). The key and fill lights are far from the table compared to its size, so they are shadowed as
+    // directional lights with cascades; the pyramid light gets the six faces of a cube. Maps are cached until
+    // a light or an object moves.
+    ShadowAtlas gShadowAtlas;
+    bool gShadows = true;
+    bool gShadowsKeyDown = false;
+    int gKeyShadow = -1, gFillShadow = -1, gPyramidShadow = -1;
+    vector<int> gShadowCasters;
+
+    // Window framebuffer size and the pooled textures of the offscreen targets (G-buffer, scaled scene)
+    FramebufferManager gFramebuffers;
+
+    // Dynamic resolution (R toggles it, --dynamic-resolution starts with it): the scene renders offscreen at the
+    // scale a PID controller picks from the measured GPU frame time, and a bicubic pass upscales it to the
+    // window. The overlay is drawn at the window's resolution after that.
+    ScaledRenderTarget gSceneTarget;
+    ResolutionController gResolution;
+    GpuFrameTimer gGpuFrameTimer;
+    bool gDynamicResolution = false;
+    bool gDynamicResolutionKeyDown = false;
+    double gGpuFrameTime = 0.0;     // milliseconds, of a frame a few frames back
+
+    // On-demand rendering (--on-demand): frames are only rendered while something changes, and the loop sleeps
+    // in glfwWaitEventsTimeout otherwise. Input events, a moving camera and moving objects request redraws;
+    // each request keeps rendering for a few frames and a short time after it, long enough for the simulation
+    // to catch up with the input and for what reads earlier frames' results (occlusion queries, the Hi-Z
+    // pyramid, the overdraw counter) to settle.
+    const int ON_DEMAND_SETTLE_FRAMES = 8;
+    const int64_t ON_DEMAND_SETTLE_TIME = 50000000;     // nanoseconds
+    const double ON_DEMAND_TIMEOUT = 0.1;               // seconds between checks for changes without an event
+    bool gOnDemand = false;
+    int gSettleFrames = 0;          // frames still rendered after the last redraw request
+    int64_t gRedrawUntil = 0;       // frame clock time until which frames are rendered after the last request
+    int gKeysHeld = 0;              // keys down; the camera keeps moving while one is held
+    bool gSceneMoved = false;       // objects moved in the last rendered frame
+    long long gShadowTileRenders = 0;
+
+    // Indirect draw commands of the objects submitted this frame (instance count 0 when Hi-Z hid them)
+    // and the render queue packets they were built from
+    vector<DrawElementsIndirectCommand> gDrawCommands;
+    vector<int> gDrawPackets;
+
+    // Persistently mapped, triple buffered ring holding everything rewritten each frame: the object shader's
+    // uniforms, instance matrices, indirect draw commands and the overlay text
+    StreamRing gStreamRing;
+    // This frame's world matrix of every scene node, in the ring. The object shader reads it as a per instance
+    // attribute; a draw's base instance is gFrameInstanceBase plus its node index.
+    glm::mat4* gFrameInstances = nullptr;
+    GLuint gFrameInstanceBase = 0;
+
+    // Object shader values shared by every draw of a frame, laid out like its std140 FrameUniforms block
+    struct FrameUniforms
+    {
+        glm::mat4 view;
+        glm::mat4 projection;
+        glm::vec3 objectColor; float pad0;
+        glm::vec3 keyLightColor; float pad1;
+        glm::vec3 keyLightPos; float pad2;
+        glm::vec3 fillLightColor; float pad3;
+        glm::vec3 fillLightPos; float pad4;
+        glm::vec3 pyramidLightColor; float pad5;
+        glm::vec3 pyramidLightPos; float pad6;
+        glm::vec3 viewPosition; float pad7;
+        glm::vec2 uvScale;
+    };
+
+    // Level of detail picked per node from its size on screen
+    LodSelector gLod;
+
+    // Visibility results of the last rendered frame
+    CullStats gCullStats = { 0, 0 };
 }
 
 /* User-defined Function prototypes to:
@@ -100,17 +280,41 @@ void UProcessInput(GLFWwindow* window);
 void UMousePositionCallback(GLFWwindow* window, double xpos, double ypos);
 void UMouseScrollCallback(GLFWwindow* window, double xoffset, double yoffset);
 void UMouseButtonCallback(GLFWwindow* window, int button, int action, int mods);
+void UKeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods);
+void UWindowRefreshCallback(GLFWwindow* window);
+void URequestRedraw();
+void UWaitForChanges();
 void UCreateMesh(GLMesh& mesh);
 void UCreatePlane(GLMesh& mesh);
 void UCreateDrawer(GLMesh& mesh);
 void UCreateLegs(GLMesh& mesh);
 void UCreatePyramidLight(GLMesh& mesh);
 void UCreateLight(GLMesh& mesh);
+void UCreateLods(GLMesh& mesh, const GLfloat* verts, GLuint floatsPerVertexTotal);
 void UDestroyMesh(GLMesh& mesh);
-bool UCreateTexture(const char* filename, GLuint& textureId);
+void UCreateScene();
+void UCreateStreamRing();
+void UCreateShadows();
+void UDrawShadowCasters(const glm::mat4& viewProjection);
+void UCreateGpuCuller();
+void URecordDrawPackets(const glm::mat4& view, const glm::mat4& projection);
+void UPickObject();
+// CPU side of a texture load, decoded off the GL thread
+struct DecodedImage
+{
+    const char* filename;
+    unsigned char* pixels;
+    int width, height, channels;
+};
+bool UDecodeImage(DecodedImage& image);
+bool UCreateTexture(DecodedImage& image, GLuint& textureId);
 void UDestroyTexture(GLuint textureId);
 void URender();
+void UCaptureFrame(RegressionImage& image);
+bool URunRegression();
+void URunFlythrough();
 bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, GLuint& programId);
+bool UCreateComputeProgram(const char* computeShaderSource, GLuint& programId);
 void UDestroyShaderProgram(GLuint programId);
 
 
@@ -119,15 +323,30 @@ const GLchar* objectVertexShaderSource = GLSL(440,
     layout(location = 0) in vec3 position; // Vertex data from Vertex Attrib Pointer 0
     layout(location = 1) in vec3 normal;  // Data from Vertex Attrib Pointer 1
     layout(location = 2) in vec2 textureCoordinate;
+    layout(location = 3) in mat4 model; // Per instance model matrix from the instance buffer (locations 3 to 6)
 
     out vec3 vertexNormal; // variable to transfer data to the fragment shader
     out vec3 vertexFragmentPos; // For outgoing pixels to fragment shader
     out vec2 vertexTextureCoordinate;
 
-    //Global variables for the  transform matrices
-    uniform mat4 model;
-    uniform mat4 view;
-    uniform mat4 projection;
+    // Per frame values, written to the stream ring once a frame (FrameUniforms on the C++ side)
+    layout(std140, binding = 0) uniform FrameUniforms
+    {
+        mat4 view;
+        mat4 projection;
+        vec3 objectColor;
+        vec3 keyLightColor;
+        vec3 keyLightPos;
+        vec3 fillLightColor;
+        vec3 fillLightPos;
+        vec3 pyramidLightColor;
+        vec3 pyramidLightPos;
+        vec3 viewPosition;
+        vec2 uvScale;
+    };
+
+    // The depth pre-pass computes the same positions; both must produce bit identical depth for GL_EQUAL
+    invariant gl_Position;
 
     void main()
     {
@@ -150,17 +369,68 @@ const GLchar* objectFragmentShaderSource = GLSL(440,
 
     out vec4 fragmentColor;
 
-    uniform vec3 objectColor;
-    uniform vec3 keyLightColor;
-    uniform vec3 keyLightPos;
-    uniform vec3 fillLightColor;
-    uniform vec3 fillLightPos;
-    uniform vec3 pyramidLightColor;
-    uniform vec3 pyramidLightPos;
-    uniform vec3 viewPosition;
+    // Per frame values, written to the stream ring once a frame (FrameUniforms on the C++ side)
+    layout(std140, binding = 0) uniform FrameUniforms
+    {
+        mat4 view;
+        mat4 projection;
+        vec3 objectColor;
+        vec3 keyLightColor;
+        vec3 keyLightPos;
+        vec3 fillLightColor;
+        vec3 fillLightPos;
+        vec3 pyramidLightColor;
+        vec3 pyramidLightPos;
+        vec3 viewPosition;
+        vec2 uvScale;
+    };
 
     uniform sampler2D uTexture;
-    uniform vec2 uvScale;
+
+    // Shadow maps of the lights in the atlas (ShadowUniforms on the C++ side, see shadows.h)
+    layout(std140, binding = 1) uniform ShadowUniforms
+    {
+        mat4 shadowMatrices[16];
+        vec4 shadowRects[16];
+        ivec4 shadowLights[4]; // first tile, tile count (0 without shadows), 1 for the six cube faces of a point light
+    };
+
+    uniform sampler2DShadow shadowAtlas;
+
+    // Compares the position with one tile, averaging the results of its 2x2 nearest texels
+    float shadowLookup(int tile, vec4 position)
+    {
+        vec4 clip = shadowMatrices[tile] * position;
+        vec3 coord = clip.xyz / clip.w * 0.5f + 0.5f;
+        vec4 rect = shadowRects[tile];
+        return texture(shadowAtlas, vec3(rect.xy + clamp(coord.xy, 0.001f, 0.999f) * rect.zw, coord.z));
+    }
+
+    // Fraction of the light reaching the position: 1 lit, 0 in shadow
+    float shadowFactor(int light, vec3 lightPosition, vec3 position, vec3 normal)
+    {
+        if (light < 0 || shadowLights[light].y == 0)
+            return 1.0f;
+        ivec4 tiles = shadowLights[light];
+        // looking up a little off the surface keeps it from shadowing itself
+        vec4 offsetPosition = vec4(position + normal * 0.02f, 1.0f);
+        if (tiles.z == 1)
+        {
+            // the cube face the light sees the position through
+            vec3 d = position - lightPosition;
+            vec3 a = abs(d);
+            int face = a.x >= a.y && a.x >= a.z ? (d.x >= 0.0f ? 0 : 1) : (a.y >= a.z ? (d.y >= 0.0f ? 2 : 3) : (d.z >= 0.0f ? 4 : 5));
+            return shadowLookup(tiles.x + face, offsetPosition);
+        }
+        // the nearest cascade holding the position
+        for (int cascade = 0; cascade < tiles.y; cascade++)
+        {
+            vec4 clip = shadowMatrices[tiles.x + cascade] * offsetPosition;
+            if (all(lessThanEqual(abs(clip.xyz / clip.w), vec3(1.0f))))
+                return shadowLookup(tiles.x + cascade, offsetPosition);
+        }
+        return 1.0f;
+    }
 
     void main()
     {
@@ -208,13 +478,212 @@ const GLchar* objectFragmentShaderSource = GLSL(440,
         // Texture holds the color to be used for all three components.
         vec4 textureColor = texture(uTexture, vertexTextureCoordinate * uvScale);
 
+        // Shadows, atlas lights 0 to 2 (key, fill, pyramid) leave only the ambient terms
+        float keyShadow = shadowFactor(0, keyLightPos, vertexFragmentPos, norm);
+        float fillShadow = shadowFactor(1, fillLightPos, vertexFragmentPos, norm);
+        float pyramidShadow = shadowFactor(2, pyramidLightPos, vertexFragmentPos, norm);
+
         // Calculate Phong result
-        vec3 phong = (key + fill + pyramid + keyDiffuse + keySpecular + fillDiffuse + fillSpecular + pyramidDiffuse + pyramidSpecular) * textureColor.xyz;
+        vec3 phong = (key + fill + pyramid + keyShadow * (keyDiffuse + keySpecular) + fillShadow * (fillDiffuse + fillSpecular) + pyramidShadow * (pyramidDiffuse + pyramidSpecular)) * textureColor.xyz;
 
         fragmentColor = vec4(phong, 1.0); // Send lighting results to GPU.
     }
 );
 
+/* G-buffer Fragment Shader Source Code*/
+const GLchar* gbufferFragmentShaderSource = GLSL(440,
+    in vec3 vertexNormal;
+    in vec2 vertexTextureCoordinate;
+
+    layout(location = 0) out vec4 albedoSpecular; // Texture color and specular intensity
+    layout(location = 1) out vec2 packedNormal;   // Octahedral encoded world space normal
+
+    // Per frame values, written to the stream ring once a frame (FrameUniforms on the C++ side)
+    layout(std140, binding = 0) uniform FrameUniforms
+    {
+        mat4 view;
+        mat4 projection;
+        vec3 objectColor;
+        vec3 keyLightColor;
+        vec3 keyLightPos;
+        vec3 fillLightColor;
+        vec3 fillLightPos;
+        vec3 pyramidLightColor;
+        vec3 pyramidLightPos;
+        vec3 viewPosition;
+        vec2 uvScale;
+    };
+
+    uniform sampler2D uTexture;
+
+    // Projects the unit normal onto the octahedron |x| + |y| + |z| = 1 and folds the lower half over the upper
+    vec2 encodeNormal(vec3 n)
+    {
+        n /= abs(n.x) + abs(n.y) + abs(n.z);
+        vec2 folded = (1.0f - abs(n.yx)) * vec2(n.x >= 0.0f ? 1.0f : -1.0f, n.y >= 0.0f ? 1.0f : -1.0f);
+        return n.z >= 0.0f ? n.xy : folded;
+    }
+
+    void main()
+    {
+        // Same specular intensity as the forward object shader
+        albedoSpecular = vec4(texture(uTexture, vertexTextureCoordinate * uvScale).rgb, 0.8f);
+        packedNormal = encodeNormal(normalize(vertexNormal));
+    }
+);
+
+
+/* Deferred Lighting Vertex Shader Source Code*/
+const GLchar* deferredLightVertexShaderSource = GLSL(440,
+
+    void main()
+    {
+        // Fullscreen triangle on the far plane, so a GL_GREATER depth test keeps only pixels an object covered
+        vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+        gl_Position = vec4(corner * 2.0f - 1.0f, 1.0f, 1.0f);
+    }
+);
+
+
+/* Deferred Lighting Fragment Shader Source Code*/
+const GLchar* deferredLightFragmentShaderSource = GLSL(440,
+
+    out vec4 fragmentColor; // One light's contribution, added to the framebuffer
+
+    // Per frame values, written to the stream ring once a frame (FrameUniforms on the C++ side)
+    layout(std140, binding = 0) uniform FrameUniforms
+    {
+        mat4 view;
+        mat4 projection;
+        vec3 objectColor;
+        vec3 keyLightColor;
+        vec3 keyLightPos;
+        vec3 fillLightColor;
+        vec3 fillLightPos;
+        vec3 pyramidLightColor;
+        vec3 pyramidLightPos;
+        vec3 viewPosition;
+        vec2 uvScale;
+    };
+
+    uniform sampler2D albedoSpecular;
+    uniform sampler2D packedNormal;
+    uniform sampler2D depth;
+    uniform mat4 inverseViewProjection;
+    uniform vec3 lightPosition;
+    uniform vec3 lightColor;
+    uniform int shadowLight; // Atlas light index, -1 for none
+    uniform vec2 viewportSize; // The objects filled the lower left of the G-buffer this size
+
+    // Shadow maps of the lights in the atlas (ShadowUniforms on the C++ side, see shadows.h)
+    layout(std140, binding = 1) uniform ShadowUniforms
+    {
+        mat4 shadowMatrices[16];
+        vec4 shadowRects[16];
+        ivec4 shadowLights[4]; // first tile, tile count (0 without shadows), 1 for the six cube faces of a point light
+    };
+
+    uniform sampler2DShadow shadowAtlas;
+
+    // Compares the position with one tile, averaging the results of its 2x2 nearest texels
+    float shadowLookup(int tile, vec4 position)
+    {
+        vec4 clip = shadowMatrices[tile] * position;
+        vec3 coord = clip.xyz / clip.w * 0.5f + 0.5f;
+        vec4 rect = shadowRects[tile];
+        return texture(shadowAtlas, vec3(rect.xy + clamp(coord.xy, 0.001f, 0.999f) * rect.zw, coord.z));
+    }
+
+    // Fraction of the light reaching the position: 1 lit, 0 in shadow
+    float shadowFactor(int light, vec3 lightPosition, vec3 position, vec3 normal)
+    {
+        if (light < 0 || shadowLights[light].y == 0)
+            return 1.0f;
+        ivec4 tiles = shadowLights[light];
+        // looking up a little off the surface keeps it from shadowing itself
+        vec4 offsetPosition = vec4(position + normal * 0.02f, 1.0f);
+        if (tiles.z == 1)
+        {
+            // the cube face the light sees the position through
+            vec3 d = position - lightPosition;
+            vec3 a = abs(d);
+            int face = a.x >= a.y && a.x >= a.z ? (d.x >= 0.0f ? 0 : 1) : (a.y >= a.z ? (d.y >= 0.0f ? 2 : 3) : (d.z >= 0.0f ? 4 : 5));
+            return shadowLookup(tiles.x + face, offsetPosition);
+        }
+        // the nearest cascade holding the position
+        for (int cascade = 0; cascade < tiles.y; cascade++)
+        {
+            vec4 clip = shadowMatrices[tiles.x + cascade] * offsetPosition;
+            if (all(lessThanEqual(abs(clip.xyz / clip.w), vec3(1.0f))))
+                return shadowLookup(tiles.x + cascade, offsetPosition);
+        }
+        return 1.0f;
+    }
+
+    vec3 decodeNormal(vec2 encoded)
+    {
+        vec3 n = vec3(encoded, 1.0f - abs(encoded.x) - abs(encoded.y));
+        float fold = max(-n.z, 0.0f);
+        n.x += n.x >= 0.0f ? -fold : fold;
+        n.y += n.y >= 0.0f ? -fold : fold;
+        return normalize(n);
+    }
+
+    void main()
+    {
+        ivec2 pixel = ivec2(gl_FragCoord.xy);
+        vec4 surface = texelFetch(albedoSpecular, pixel, 0);
+        vec3 norm = decodeNormal(texelFetch(packedNormal, pixel, 0).xy);
+
+        // World position from the pixel and its depth
+        vec2 ndc = gl_FragCoord.xy / viewportSize * 2.0f - 1.0f;
+        vec4 world = inverseViewProjection * vec4(ndc, texelFetch(depth, pixel, 0).r * 2.0f - 1.0f, 1.0f);
+        vec3 fragmentPos = world.xyz / world.w;
+
+        // The forward object shader's Phong terms for this light
+        vec3 ambient = 0.1f * lightColor;
+        vec3 lightDirection = normalize(lightPosition - fragmentPos);
+        vec3 diffuse = max(dot(norm, lightDirection), 0.0) * lightColor;
+        vec3 viewDir = normalize(viewPosition - fragmentPos);
+        vec3 reflectDir = reflect(-lightDirection, norm);
+        vec3 specular = surface.a * pow(max(dot(viewDir, reflectDir), 0.0), 16.0f) * lightColor;
+        float shadow = shadowFactor(shadowLight, lightPosition, fragmentPos, norm);
+
+        fragmentColor = vec4((ambient + shadow * (diffuse + specular)) * surface.rgb, 1.0);
+    }
+);
+
+
+/* Depth Pre-pass Vertex Shader Source Code*/
+const GLchar* depthVertexShaderSource = GLSL(440,
+    layout(location = 0) in vec3 position;
+    layout(location = 3) in mat4 model; // Same instance attributes as the object shader
+
+    // Leading members of the object shader's FrameUniforms block, read from the same range
+    layout(std140, binding = 0) uniform FrameUniforms
+    {
+        mat4 view;
+        mat4 projection;
+    };
+
+    invariant gl_Position;
+
+    void main()
+    {
+        gl_Position = projection * view * model * vec4(position, 1.0f);
+    }
+);
+
+
+/* Depth Pre-pass Fragment Shader Source Code*/
+const GLchar* depthFragmentShaderSource = GLSL(440,
+
+    void main()
+    {
+        // Depth only, color writes are masked off
+    }
+);
+
 /* Lamp Shader Source Code*/
 const GLchar* lampVertexShaderSource = GLSL(440,
 
@@ -243,6 +712,199 @@ const GLchar* lampFragmentShaderSource = GLSL(440,
     }
 );
 
+/* Hi-Z Downsample Vertex Shader Source Code*/
+const GLchar* hizVertexShaderSource = GLSL(440,
+
+    void main()
+    {
+        // Fullscreen triangle from the vertex index: (-1,-1), (3,-1), (-1,3)
+        vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+        gl_Position = vec4(corner * 2.0f - 1.0f, 0.0f, 1.0f);
+    }
+);
+
+
+/* Hi-Z Downsample Fragment Shader Source Code*/
+const GLchar* hizFragmentShaderSource = GLSL(440,
+
+    uniform sampler2D depthLevel; // Depth buffer copy, or the previous pyramid level
+    uniform int sourceLevel;
+    uniform ivec2 sourceSize;     // Texels of the source holding depth, the rest are left from larger frames
+
+    out float maxDepth; // Farthest depth of the 2x2 source texels under this texel
+
+    void main()
+    {
+        ivec2 last = sourceSize - 1;
+        ivec2 source = ivec2(gl_FragCoord.xy) * 2;
+        float depth0 = texelFetch(depthLevel, min(source, last), sourceLevel).r;
+        float depth1 = texelFetch(depthLevel, min(source + ivec2(1, 0), last), sourceLevel).r;
+        float depth2 = texelFetch(depthLevel, min(source + ivec2(0, 1), last), sourceLevel).r;
+        float depth3 = texelFetch(depthLevel, min(source + ivec2(1, 1), last), sourceLevel).r;
+        maxDepth = max(max(depth0, depth1), max(depth2, depth3));
+    }
+);
+
+
+/* Upscale Fragment Shader Source Code (with the Hi-Z vertex shader's fullscreen triangle)*/
+const GLchar* upscaleFragmentShaderSource = GLSL(440,
+
+    uniform sampler2D source; // Scene rendered into the lower left sourceSize texels
+    uniform vec2 sourceSize;
+    uniform vec2 outputSize;
+
+    out vec4 fragmentColor;
+
+    void main()
+    {
+        // Catmull-Rom weights of the 4x4 texels around the sample point; the middle two texels of each axis
+        // are merged into one bilinear tap, so the filter takes 9 taps instead of 16
+        vec2 size = vec2(textureSize(source, 0));
+        vec2 position = gl_FragCoord.xy / outputSize * sourceSize;
+        vec2 center = floor(position - 0.5f) + 0.5f;
+        vec2 f = position - center;
+        vec2 w0 = f * (-0.5f + f * (1.0f - 0.5f * f));
+        vec2 w1 = 1.0f + f * f * (-2.5f + 1.5f * f);
+        vec2 w2 = f * (0.5f + f * (2.0f - 1.5f * f));
+        vec2 w3 = f * f * (-0.5f + 0.5f * f);
+        vec2 w12 = w1 + w2;
+
+        // Taps stay inside the rendered region, which repeats its edge texels
+        vec2 low = vec2(0.5f) / size;
+        vec2 high = (sourceSize - 0.5f) / size;
+        vec2 tap0 = clamp((center - 1.0f) / size, low, high);
+        vec2 tap12 = clamp((center + w2 / w12) / size, low, high);
+        vec2 tap3 = clamp((center + 2.0f) / size, low, high);
+
+        vec3 color = texture(source, vec2(tap0.x, tap0.y)).rgb * (w0.x * w0.y);
+        color += texture(source, vec2(tap12.x, tap0.y)).rgb * (w12.x * w0.y);
+        color += texture(source, vec2(tap3.x, tap0.y)).rgb * (w3.x * w0.y);
+        color += texture(source, vec2(tap0.x, tap12.y)).rgb * (w0.x * w12.y);
+        color += texture(source, vec2(tap12.x, tap12.y)).rgb * (w12.x * w12.y);
+        color += texture(source, vec2(tap3.x, tap12.y)).rgb * (w3.x * w12.y);
+        color += texture(source, vec2(tap0.x, tap3.y)).rgb * (w0.x * w3.y);
+        color += texture(source, vec2(tap12.x, tap3.y)).rgb * (w12.x * w3.y);
+        color += texture(source, vec2(tap3.x, tap3.y)).rgb * (w3.x * w3.y);
+
+        // The negative lobes can overshoot at hard edges
+        fragmentColor = vec4(clamp(color, 0.0f, 1.0f), 1.0f);
+    }
+);
+
+
+/* GPU Cull Compute Shader Source Code*/
+const GLchar* cullComputeShaderSource = GLSL(440,
+    layout(local_size_x = 64) in;
+
+    // GpuCullObject and DrawElementsIndirectCommand on the C++ side
+    struct CullObject
+    {
+        vec3 boundsMin;
+        uint node;
+        vec3 boundsMax;
+        uint batch;
+        uvec4 firstIndex; // Index range of each detail level
+        uvec4 indexCount;
+        uint levelCount;
+        uint commandBase;
+        uint padding0;
+        uint padding1;
+    };
+    struct DrawCommand
+    {
+        uint count;
+        uint instanceCount;
+        uint firstIndex;
+        int baseVertex;
+        uint baseInstance;
+    };
+
+    layout(std430, binding = 0) readonly buffer Objects { CullObject objects[]; };
+    layout(std430, binding = 1) readonly buffer Instances { mat4 instances[]; }; // The stream ring's instance matrices
+    layout(std430, binding = 2) writeonly buffer Commands { DrawCommand commands[]; };
+    layout(std430, binding = 3) buffer Counts { uint counts[]; }; // Commands written per batch
+
+    uniform uint objectCount;
+    uniform uint instanceBase;
+    uniform vec4 frustumPlanes[6];
+    uniform vec3 cameraPosition;
+    uniform vec2 lodProjection; // tan(fovy / 2) in perspective, else 0 and the ortho half height
+    uniform vec3 lodThresholds;
+
+    void main()
+    {
+        uint i = gl_GlobalInvocationID.x;
+        if (i >= objectCount)
+            return;
+        CullObject object = objects[i];
+        mat4 model = instances[instanceBase + object.node];
+
+        // World space box around the transformed model box, as BoundingBox::Transform, tested like Frustum::TestBox
+        vec3 center = vec3(model * vec4((object.boundsMin + object.boundsMax) * 0.5f, 1.0f));
+        vec3 extents = mat3(abs(model[0].xyz), abs(model[1].xyz), abs(model[2].xyz)) * ((object.boundsMax - object.boundsMin) * 0.5f);
+        for (int p = 0; p < 6; p++)
+        {
+            vec4 plane = frustumPlanes[p];
+            if (dot(plane.xyz, center) + plane.w + dot(abs(plane.xyz), extents) < 0.0f)
+                return;
+        }
+
+        // Detail level from the bounding sphere's size on screen, as LodSelector picks it minus the hysteresis
+        float radius = length(extents);
+        float screenSize = radius / lodProjection.y;
+        if (lodProjection.x > 0.0f)
+        {
+            float distance = length(center - cameraPosition);
+            screenSize = distance <= radius ? 1.0f : radius / (distance * lodProjection.x);
+        }
+        uint level = 0u;
+        while (level + 1u < object.levelCount && screenSize < lodThresholds[level])
+            level++;
+
+        uint slot = atomicAdd(counts[object.batch], 1u);
+        DrawCommand command;
+        command.count = object.indexCount[level];
+        command.instanceCount = 1u;
+        command.firstIndex = object.firstIndex[level];
+        command.baseVertex = 0;
+        command.baseInstance = instanceBase + object.node;
+        commands[object.commandBase + slot] = command;
+    }
+);
+
+
+/* Stats Overlay Vertex Shader Source Code*/
+const GLchar* textVertexShaderSource = GLSL(440,
+
+    layout(location = 0) in vec4 vertex; // Clip space position in xy, font texture coordinates in zw
+
+    out vec2 glyphCoordinate;
+
+    void main()
+    {
+        gl_Position = vec4(vertex.xy, 0.0f, 1.0f);
+        glyphCoordinate = vertex.zw;
+    }
+);
+
+
+/* Stats Overlay Fragment Shader Source Code*/
+const GLchar* textFragmentShaderSource = GLSL(440,
+
+    in vec2 glyphCoordinate;
+
+    out vec4 fragmentColor;
+
+    uniform sampler2D glyphs;
+
+    void main()
+    {
+        // White text on a translucent black background
+        float ink = texture(glyphs, glyphCoordinate).r;
+        fragmentColor = mix(vec4(0.0f, 0.0f, 0.0f, 0.6f), vec4(1.0f), ink);
+    }
+);
+
 // Images are loaded with Y axis going down, but OpenGL's Y axis goes up, so let's flip it
 void flipImageVertically(unsigned char* image, int width, int height, int channels)
 {
@@ -268,67 +930,185 @@ int main(int argc, char* argv[])
         return EXIT_FAILURE;
 
     // Create the mesh
+    ProfileScope meshScope(gProfiler, "mesh build");
     UCreateMesh(gMesh1); // Calls the function to create the Vertex Buffer Object
     UCreateDrawer(gMesh2);
     UCreatePlane(gMesh3);
     UCreateLegs(gMesh4);
     UCreateLight(gLightMesh);
     UCreatePyramidLight(gLightMesh2);
+    meshScope.End();
 
     // Create the shader programs
     if (!UCreateShaderProgram(objectVertexShaderSource, objectFragmentShaderSource, gObjectProgramId))
         return EXIT_FAILURE;
     if (!UCreateShaderProgram(lampVertexShaderSource, lampFragmentShaderSource, gLightProgramId))
         return EXIT_FAILURE;
+    if (!UCreateShaderProgram(hizVertexShaderSource, hizFragmentShaderSource, gHiZProgramId))
+        return EXIT_FAILURE;
+    if (!UCreateShaderProgram(textVertexShaderSource, textFragmentShaderSource, gTextProgramId))
+        return EXIT_FAILURE;
+    if (!UCreateComputeProgram(cullComputeShaderSource, gCullProgramId))
+        return EXIT_FAILURE;
+    if (!UCreateShaderProgram(depthVertexShaderSource, depthFragmentShaderSource, gDepthProgramId))
+        return EXIT_FAILURE;
+    if (!UCreateShaderProgram(objectVertexShaderSource, gbufferFragmentShaderSource, gGBufferProgramId))
+        return EXIT_FAILURE;
+    if (!UCreateShaderProgram(deferredLightVertexShaderSource, deferredLightFragmentShaderSource, gDeferredLightProgramId))
+        return EXIT_FAILURE;
+    if (!UCreateShaderProgram(hizVertexShaderSource, upscaleFragmentShaderSource, gUpscaleProgramId))
+        return EXIT_FAILURE;
+
+    // One worker per spare core; the main thread runs jobs too whenever it waits, and is the only one calling GL
+    unsigned int cores = thread::hardware_concurrency();
+    gJobs.Start(cores > 1 ? (int)(cores - 1) : 0);
 
-    // Load textures
-    const char* texFilename1 = "Wood1.jpeg";
-    if (!UCreateTexture(texFilename1, gTextureId1))
+    // Load textures: decode all images in parallel, then upload them here on the GL thread
+    DecodedImage images[3] = {
+        { "Wood1.jpeg", nullptr, 0, 0, 0 },
+        { "Wood2.jpeg", nullptr, 0, 0, 0 },
+        { "Bricks.jpeg", nullptr, 0, 0, 0 }
+    };
+    GLuint* textureIds[3] = { &gTextureId1, &gTextureId2, &gTextureId3 };
+    JobCounter decoded;
+    for (int i = 0; i < 3; i++)
     {
-        cout << "Failed to load texture " << texFilename1 << endl;
-        return EXIT_FAILURE;
+        DecodedImage* image = &images[i];
+        gJobs.Run([image] { UDecodeImage(*image); }, decoded);
     }
-
-    const char* texFilename2 = "Wood2.jpeg";
-    if (!UCreateTexture(texFilename2, gTextureId2))
+    gJobs.Wait(decoded);
+    bool texturesLoaded = true;
+    for (int i = 0; i < 3; i++)
     {
-        cout << "Failed to load texture " << texFilename2 << endl;
-        return EXIT_FAILURE;
+        if (texturesLoaded && !UCreateTexture(images[i], *textureIds[i]))
+        {
+            cout << "Failed to load texture " << images[i].filename << endl;
+            texturesLoaded = false;
+        }
+        stbi_image_free(images[i].pixels);
     }
+    if (!texturesLoaded)
+        return EXIT_FAILURE;
 
-    const char* texFilename3 = "Bricks.jpeg";
-    if (!UCreateTexture(texFilename3, gTextureId3))
+    // Build the scene graph now that meshes and textures exist
+    UCreateScene();
+    UCreateStreamRing();
+    UCreateGpuCuller();
+    UCreateShadows();
+
+    // Occlusion queries draw bounding boxes with the (position only) lamp shader
+    gOcclusion.Init(gLightProgramId);
+    gOcclusion.Enabled = gOcclusionMode == OCCLUSION_QUERIES;
+    gHiZ.Init(gHiZProgramId, gFramebuffers);
+    gProfiler.Init();
+    gFragmentCounter.Init();
+    gGBuffer.Init(gDeferredLightProgramId, gFramebuffers);
+    gSceneTarget.Init(gUpscaleProgramId, gFramebuffers);
+    gGpuFrameTimer.Init();
+    gOverlay.Init(gTextProgramId, gStreamRing);
+
+    // Frame graph: transforms and BVH refit, then culling and draw packet recording. The GL work around it
+    // (occlusion results before, replay after) stays on the main thread.
+    gRenderQueue.Init(&gJobs);
+    int transformsTask = gFrameGraph.Add("transforms", []
     {
-        cout << "Failed to load texture " << texFilename3 << endl;
-        return EXIT_FAILURE;
-    }
+        ProfileScope scope(gProfiler, "transforms");
+        gScene.Update(&gJobs, gFrameInstances);
+    });
+    gFrameGraph.Add("cull and record", []
+    {
+        ProfileScope scope(gProfiler, "cull and record");
+        URecordDrawPackets(gFrameView, gFrameProjection);
+    }, { transformsTask });
 
     // tell opengl for each sampler to which texture unit it belongs to (only has to be done once)
-    glUseProgram(gObjectProgramId);
+    GLStats::UseProgram(gObjectProgramId);
     // We set the texture as texture unit 0
-    glUniform1i(glGetUniformLocation(gObjectProgramId, "uTexture"), 0);
+    GLStats::Uniform1i(glGetUniformLocation(gObjectProgramId, "uTexture"), 0);
+    // and the shadow atlas as unit 3
+    GLStats::Uniform1i(glGetUniformLocation(gObjectProgramId, "shadowAtlas"), 3);
+    GLStats::UseProgram(gGBufferProgramId);
+    GLStats::Uniform1i(glGetUniformLocation(gGBufferProgramId, "uTexture"), 0);
 
     // Sets the background color of the window to black (it will be implicitely used by glClear)
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
 
+    // A regression run renders its fixed cases and skips the interactive loop
+    bool regressionPassed = gRegressionDir.empty() || URunRegression();
+    if (gFlythroughFrames > 0)
+        URunFlythrough();
+    bool interactive = gRegressionDir.empty() && gFlythroughFrames == 0;
+
+    // Camera movement runs at a fixed rate on its own thread from here on
+    gSimulation.Start(gCamera);
+    URequestRedraw();
+
+    // The first frame's delta starts here, not at the clock's construction before the scene was loaded
+    gFrameClock.Start();
+
     // render loop
     // -----------
-    while (!glfwWindowShouldClose(gWindow))
+    while (interactive && !glfwWindowShouldClose(gWindow))
     {
         // per-frame timing
         // --------------------
-        float currentFrame = glfwGetTime();
-        gDeltaTime = currentFrame - gLastFrame;
-        gLastFrame = currentFrame;
+        gDeltaTime = gFrameClock.Tick();
+        gWorstFrame = max(gWorstFrame, gFrameClock.Delta());
+        gProfiler.BeginFrame();
+        ProfileScope frameScope(gProfiler, "frame");
 
         // input
         // -----
+        ProfileScope inputScope(gProfiler, "input");
         UProcessInput(gWindow);
+        inputScope.End();
+
+        // Camera for this frame, blended between the last two simulation ticks
+        gCamera = gSimulation.Interpolate(chrono::steady_clock::now());
 
         // Render this frame
         URender();
 
         glfwPollEvents();
+
+        // Close this frame's GL call counters; the overlay and the title show the last complete frame
+        GLStats::EndFrame();
+        gStatsLog.Write(gFrameClock.FrameCount, gDeltaTime * 1000.0, GLStats::Last());
+
+        // Show frame timing and the culling stats in the title bar once per second
+        if (gFrameClock.Elapsed() - gLastStatsTime >= 1000000000)
+        {
+            double seconds = FrameClock::Seconds(gFrameClock.Elapsed() - gLastStatsTime);
+            double fps = (gFrameClock.FrameCount - gStatsFrames) / seconds;
+            char timing[64];
+            snprintf(timing, sizeof(timing), " | %.0f fps (%.2f ms, worst %.2f ms)", fps, 1000.0 / fps, FrameClock::Seconds(gWorstFrame) * 1000.0);
+            gLastStatsTime = gFrameClock.Elapsed();
+            gStatsFrames = gFrameClock.FrameCount;
+            gWorstFrame = 0;
+            string title = string(WINDOW_TITLE) + timing + " | culled " + to_string(gCullStats.Culled) + "/" + to_string(gCullStats.Tested)
+                + " | occluded " + to_string(gOcclusion.Stats.Occluded + gHiZOccluded) + " (" + to_string(gOcclusion.Stats.Queries) + " queries)"
+                + " | LOD tris " + to_string(gLod.Stats.DrawnTriangles) + "/" + to_string(gLod.Stats.FullTriangles)
+                + " (" + to_string(gLod.Stats.FullTriangles - gLod.Stats.DrawnTriangles) + " saved)"
+                + " | draws " + to_string(GLStats::Last().DrawCalls);
+            glfwSetWindowTitle(gWindow, title.c_str());
+        }
+
+        frameScope.End();
+
+        // Hold the target frame rate, sleeping instead of spinning through idle time
+        ProfileScope pacingScope(gProfiler, "pacing");
+        gFramePacer.Wait();
+        pacingScope.End();
+
+        // On demand: sleep until the next frame would differ from this one
+        if (gOnDemand)
+        {
+            if (gSettleFrames > 0)
+                gSettleFrames--;
+            if (gSceneMoved)
+                URequestRedraw();
+            UWaitForChanges();
+        }
     }
 
     // Release mesh data
@@ -339,6 +1119,23 @@ int main(int argc, char* argv[])
     UDestroyMesh(gLightMesh);
     UDestroyMesh(gLightMesh2);
 
+    // Stop the simulation and the job system, and release occlusion queries, the depth pyramid and the stream ring
+    gSimulation.Stop();
+    gJobs.Stop();
+    gOcclusion.Destroy();
+    gHiZ.Destroy();
+    gProfiler.Destroy();
+    gFragmentCounter.Destroy();
+    gGBuffer.Destroy();
+    gSceneTarget.Destroy();
+    gGpuFrameTimer.Destroy();
+    gFramebuffers.Destroy();
+    gShadowAtlas.Destroy();
+    gOverlay.Destroy();
+    gStreamRing.Destroy();
+    gGpuCuller.Destroy();
+    gStatsLog.Close();
+
     // Release texture
     UDestroyTexture(gTextureId1);
     UDestroyTexture(gTextureId2);
@@ -347,12 +1144,19 @@ int main(int argc, char* argv[])
     // Release shader program
     UDestroyShaderProgram(gObjectProgramId);
     UDestroyShaderProgram(gLightProgramId);
-
-    exit(EXIT_SUCCESS); // Terminates the program successfully
+    UDestroyShaderProgram(gHiZProgramId);
+    UDestroyShaderProgram(gTextProgramId);
+    UDestroyShaderProgram(gCullProgramId);
+    UDestroyShaderProgram(gDepthProgramId);
+    UDestroyShaderProgram(gGBufferProgramId);
+    UDestroyShaderProgram(gDeferredLightProgramId);
+    UDestroyShaderProgram(gUpscaleProgramId);
+
+    exit(regressionPassed ? EXIT_SUCCESS : EXIT_FAILURE); // Terminates the program successfully
 }
 
 
-// Initialize GLFW, GLEW, and create a window
+// Initialize GLFW and the GL loader, and create a window
 bool UInitialize(int argc, char* argv[], GLFWwindow** window)
 {
     // GLFW: initialize and configure
@@ -366,6 +1170,59 @@ bool UInitialize(int argc, char* argv[], GLFWwindow** window)
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 #endif
 
+    // --fps <rate> paces frames on the CPU clock with vsync off; without it vsync paces the loop
+    // --stats-log <file> writes the GL call counters of every frame, as CSV or as JSON lines for a .json file
+    // --regression <dir> runs the render regression suite in a hidden window, writing its results to <dir>
+    // --goldens <dir> compares the regression images with the goldens in <dir> (regression/goldens by default)
+    // --record writes the regression images as the goldens, --record-baselines the frame times as this machine's baselines
+    // --flythrough <frames> renders the canned camera flythrough in a hidden window and prints its timings
+    // --gpu-cull starts with GPU driven culling and submission
+    // --depth-prepass starts with the depth pre-pass on
+    // --deferred starts with deferred shading
+    // --no-shadow-cache redraws every shadow map every frame
+    // --on-demand only renders frames while the camera, the scene or the window changes
+    // --dynamic-resolution starts with the render scale following the GPU frame time
+    for (int i = 1; i < argc; i++)
+    {
+        string option = argv[i];
+        if (option == "--record")
+            gRecordGoldens = true;
+        if (option == "--record-baselines")
+            gRecordBaselines = true;
+        if (option == "--gpu-cull")
+            gGpuDriven = true;
+        if (option == "--depth-prepass")
+            gDepthPrePass = true;
+        if (option == "--deferred")
+            gDeferred = true;
+        if (option == "--no-shadow-cache")
+            gShadowAtlas.CacheEnabled = false;
+        if (option == "--on-demand")
+            gOnDemand = true;
+        if (option == "--dynamic-resolution")
+            gDynamicResolution = true;
+        if (i + 1 >= argc)
+            continue;
+        if (option == "--fps")
+            gFramePacer.SetTarget(atof(argv[i + 1]));
+        if (option == "--stats-log" && !gStatsLog.Open(argv[i + 1]))
+            std::cerr << "Failed to open stats log " << argv[i + 1] << std::endl;
+        if (option == "--regression")
+            gRegressionDir = argv[i + 1];
+        if (option == "--goldens")
+            gGoldenDir = argv[i + 1];
+        if (option == "--flythrough")
+            gFlythroughFrames = atoi(argv[i + 1]);
+    }
+#ifdef HEADLESS_RENDERER
+    // The headless build runs the regression suite, into ./regression/results unless given a directory, when it isn't flying through
+    if (gRegressionDir.empty() && gFlythroughFrames == 0)
+        gRegressionDir = "regression/results";
+#endif
+    bool hidden = !gRegressionDir.empty() || gFlythroughFrames > 0;
+    if (hidden)
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+
     // GLFW: window creation
     // ---------------------
     * window = glfwCreateWindow(WINDOW_WIDTH, WINDOW_HEIGHT, WINDOW_TITLE, NULL, NULL);
@@ -376,29 +1233,31 @@ bool UInitialize(int argc, char* argv[], GLFWwindow** window)
         return false;
     }
     glfwMakeContextCurrent(*window);
+    int framebufferWidth, framebufferHeight;
+    glfwGetFramebufferSize(*window, &framebufferWidth, &framebufferHeight);
+    gFramebuffers.Resize(framebufferWidth, framebufferHeight);
     glfwSetFramebufferSizeCallback(*window, UResizeWindow);
     glfwSetCursorPosCallback(*window, UMousePositionCallback);
     glfwSetScrollCallback(*window, UMouseScrollCallback);
     glfwSetMouseButtonCallback(*window, UMouseButtonCallback);
+    glfwSetKeyCallback(*window, UKeyCallback);
+    glfwSetWindowRefreshCallback(*window, UWindowRefreshCallback);
 
     // tell GLFW to capture our mouse
     glfwSetInputMode(*window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
-    // GLEW: initialize
-    // ----------------
-    // Note: if using GLEW version 1.13 or earlier
-    glewExperimental = GL_TRUE;
-    GLenum GlewInitResult = glewInit();
-
-    if (GLEW_OK != GlewInitResult)
-    {
-        std::cerr << glewGetErrorString(GlewInitResult) << std::endl;
+    // GL loader: initialize
+    // ---------------------
+    // Entry points are looked up through GLFW the first time they are called
+    if (!GLLoader::Init((GLLoader::ProcAddressFunction)glfwGetProcAddress, 4, 4))
         return false;
-    }
 
     // Displays GPU OpenGL version
     cout << "INFO: OpenGL Version: " << glGetString(GL_VERSION) << endl;
 
+    // Hidden runs and paced frames don't wait for vsync
+    glfwSwapInterval(gFramePacer.TargetFps > 0.0 || hidden ? 0 : 1);
+
     return true;
 }
 
@@ -410,32 +1269,163 @@ void UProcessInput(GLFWwindow* window)
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
         glfwSetWindowShouldClose(window, true);
 
-    float cameraOffset = gCamera.MovementSpeed * gDeltaTime;
-
-    if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
-        gCamera.ProcessKeyboard(FORWARD, gDeltaTime);
-    if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
-        gCamera.ProcessKeyboard(BACKWARD, gDeltaTime);
-    if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
-        gCamera.ProcessKeyboard(LEFT, gDeltaTime);
-    if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
-        gCamera.ProcessKeyboard(RIGHT, gDeltaTime);
-    if (glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS)
-        gCamera.Position += gCameraUp * cameraOffset;
-    if (glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS)
-        gCamera.Position -= gCameraUp * cameraOffset;
+    // Movement keys are only sampled here; the simulation thread applies them every tick
+    gSimulation.SetKeys(glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS,
+        glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS,
+        glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS,
+        glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS,
+        glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS,
+        glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS);
 
     if (glfwGetKey(window, GLFW_KEY_V) == GLFW_PRESS)
         perspective = false;
     if (glfwGetKey(window, GLFW_KEY_B) == GLFW_PRESS)
         perspective = true;
+
+    // O culls with occlusion queries, H against the Hi-Z pyramid, P turns occlusion culling off (plain frustum culling)
+    if (glfwGetKey(window, GLFW_KEY_O) == GLFW_PRESS)
+        gOcclusionMode = OCCLUSION_QUERIES;
+    if (glfwGetKey(window, GLFW_KEY_H) == GLFW_PRESS)
+        gOcclusionMode = OCCLUSION_HIZ;
+    if (glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS)
+        gOcclusionMode = OCCLUSION_OFF;
+    gOcclusion.Enabled = gOcclusionMode == OCCLUSION_QUERIES;
+
+    // G switches object culling and draw submission between the CPU and the GPU
+    bool gpuDrivenKey = glfwGetKey(window, GLFW_KEY_G) == GLFW_PRESS;
+    if (gpuDrivenKey && !gGpuDrivenKeyDown)
+    {
+        if (gGpuCullSupported)
+        {
+            gGpuDriven = !gGpuDriven;
+            // GPU driven frames don't build the Hi-Z pyramid, so the last one is too old to test against
+            gHiZ.Invalidate();
+            cout << "GPU driven culling " << (gGpuDriven ? "on" : "off") << endl;
+        }
+        else
+            cout << "GPU driven culling needs OpenGL 4.6 or GL_ARB_indirect_parameters" << endl;
+    }
+    gGpuDrivenKeyDown = gpuDrivenKey;
+
+    // Z switches the depth pre-pass on and off
+    bool depthPrePassKey = glfwGetKey(window, GLFW_KEY_Z) == GLFW_PRESS;
+    if (depthPrePassKey && !gDepthPrePassKeyDown)
+    {
+        gDepthPrePass = !gDepthPrePass;
+        cout << "Depth pre-pass " << (gDepthPrePass ? "on" : "off") << endl;
+    }
+    gDepthPrePassKeyDown = depthPrePassKey;
+
+    // F switches between forward and deferred shading
+    bool deferredKey = glfwGetKey(window, GLFW_KEY_F) == GLFW_PRESS;
+    if (deferredKey && !gDeferredKeyDown)
+    {
+        gDeferred = !gDeferred;
+        cout << (gDeferred ? "Deferred" : "Forward") << " shading" << endl;
+    }
+    gDeferredKeyDown = deferredKey;
+
+    // K switches shadows on and off
+    bool shadowsKey = glfwGetKey(window, GLFW_KEY_K) == GLFW_PRESS;
+    if (shadowsKey && !gShadowsKeyDown)
+    {
+        gShadows = !gShadows;
+        cout << "Shadows " << (gShadows ? "on" : "off") << endl;
+    }
+    gShadowsKeyDown = shadowsKey;
+
+    // R switches dynamic resolution on and off; it starts again from the full resolution
+    bool dynamicResolutionKey = glfwGetKey(window, GLFW_KEY_R) == GLFW_PRESS;
+    if (dynamicResolutionKey && !gDynamicResolutionKeyDown)
+    {
+        gDynamicResolution = !gDynamicResolution;
+        gResolution.Reset();
+        cout << "Dynamic resolution " << (gDynamicResolution ? "on" : "off") << endl;
+    }
+    gDynamicResolutionKeyDown = dynamicResolutionKey;
+
+    // T prints the recent pass timings and writes them as a Chrome trace (open in chrome://tracing or Perfetto)
+    bool traceKey = glfwGetKey(window, GLFW_KEY_T) == GLFW_PRESS;
+    if (traceKey && !gTraceKeyDown)
+    {
+        gProfiler.PrintSummary(cout);
+        const char* tracePath = "frame_trace.json";
+        if (gProfiler.WriteChromeTrace(tracePath))
+            cout << "Wrote " << tracePath << endl;
+        else
+            cout << "Failed to write " << tracePath << endl;
+    }
+    gTraceKeyDown = traceKey;
+
+    // I shows or hides the GL call counters
+    bool overlayKey = glfwGetKey(window, GLFW_KEY_I) == GLFW_PRESS;
+    if (overlayKey && !gOverlayKeyDown)
+        gShowOverlay = !gShowOverlay;
+    gOverlayKeyDown = overlayKey;
 }
 
 
 // glfw: whenever the window size changed (by OS or user resize) this callback function executes
 void UResizeWindow(GLFWwindow* window, int width, int height)
 {
+    gFramebuffers.Resize(width, height);
     glViewport(0, 0, width, height);
+    URequestRedraw();
+}
+
+
+// glfw: the window's contents were damaged (uncovered, restored) and have to be drawn again
+// -----------------------------------------------------------------------------------------
+void UWindowRefreshCallback(GLFWwindow* window)
+{
+    URequestRedraw();
+}
+
+
+// glfw: whenever a key is pressed or released, this callback is called
+// --------------------------------------------------------------------
+// The keys themselves are polled in UProcessInput; this only tells on-demand rendering that something may change
+void UKeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods)
+{
+    if (action == GLFW_PRESS)
+        gKeysHeld++;
+    else if (action == GLFW_RELEASE && gKeysHeld > 0)
+        gKeysHeld--;
+    URequestRedraw();
+}
+
+
+// Keeps on-demand rendering going for the settle frames and time from now
+void URequestRedraw()
+{
+    gSettleFrames = ON_DEMAND_SETTLE_FRAMES;
+    gRedrawUntil = FrameClock::Now() + ON_DEMAND_SETTLE_TIME;
+}
+
+
+// On-demand rendering: returns once a frame is due (a redraw was requested and is still settling, a key is held,
+// or the camera moved since the last frame) or the window is closing, waiting for events in between. Changes
+// that come without an event, like the simulation thread moving the camera, are seen at the next timeout.
+void UWaitForChanges()
+{
+    bool waited = false;
+    while (!glfwWindowShouldClose(gWindow))
+    {
+        if (gSettleFrames > 0 || gKeysHeld > 0 || FrameClock::Now() < gRedrawUntil)
+            break;
+        Camera camera = gSimulation.Interpolate(chrono::steady_clock::now());
+        if (camera.Position != gCamera.Position || camera.Yaw != gCamera.Yaw || camera.Pitch != gCamera.Pitch || camera.Zoom != gCamera.Zoom)
+        {
+            URequestRedraw();
+            break;
+        }
+        glfwWaitEventsTimeout(ON_DEMAND_TIMEOUT);
+        waited = true;
+    }
+
+    // The time spent waiting isn't part of the next frame
+    if (waited)
+        gFrameClock.Resume();
 }
 
 
@@ -456,7 +1446,8 @@ void UMousePositionCallback(GLFWwindow* window, double xpos, double ypos)
     gLastX = xpos;
     gLastY = ypos;
 
-    gCamera.ProcessMouseMovement(xoffset, yoffset);
+    gSimulation.AddMouseMovement(xoffset, yoffset);
+    URequestRedraw();
 }
 
 
@@ -467,10 +1458,9 @@ void UMouseScrollCallback(GLFWwindow* window, double xoffset, double yoffset)
 
     if (yoffset != 0)
     {
-        gCamera.MovementSpeed += yoffset;
+        gSimulation.AddScroll(yoffset);
+        URequestRedraw();
     }
-    else
-        gCamera.MovementSpeed = gCamera.MovementSpeed;
 
 }
 
@@ -478,12 +1468,16 @@ void UMouseScrollCallback(GLFWwindow* window, double xoffset, double yoffset)
 // --------------------------------
 void UMouseButtonCallback(GLFWwindow* window, int button, int action, int mods)
 {
+    URequestRedraw();
     switch (button)
     {
     case GLFW_MOUSE_BUTTON_LEFT:
     {
         if (action == GLFW_PRESS)
+        {
             cout << "Left mouse button pressed" << endl;
+            UPickObject();
+        }
         else
             cout << "Left mouse button released" << endl;
     }
@@ -517,161 +1511,814 @@ void UMouseButtonCallback(GLFWwindow* window, int button, int action, int mods)
 // Function called to render a frame
 void URender()
 {
+    // Next region of the stream ring; waits only if the GPU is still reading what was written there three frames ago
+    gStreamRing.BeginFrame();
+
+    // Dynamic resolution: the controller gets the GPU time of a frame a few frames back, then this one is timed
+    // unless every timer still waits for its result
+    double gpuMilliseconds = 0.0;
+    if (gGpuFrameTimer.Resolve(gpuMilliseconds))
+    {
+        gGpuFrameTime = gpuMilliseconds;
+        // paced frames have the pacer's budget; vsync is assumed to run at 60 Hz
+        if (gDynamicResolution)
+            gResolution.Update(gpuMilliseconds, 1000.0 / (gFramePacer.TargetFps > 0.0 ? gFramePacer.TargetFps : 60.0));
+    }
+    bool timeFrame = gGpuFrameTimer.Ready();
+    if (timeFrame)
+        gGpuFrameTimer.Begin();
+
     // Enable z-depth
     glEnable(GL_DEPTH_TEST);
 
     // Clear the frame and z buffers
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    const int framebufferWidth = gFramebuffers.Width, framebufferHeight = gFramebuffers.Height;
+    // Offscreen textures no target took back in a while are freed
+    gFramebuffers.Trim();
 
     // camera/view transformation
     glm::mat4 view = gCamera.GetViewMatrix();
 
-    // Creates a perspective projection
+    // Creates a perspective projection with the window's current aspect ratio
+    const float nearPlane = 0.1f, farPlane = 100.0f;
+    const float aspect = gFramebuffers.Aspect();
     glm::mat4 projection;
     if (!perspective)
     {
         // p for perspective (default)
-        projection = glm::perspective(glm::radians(gCamera.Zoom), (GLfloat)WINDOW_WIDTH / (GLfloat)WINDOW_HEIGHT, 0.1f, 100.0f);
+        projection = glm::perspective(glm::radians(gCamera.Zoom), aspect, nearPlane, farPlane);
     }
     else
-        // o for ortho
-        projection = glm::ortho(-5.0f, 5.0f, -5.0f, 5.0f, 0.1f, 100.0f);
+        // o for ortho, 10 units high
+        projection = glm::ortho(-5.0f * aspect, 5.0f * aspect, -5.0f, 5.0f, nearPlane, farPlane);
+
+    // FRUSTUM CULLING
+    //----------------
+    // Collect last frame's visibility results, then run the frame graph: bring world transforms and
+    // the BVH up to date, then cull and record the frame's draw packets on the render queue
+    gOcclusion.BeginFrame();
+    gHiZ.Resolve();
+    gFrameView = view;
+    gFrameProjection = projection;
+    // The transform pass writes every node's world matrix straight into the frame's region of the ring
+    GLintptr instanceOffset = 0;
+    gFrameInstances = (glm::mat4*)gStreamRing.Allocate((GLsizeiptr)(gScene.Nodes.size() * sizeof(glm::mat4)), sizeof(glm::mat4), instanceOffset);
+    gFrameInstanceBase = (GLuint)(instanceOffset / sizeof(glm::mat4));
+    ProfileScope graphScope(gProfiler, "frame graph");
+    gFrameGraph.Run(gJobs);
+    graphScope.End();
+    gFrameInstances = nullptr;
+    const vector<DrawPacket>& packets = gRenderQueue.Packets;
+
+    // GPU driven: cull every object and write its draw command before the object pass draws them
+    if (gGpuDriven)
+    {
+        GpuProfileScope cullScope(gProfiler, "gpu cull");
+        const glm::vec2 lodProjection = perspective ? glm::vec2(0.0f, 5.0f) : glm::vec2(tanf(glm::radians(gCamera.Zoom) * 0.5f), 0.0f);
+        gGpuCuller.Cull(Frustum(projection * view), gCamera.Position, lodProjection, gLod.Thresholds, gStreamRing.Buffer(), gFrameInstanceBase);
+    }
+
+    // SHADOWS
+    //----------------
+    // Redraw the shadow maps whose light, cascade fit or casters changed, then hand the atlas to the object shaders
+    gSceneMoved = !gScene.Transforms.Changed.empty();
+    for (size_t i = 0; i < gScene.Transforms.Changed.size(); i++)
+    {
+        const SceneNode& node = gScene.Nodes[gScene.Transforms.Changed[i]];
+        if (node.Renderable >= 0 && !gRenderables[node.Renderable].lamp)
+        {
+            gShadowAtlas.Invalidate();
+            break;
+        }
+    }
+    if (gShadows)
+    {
+        GpuProfileScope shadowsScope(gProfiler, "shadows");
+        BoundingBox casters;
+        for (size_t i = 0; i < gShadowCasters.size(); i++)
+            casters.Expand(gScene.Nodes[gShadowCasters[i]].WorldBounds);
+        gShadowAtlas.UpdateDirectional(gKeyShadow, casters.Center() - gKeyLightPosition, projection * view, nearPlane, farPlane, casters);
+        gShadowAtlas.UpdateDirectional(gFillShadow, casters.Center() - gFillLightPosition, projection * view, nearPlane, farPlane, casters);
+        gShadowAtlas.UpdatePoint(gPyramidShadow, gPyramidLightPosition, 30.0f);
+        GLStats::UseProgram(gDepthProgramId);
+        gShadowAtlas.Render(framebufferWidth, framebufferHeight, UDrawShadowCasters);
+        gShadowTileRenders += gShadowAtlas.RenderedTiles;
+    }
+    GLintptr shadowUniformsOffset;
+    ShadowUniforms* shadowUniforms = (ShadowUniforms*)gStreamRing.AllocateUniforms(sizeof(ShadowUniforms), shadowUniformsOffset);
+    if (shadowUniforms)
+    {
+        gShadowAtlas.FillUniforms(*shadowUniforms, gShadows);
+        glBindBufferRange(GL_UNIFORM_BUFFER, 1, gStreamRing.Buffer(), shadowUniformsOffset, sizeof(ShadowUniforms));
+    }
+    glActiveTexture(GL_TEXTURE3);
+    GLStats::BindTexture(GL_TEXTURE_2D, gShadowAtlas.Texture());
+    glActiveTexture(GL_TEXTURE0);
+
+    // The scene renders into the offscreen target at the controller's scale, or straight into the window
+    GLuint sceneFramebuffer = 0;
+    int renderWidth = framebufferWidth, renderHeight = framebufferHeight;
+    if (gDynamicResolution)
+    {
+        gSceneTarget.Begin(framebufferWidth, framebufferHeight, gResolution.Scale());
+        sceneFramebuffer = gSceneTarget.Framebuffer();
+        renderWidth = gSceneTarget.RenderWidth;
+        renderHeight = gSceneTarget.RenderHeight;
+    }
 
     // OBJECTS
     //----------------
+    GpuProfileScope objectsScope(gProfiler, "objects");
+    // Overdraw of a frame a few frames back, once its fragment count is in
+    GLuint64 shadedFragments = 0;
+    if (gFragmentCounter.Resolve(shadedFragments))
+    {
+        if (renderWidth > 0 && renderHeight > 0)
+        {
+            gOverdraw = (double)shadedFragments / ((double)renderWidth * renderHeight);
+            gOverdrawSum += gOverdraw;
+            gOverdrawSamples++;
+        }
+    }
+    // Deferred: the objects write the G-buffer instead of lighting themselves. It is sized from the window, so
+    // render scale steps don't reallocate it; the viewport keeps the objects to the render size.
+    const GLuint shadingProgramId = gDeferred ? gGBufferProgramId : gObjectProgramId;
+    if (gDeferred)
+        gGBuffer.Begin(framebufferWidth, framebufferHeight);
     // Activate object shader
-    glUseProgram(gObjectProgramId);
-
-    // Model matrix: transformations are applied right-to-left order
-    glm::mat4 model = glm::translate(gObjectPosition) * glm::scale(gObjectScale) * glm::rotate(0.0f, gObjectRotation);
-
-    // Retrieves and passes transform matrices to the Shader program
-    GLint modelLoc = glGetUniformLocation(gObjectProgramId, "model");
-    GLint viewLoc = glGetUniformLocation(gObjectProgramId, "view");
-    GLint projLoc = glGetUniformLocation(gObjectProgramId, "projection");
-
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
-
-    // Reference matrix uniforms from the Object Shader program for the object color, light color, light position, and camera position
-    GLint objectColorLoc = glGetUniformLocation(gObjectProgramId, "objectColor");
-    GLint keyLightColorLoc = glGetUniformLocation(gObjectProgramId, "keyLightColor");
-    GLint keyLightPositionLoc = glGetUniformLocation(gObjectProgramId, "keyLightPos");
-    GLint fillLightColorLoc = glGetUniformLocation(gObjectProgramId, "fillLightColor");
-    GLint fillLightPositionLoc = glGetUniformLocation(gObjectProgramId, "fillLightPos");
-    GLint pyramidLightColorLoc = glGetUniformLocation(gObjectProgramId, "pyramidLightColor");
-    GLint pyramidLightPositionLoc = glGetUniformLocation(gObjectProgramId, "pyramidLightPos");
-    GLint viewPositionLoc = glGetUniformLocation(gObjectProgramId, "viewPosition");
-    
-    // Pass color, light, and camera data to the Object Shader program's corresponding uniforms
-    glUniform3f(objectColorLoc, gObjectColor.r, gObjectColor.g, gObjectColor.b);
-    glUniform3f(keyLightColorLoc, gKeyLightColor.r, gKeyLightColor.g, gKeyLightColor.b);
-    glUniform3f(keyLightPositionLoc, gKeyLightPosition.x, gKeyLightPosition.y, gKeyLightPosition.z);
-    glUniform3f(fillLightColorLoc, gFillLightColor.r, gFillLightColor.g, gFillLightColor.b);
-    glUniform3f(fillLightPositionLoc, gFillLightPosition.x, gFillLightPosition.y, gFillLightPosition.z);
-    glUniform3f(pyramidLightColorLoc, gPyramidLightColor.r, gPyramidLightColor.g, gPyramidLightColor.b);
-    glUniform3f(pyramidLightPositionLoc, gPyramidLightPosition.x, gPyramidLightPosition.y, gPyramidLightPosition.z);
-    const glm::vec3 cameraPosition = gCamera.Position;
-    glUniform3f(viewPositionLoc, cameraPosition.x, cameraPosition.y, cameraPosition.z);
+    GLStats::UseProgram(shadingProgramId);
 
-    GLint UVScaleLoc = glGetUniformLocation(gObjectProgramId, "uvScale");
-    glUniform2fv(UVScaleLoc, 1, glm::value_ptr(gUVScale));
-
-    // Table
-    glBindVertexArray(gMesh1.vao);  // Activate the VBOs contained within the mesh's VAO
-    glActiveTexture(GL_TEXTURE0);    // bind textures on corresponding texture units
-    glBindTexture(GL_TEXTURE_2D, gTextureId1);
-    glDrawArrays(GL_TRIANGLES, 0, gMesh1.nVertices);    // Draws the triangles
-    glBindVertexArray(0);   // Deactivate the Vertex Array Object
-    
-    // Drawer
-    glBindVertexArray(gMesh2.vao);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, gTextureId2);
-    glDrawArrays(GL_TRIANGLES, 0, gMesh2.nVertices);
-    glBindVertexArray(0);
+    // Transform matrices, color, light and camera data go to the Object Shader program's FrameUniforms block
+    // through the stream ring (model matrices are per instance)
+    GLintptr uniformsOffset;
+    FrameUniforms* uniforms = (FrameUniforms*)gStreamRing.AllocateUniforms(sizeof(FrameUniforms), uniformsOffset);
+    if (uniforms)
+    {
+        uniforms->view = view;
+        uniforms->projection = projection;
+        uniforms->objectColor = gObjectColor;
+        uniforms->keyLightColor = gKeyLightColor;
+        uniforms->keyLightPos = gKeyLightPosition;
+        uniforms->fillLightColor = gFillLightColor;
+        uniforms->fillLightPos = gFillLightPosition;
+        uniforms->pyramidLightColor = gPyramidLightColor;
+        uniforms->pyramidLightPos = gPyramidLightPosition;
+        uniforms->viewPosition = gCamera.Position;
+        uniforms->uvScale = gUVScale;
+        glBindBufferRange(GL_UNIFORM_BUFFER, 0, gStreamRing.Buffer(), uniformsOffset, sizeof(FrameUniforms));
+    }
 
-    // Plane(floor)
-    glBindVertexArray(gMesh3.vao);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, gTextureId3);
-    glDrawArrays(GL_TRIANGLES, 0, gMesh3.nVertices);
-    glBindVertexArray(0);
+    // Table, drawer, floor and legs
+    // Objects found hidden by an earlier occlusion query are skipped and only have their bounds re-queried below.
+    // The rest get an indirect draw command for the detail level recorded in their packet,
+    // with the instance count zeroed when the Hi-Z pyramid hid them.
+    gHiZOccluded = 0;
+    gHiddenNodes.clear();
+    gHiddenBounds.clear();
+    gDrawPackets.clear();
+    gDrawCommands.clear();
+    for (size_t i = 0; i < packets.size() && !gGpuDriven; i++)
+    {
+        const DrawPacket& packet = packets[i];
+        if (packet.Flags & DRAW_PACKET_LAMP)
+            continue;
 
-    // Table Legs
-    glBindVertexArray(gMesh4.vao);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, gTextureId1);
-    glDrawArrays(GL_TRIANGLES, 0, gMesh4.nVertices);
-    glBindVertexArray(0);
+        if (!gOcclusion.ShouldDraw(packet.Node))
+        {
+            gHiddenNodes.push_back(packet.Node);
+            gHiddenBounds.push_back(gScene.Nodes[packet.Node].WorldBounds);
+            continue;
+        }
 
-    // LAMPs: draw lamps
-    //----------------
-    // Key Light
-    glBindVertexArray(gLightMesh.vao);
+        DrawElementsIndirectCommand command = { packet.Count, 1, packet.FirstIndex, 0, gFrameInstanceBase + packet.Node };
+        if (packet.Flags & DRAW_PACKET_HIDDEN)
+        {
+            command.instanceCount = 0;
+            gHiZOccluded++;
+        }
+        gDrawPackets.push_back((int)i);
+        gDrawCommands.push_back(command);
+    }
 
-    glUseProgram(gLightProgramId);
+    // The commands are read from the ring too
+    GLintptr commandsOffset = 0;
+    void* commands = gStreamRing.Allocate(gDrawCommands.size() * sizeof(DrawElementsIndirectCommand), sizeof(GLuint), commandsOffset);
+    if (!commands)
+        gDrawPackets.clear();
+    else if (!gDrawCommands.empty())
+        memcpy(commands, &gDrawCommands[0], gDrawCommands.size() * sizeof(DrawElementsIndirectCommand));
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, gStreamRing.Buffer());
+
+    // DEPTH PRE-PASS: the same draws with the depth only shader, nearest first, then shade only where the
+    // depth test finds the surface that ended up in front
+    if (gDepthPrePass)
+    {
+        GpuProfileScope prePassScope(gProfiler, "depth pre-pass");
+        GLStats::UseProgram(gDepthProgramId);
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        // the packets are sorted by state here; their keys end in the quantized view depth
+        gPrePassOrder.clear();
+        for (size_t i = 0; i < gDrawPackets.size(); i++)
+        {
+            if (gDrawCommands[i].instanceCount > 0)
+                gPrePassOrder.push_back((int)i);
+        }
+        std::sort(gPrePassOrder.begin(), gPrePassOrder.end(), [&](int a, int b)
+        {
+            return (packets[gDrawPackets[a]].SortKey & 0xFFFF) < (packets[gDrawPackets[b]].SortKey & 0xFFFF);
+        });
+        GLuint prePassVao = 0;
+        for (size_t i = 0; i < gPrePassOrder.size(); i++)
+        {
+            int draw = gPrePassOrder[i];
+            const DrawPacket& packet = packets[gDrawPackets[draw]];
+            if (packet.Vao != prePassVao)
+            {
+                GLStats::BindVertexArray(packet.Vao);
+                prePassVao = packet.Vao;
+            }
+            const DrawElementsIndirectCommand& command = gDrawCommands[draw];
+            GLStats::DrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (const void*)(commandsOffset + draw * sizeof(DrawElementsIndirectCommand)), command.count, command.instanceCount);
+        }
+        if (gGpuDriven)
+            gGpuCuller.Draw();
+        prePassScope.End();
+
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        glDepthMask(GL_FALSE);
+        glDepthFunc(GL_EQUAL);
+        GLStats::UseProgram(shadingProgramId);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, gStreamRing.Buffer());
+    }
 
-    //Transform visual que for the key light source
-    model = glm::translate(gKeyLightPosition) * glm::scale(gKeyLightScale) * glm::rotate(40.0f, gKeyLightRotation);
+    // Count the fragments shaded from here on; a GL_SAMPLES_PASSED query can't run alongside occlusion queries,
+    // and frames are left uncounted while every query still waits for its result
+    bool countFragments = gOcclusionMode != OCCLUSION_QUERIES && gFragmentCounter.Ready();
+    if (countFragments)
+        gFragmentCounter.Begin();
 
-    // Reference matrix uniforms from the Lamp Shader program
-    modelLoc = glGetUniformLocation(gLightProgramId, "model");
-    viewLoc = glGetUniformLocation(gLightProgramId, "view");
-    projLoc = glGetUniformLocation(gLightProgramId, "projection");
+    // Packets are sorted by texture and VAO (or front to back without the pre-pass), so consecutive draws only
+    // rebind what changed
+    glActiveTexture(GL_TEXTURE0);    // bind textures on corresponding texture units
+    GLuint boundVao = 0, boundTexture = 0;
+    for (size_t i = 0; i < gDrawPackets.size(); i++)
+    {
+        const DrawPacket& packet = packets[gDrawPackets[i]];
 
-    // Pass matrix data to the Lamp Shader program's matrix uniforms
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
+        bool query = gOcclusion.QueryDue(packet.Node);
+        if (query)
+            gOcclusion.BeginQuery(packet.Node);
 
-    glDrawArrays(GL_TRIANGLES, 0, gLightMesh.nVertices);
+        if (packet.Vao != boundVao)
+        {
+            GLStats::BindVertexArray(packet.Vao);  // Activate the VBOs contained within the mesh's VAO
+            boundVao = packet.Vao;
+        }
+        if (packet.Texture != boundTexture)
+        {
+            GLStats::BindTexture(GL_TEXTURE_2D, packet.Texture);
+            boundTexture = packet.Texture;
+        }
+        const DrawElementsIndirectCommand& command = gDrawCommands[i];
+        GLStats::DrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (const void*)(commandsOffset + i * sizeof(DrawElementsIndirectCommand)), command.count, command.instanceCount);    // Draws the triangles
 
-    // Fill Light
-    //Transform visual que for the fill light source
-    model = glm::translate(gFillLightPosition) * glm::scale(gFillLightScale) * glm::rotate(40.0f, gFillLightRotation);
+        if (query)
+            gOcclusion.EndQuery(packet.Node);
+    }
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    // GPU driven: a fixed number of calls whatever the object count
+    if (gGpuDriven)
+        gGpuCuller.Draw();
+    if (countFragments)
+        gFragmentCounter.End();
+    if (gDepthPrePass)
+    {
+        glDepthMask(GL_TRUE);
+        glDepthFunc(GL_LESS);
+    }
 
-    // Reference matrix uniforms from the Lamp Shader program
-    modelLoc = glGetUniformLocation(gLightProgramId, "model");
-    viewLoc = glGetUniformLocation(gLightProgramId, "view");
-    projLoc = glGetUniformLocation(gLightProgramId, "projection");
+    // Hidden objects: query their bounding boxes against the depth written so far, results are read next frame
+    gOcclusion.QueryHidden(gHiddenNodes, gHiddenBounds, gCamera.Position, view, projection);
 
-    // Pass matrix data to the Lamp Shader program's matrix uniforms
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
+    objectsScope.End();
 
-    glDrawArrays(GL_TRIANGLES, 0, gLightMesh.nVertices);
+    // DEFERRED LIGHTING: shade the G-buffer into the scene's framebuffer, one additive pass per light
+    if (gDeferred)
+    {
+        GpuProfileScope lightingScope(gProfiler, "deferred lighting");
+        const DeferredLight lights[3] = {
+            { gKeyLightPosition, gKeyLightColor, gKeyShadow },
+            { gFillLightPosition, gFillLightColor, gFillShadow },
+            { gPyramidLightPosition, gPyramidLightColor, gPyramidShadow }
+        };
+        gGBuffer.Light(lights, 3, projection * view, sceneFramebuffer, renderWidth, renderHeight);
+    }
 
-    // Pyramid Light
-    //Transform visual que for the fill light source
-    glBindVertexArray(gLightMesh2.vao);
-    model = glm::translate(gPyramidLightPosition) * glm::scale(gPyramidLightScale) * glm::rotate(10.0f, gPyramidLightRotation);
+    // LAMPs: draw lamps
+    //----------------
+    GpuProfileScope lampsScope(gProfiler, "lamps");
+    GLStats::UseProgram(gLightProgramId);
 
     // Reference matrix uniforms from the Lamp Shader program
-    modelLoc = glGetUniformLocation(gLightProgramId, "model");
-    viewLoc = glGetUniformLocation(gLightProgramId, "view");
-    projLoc = glGetUniformLocation(gLightProgramId, "projection");
+    GLint modelLoc = glGetUniformLocation(gLightProgramId, "model");
+    GLint viewLoc = glGetUniformLocation(gLightProgramId, "view");
+    GLint projLoc = glGetUniformLocation(gLightProgramId, "projection");
 
     // Pass matrix data to the Lamp Shader program's matrix uniforms
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
+    GLStats::UniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
+    GLStats::UniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
+
+    // Key, fill and pyramid light visual ques (sorted after the objects)
+    for (size_t i = 0; i < packets.size(); i++)
+    {
+        const DrawPacket& packet = packets[i];
+        if (!(packet.Flags & DRAW_PACKET_LAMP))
+            continue;
 
-    glDrawArrays(GL_TRIANGLES, 0, gLightMesh2.nVertices);
+        GLStats::UniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(packet.Model));
+        GLStats::BindVertexArray(packet.Vao);
+        GLStats::DrawArrays(GL_TRIANGLES, packet.FirstIndex, packet.Count);
+    }
 
     // Deactivate the Vertex Array Object
-    glBindVertexArray(0);
-    glUseProgram(0);
+    GLStats::BindVertexArray(0);
+    GLStats::UseProgram(0);
+    lampsScope.End();
+
+    // Build next frame's depth pyramid from the depth this frame produced; GPU driven frames don't test against it
+    if (gOcclusionMode == OCCLUSION_HIZ && !gGpuDriven)
+    {
+        GpuProfileScope hizScope(gProfiler, "hi-z build");
+        gHiZ.Build(renderWidth, renderHeight, projection * view, sceneFramebuffer);
+        GLStats::UseProgram(0);
+    }
+
+    // UPSCALE: stretch the scene over the window
+    if (gDynamicResolution)
+    {
+        GpuProfileScope upscaleScope(gProfiler, "upscale");
+        gSceneTarget.Upscale();
+    }
+
+    // STATS OVERLAY: GL call counters of the last complete frame
+    if (gShowOverlay)
+    {
+        const GLCounters& counters = GLStats::Last();
+        char line[96];
+        vector<string> lines;
+        snprintf(line, sizeof(line), "frame %.2f ms", gDeltaTime * 1000.0);
+        lines.push_back(line);
+        snprintf(line, sizeof(line), "draws %u  triangles %llu  vertices %llu", counters.DrawCalls, counters.Triangles, counters.Vertices);
+        lines.push_back(line);
+        snprintf(line, sizeof(line), "state changes %u (program %u, vao %u, texture %u)", counters.StateChanges(), counters.ProgramBinds, counters.VertexArrayBinds, counters.TextureBinds);
+        lines.push_back(line);
+        snprintf(line, sizeof(line), "uniforms %u  uploads %u (%.1f kb)", counters.UniformUploads, counters.BufferUploads, counters.UploadBytes / 1024.0);
+        lines.push_back(line);
+        snprintf(line, sizeof(line), "stream ring %.1f of %.0f kb  waits %u", gStreamRing.Used() / 1024.0, gStreamRing.RegionSize() / 1024.0, gStreamRing.Waits);
+        lines.push_back(line);
+        if (gOcclusionMode == OCCLUSION_QUERIES)
+            snprintf(line, sizeof(line), "overdraw not measured with occlusion queries  depth pre-pass %s", gDepthPrePass ? "on" : "off");
+        else
+            snprintf(line, sizeof(line), "overdraw %.2f fragments/pixel  depth pre-pass %s", gOverdraw, gDepthPrePass ? "on" : "off");
+        lines.push_back(line);
+        if (gDeferred)
+            snprintf(line, sizeof(line), "deferred shading  %d light passes", gGBuffer.LightPasses);
+        else
+            snprintf(line, sizeof(line), "forward shading");
+        lines.push_back(line);
+        snprintf(line, sizeof(line), "shadows %s  maps drawn %d of %d  cache %s", gShadows ? "on" : "off", gShadowAtlas.RenderedTiles,
+            (int)gShadowAtlas.Tiles.size(), gShadowAtlas.CacheEnabled ? "on" : "off");
+        lines.push_back(line);
+        snprintf(line, sizeof(line), "resolution %dx%d (%s)  gpu %.2f ms", renderWidth, renderHeight, gDynamicResolution ? "dynamic" : "fixed", gGpuFrameTime);
+        lines.push_back(line);
+        snprintf(line, sizeof(line), "target textures %d lent  %d pooled  %u allocated", gFramebuffers.LentTextures(), gFramebuffers.PooledTextures(), gFramebuffers.Allocations);
+        lines.push_back(line);
+        gOverlay.Draw(lines, framebufferWidth, framebufferHeight);
+    }
+    if (timeFrame)
+        gGpuFrameTimer.End();
 
+    // Everything reading this frame's region of the stream ring has been issued
+    gStreamRing.EndFrame();
+
+
+    // Regression runs read the finished frame back before it is presented
+    if (gCapture)
+        UCaptureFrame(*gCapture);
 
     // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
+    GpuProfileScope swapScope(gProfiler, "swap");
     glfwSwapBuffers(gWindow);    // Flips the the back buffer with the front buffer every frame.
 }
 
 
+
+// Reads the back buffer into an RGB image, top row first
+void UCaptureFrame(RegressionImage& image)
+{
+    glfwGetFramebufferSize(gWindow, &image.Width, &image.Height);
+    image.Pixels.resize((size_t)image.Width * image.Height * 3);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    glReadBuffer(GL_BACK);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, image.Width, image.Height, GL_RGB, GL_UNSIGNED_BYTE, &image.Pixels[0]);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    flipImageVertically(&image.Pixels[0], image.Width, image.Height, 3);
+}
+
+
+// Renders every regression case (resolution and light count) from a fixed camera and checks its final
+// image against the goldens in gGoldenDir and its frame times against the baselines in gRegressionDir.
+// Run it on Mesa's llvmpipe (benchmarks/run_regression.sh), which the goldens were recorded on.
+bool URunRegression()
+{
+    const int WARMUP_FRAMES = 30;       // lets occlusion and LOD state settle before timing
+    const int MEASURED_FRAMES = 120;
+    const int resolutions[][2] = { { 320, 240 }, { 800, 600 }, { 1280, 720 } };
+
+    RegressionSuite suite(gGoldenDir, gRegressionDir);
+    suite.RecordGoldens = gRecordGoldens;
+    suite.RecordBaselines = gRecordBaselines;
+
+    // The object shader has three fixed lights; light counts below three switch off the fill and pyramid lights
+    const glm::vec3 fillLightColor = gFillLightColor;
+    const glm::vec3 pyramidLightColor = gPyramidLightColor;
+    gCamera = Camera(glm::vec3(0.0f, 1.0f, 5.0f), glm::vec3(0.0f, 1.0f, 0.0f), -90.0f, -10.0f);
+
+    bool passed = true;
+    for (int resolution = 0; resolution < 3; resolution++)
+    {
+        int width = resolutions[resolution][0];
+        int height = resolutions[resolution][1];
+        glfwSetWindowSize(gWindow, width, height);
+        glfwPollEvents();
+        int framebufferWidth, framebufferHeight;
+        glfwGetFramebufferSize(gWindow, &framebufferWidth, &framebufferHeight);
+        UResizeWindow(gWindow, framebufferWidth, framebufferHeight);
+
+        for (int lights = 1; lights <= 3; lights++)
+        {
+            gFillLightColor = lights >= 2 ? fillLightColor : glm::vec3(0.0f);
+            gPyramidLightColor = lights >= 3 ? pyramidLightColor : glm::vec3(0.0f);
+
+            // glFinish makes each sample cover the GPU work of the frame, not just its submission
+            vector<double> frameTimes;
+            for (int frame = 0; frame < WARMUP_FRAMES + MEASURED_FRAMES; frame++)
+            {
+                int64_t start = FrameClock::Now();
+                URender();
+                glFinish();
+                if (frame >= WARMUP_FRAMES)
+                    frameTimes.push_back((FrameClock::Now() - start) / 1e6);
+                GLStats::EndFrame();
+            }
+
+            RegressionImage image;
+            gCapture = &image;
+            URender();
+
+            // The same frame without occlusion culling, which must look the same
+            RegressionImage unculled;
+            const OcclusionMode occlusionMode = gOcclusionMode;
+            gOcclusionMode = OCCLUSION_OFF;
+            gOcclusion.Enabled = false;
+            gCapture = &unculled;
+            URender();
+            gCapture = nullptr;
+            gOcclusionMode = occlusionMode;
+            gOcclusion.Enabled = gOcclusionMode == OCCLUSION_QUERIES;
+
+            char name[32];
+            snprintf(name, sizeof(name), "%dx%d_lights%d", width, height, lights);
+            passed = suite.Check(name, frameTimes, image, unculled) && passed;
+        }
+    }
+
+    gFillLightColor = fillLightColor;
+    gPyramidLightColor = pyramidLightColor;
+    return suite.Finish(cout) && passed;
+}
+
+
+// Renders gFlythroughFrames frames as fast as possible while the camera makes two laps around the table,
+// weaving in and out and up and down so culling, occlusion and level of detail keep changing. The path
+// depends only on the frame index, so every run (and every PGO training run) renders the same frames.
+void URunFlythrough()
+{
+    const glm::vec3 target(0.0f, 0.5f, 0.0f);
+    const float TWO_PI = 6.28318531f;
+    int64_t start = FrameClock::Now();
+    for (int frame = 0; frame < gFlythroughFrames; frame++)
+    {
+        float t = (float)frame / gFlythroughFrames;
+        float angle = t * 2.0f * TWO_PI;
+        float radius = 4.0f + 1.5f * sin(t * 3.0f * TWO_PI);
+        glm::vec3 position(radius * cos(angle), 1.0f + 0.8f * sin(t * 2.0f * TWO_PI), radius * sin(angle));
+        glm::vec3 direction = glm::normalize(target - position);
+        gCamera = Camera(position, glm::vec3(0.0f, 1.0f, 0.0f), glm::degrees(atan2(direction.z, direction.x)), glm::degrees(asin(direction.y)));
+
+        gProfiler.BeginFrame();
+        ProfileScope frameScope(gProfiler, "frame");
+        URender();
+        glfwPollEvents();
+        GLStats::EndFrame();
+    }
+    glFinish();
+
+    double seconds = FrameClock::Seconds(FrameClock::Now() - start);
+    const RollingHistogram* meshBuild = gProfiler.CpuHistogram("mesh build");
+    printf("flythrough: %d frames in %.3f s (%.1f fps), mesh build %.3f ms\n", gFlythroughFrames, seconds, gFlythroughFrames / seconds,
+        meshBuild ? meshBuild->Average() : 0.0);
+    if (gOverdrawSamples > 0)
+        printf("overdraw: %.2f shaded fragments per pixel, depth pre-pass %s\n", gOverdrawSum / gOverdrawSamples, gDepthPrePass ? "on" : "off");
+    printf("shading: %s\n", gDeferred ? "deferred" : "forward");
+    printf("shadows: %lld shadow maps drawn, cache %s\n", gShadowTileRenders, gShadowAtlas.CacheEnabled ? "on" : "off");
+    if (gDynamicResolution)
+        printf("resolution: dynamic, final scale %.2f (%dx%d)\n", gResolution.Scale(), gSceneTarget.RenderWidth, gSceneTarget.RenderHeight);
+    gProfiler.PrintSummary(cout);
+}
+
+// Builds the scene graph: the table owns its drawer and legs, the floor and lamps hang off the room
+void UCreateScene()
+{
+    const glm::vec3 origin(0.0f, 0.0f, 0.0f);
+    const glm::vec3 unitScale(1.0f);
+
+    Renderable table = { &gMesh1, gTextureId1, false };
+    Renderable drawer = { &gMesh2, gTextureId2, false };
+    Renderable plane = { &gMesh3, gTextureId3, false };
+    Renderable legs = { &gMesh4, gTextureId1, false };
+    Renderable light = { &gLightMesh, 0, true };
+    Renderable pyramidLight = { &gLightMesh2, 0, true };
+    gRenderables.push_back(table);
+    gRenderables.push_back(drawer);
+    gRenderables.push_back(plane);
+    gRenderables.push_back(legs);
+    gRenderables.push_back(light);
+    gRenderables.push_back(pyramidLight);
+
+    int room = gScene.AddNode("Room", -1, origin, unitScale, 0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
+    int tableNode = gScene.AddNode("Table", room, origin, unitScale, 0.0f, glm::vec3(1.0f, 1.0f, 1.0f), 0, gMesh1.bounds);
+    gScene.AddNode("Drawer", tableNode, origin, unitScale, 0.0f, glm::vec3(1.0f, 1.0f, 1.0f), 1, gMesh2.bounds);
+    gScene.AddNode("Table Legs", tableNode, origin, unitScale, 0.0f, glm::vec3(1.0f, 1.0f, 1.0f), 3, gMesh4.bounds);
+    gScene.AddNode("Floor", room, origin, unitScale, 0.0f, glm::vec3(1.0f, 1.0f, 1.0f), 2, gMesh3.bounds);
+    gScene.AddNode("Key Light", room, gKeyLightPosition, unitScale, 40.0f, glm::vec3(0.0f, 1.0f, 0.0f), 4, gLightMesh.bounds);
+    gScene.AddNode("Fill Light", room, gFillLightPosition, unitScale, 40.0f, glm::vec3(0.0f, 1.0f, 0.0f), 4, gLightMesh.bounds);
+    gScene.AddNode("Pyramid Light", room, gPyramidLightPosition, glm::vec3(0.75f), 10.0f, glm::vec3(0.0f, 1.0f, 0.0f), 5, gLightMesh2.bounds);
+    gScene.Update();
+}
+
+
+// Creates the stream ring and hooks it up as the model matrix attribute (locations 3 to 6) of the object meshes'
+// vertex arrays. The attribute starts at the beginning of the ring; each draw's base instance selects its matrix.
+void UCreateStreamRing()
+{
+    // instance matrices, draw commands and uniforms of a frame, with room to spare for the overlay text, plus
+    // the uniforms and caster commands of every shadow map
+    GLsizeiptr frameBytes = (GLsizeiptr)(gScene.Nodes.size() * (sizeof(glm::mat4) + sizeof(DrawElementsIndirectCommand)) + sizeof(FrameUniforms));
+    frameBytes += (GLsizeiptr)(SHADOW_MAX_TILES * (256 + gScene.Nodes.size() * sizeof(DrawElementsIndirectCommand)) + sizeof(ShadowUniforms));
+    gStreamRing.Init(std::max<GLsizeiptr>(2 * frameBytes, 1 << 20));
+    glBindBuffer(GL_ARRAY_BUFFER, gStreamRing.Buffer());
+
+    for (size_t i = 0; i < gRenderables.size(); i++)
+    {
+        if (gRenderables[i].lamp)
+            continue;
+        GLStats::BindVertexArray(gRenderables[i].mesh->vao);
+        // a mat4 attribute takes one location per column; divisor 1 advances it once per instance
+        for (GLuint column = 0; column < 4; column++)
+        {
+            glVertexAttribPointer(3 + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(column * sizeof(glm::vec4)));
+            glEnableVertexAttribArray(3 + column);
+            glVertexAttribDivisor(3 + column, 1);
+        }
+    }
+    GLStats::BindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+
+// Gives the lights their shadow maps, in the order the object shaders index them (key, fill, pyramid), and
+// lists the objects casting shadows
+void UCreateShadows()
+{
+    gShadowAtlas.Init();
+    gShadowAtlas.AddDirectionalLight(gKeyShadow);
+    gShadowAtlas.AddDirectionalLight(gFillShadow);
+    gShadowAtlas.AddPointLight(gPyramidShadow);
+    for (size_t i = 0; i < gScene.Nodes.size(); i++)
+    {
+        int renderable = gScene.Nodes[i].Renderable;
+        if (renderable >= 0 && !gRenderables[renderable].lamp)
+            gShadowCasters.push_back((int)i);
+    }
+}
+
+
+// Draws the depth of the shadow casters inside one shadow map's frustum, at full detail, with the depth
+// program. The map's matrix goes in as the projection of the program's FrameUniforms block.
+void UDrawShadowCasters(const glm::mat4& viewProjection)
+{
+    GLintptr uniformsOffset, commandsOffset;
+    glm::mat4* uniforms = (glm::mat4*)gStreamRing.AllocateUniforms(2 * sizeof(glm::mat4), uniformsOffset);
+    DrawElementsIndirectCommand* commands = (DrawElementsIndirectCommand*)gStreamRing.Allocate(gShadowCasters.size() * sizeof(DrawElementsIndirectCommand), sizeof(GLuint), commandsOffset);
+    if (!uniforms || !commands)
+        return;
+    uniforms[0] = glm::mat4(1.0f);
+    uniforms[1] = viewProjection;
+    glBindBufferRange(GL_UNIFORM_BUFFER, 0, gStreamRing.Buffer(), uniformsOffset, 2 * sizeof(glm::mat4));
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, gStreamRing.Buffer());
+
+    const Frustum frustum(viewProjection);
+    GLuint boundVao = 0;
+    for (size_t i = 0; i < gShadowCasters.size(); i++)
+    {
+        const SceneNode& node = gScene.Nodes[gShadowCasters[i]];
+        if (!frustum.TestBox(node.WorldBounds))
+            continue;
+        const GLMesh& mesh = *gRenderables[node.Renderable].mesh;
+        DrawElementsIndirectCommand command = { mesh.lods[0].IndexCount, 1, mesh.lods[0].FirstIndex, 0, gFrameInstanceBase + (GLuint)gShadowCasters[i] };
+        commands[i] = command;
+        if (mesh.vao != boundVao)
+        {
+            GLStats::BindVertexArray(mesh.vao);
+            boundVao = mesh.vao;
+        }
+        GLStats::DrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (const void*)(commandsOffset + i * sizeof(DrawElementsIndirectCommand)), command.count, command.instanceCount);
+    }
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+
+// Describes every object of the scene to the GPU culler, one batch per vertex array and texture
+void UCreateGpuCuller()
+{
+    gGpuCullSupported = gGpuCuller.Init(gCullProgramId);
+    if (!gGpuCullSupported)
+    {
+        if (gGpuDriven)
+            cout << "GPU driven culling needs OpenGL 4.6 or GL_ARB_indirect_parameters, culling on the CPU" << endl;
+        gGpuDriven = false;
+        return;
+    }
+
+    vector<int> batchOfRenderable(gRenderables.size(), -1);
+    gLampNodes.clear();
+    for (size_t i = 0; i < gScene.Nodes.size(); i++)
+    {
+        const SceneNode& node = gScene.Nodes[i];
+        if (node.Renderable < 0)
+            continue;
+        if (gRenderables[node.Renderable].lamp)
+        {
+            gLampNodes.push_back((int)i);
+            continue;
+        }
+        const Renderable& renderable = gRenderables[node.Renderable];
+        int& batch = batchOfRenderable[node.Renderable];
+        for (size_t b = 0; b < gGpuCuller.Batches.size() && batch < 0; b++)
+        {
+            if (gGpuCuller.Batches[b].Vao == renderable.mesh->vao && gGpuCuller.Batches[b].Texture == renderable.texture)
+                batch = (int)b;
+        }
+        if (batch < 0)
+            batch = gGpuCuller.AddBatch(renderable.mesh->vao, renderable.texture);
+
+        GpuCullObject object = GpuCullObject();
+        object.BoundsMin = node.LocalBounds.Min;
+        object.BoundsMax = node.LocalBounds.Max;
+        object.Node = (GLuint)i;
+        object.Batch = (GLuint)batch;
+        const vector<LodLevel>& lods = renderable.mesh->lods;
+        object.LevelCount = (GLuint)std::min(lods.size(), (size_t)MAX_LOD_LEVELS);
+        for (GLuint level = 0; level < object.LevelCount; level++)
+        {
+            object.FirstIndex[level] = lods[level].FirstIndex;
+            object.IndexCount[level] = lods[level].IndexCount;
+        }
+        gGpuCuller.Objects.push_back(object);
+    }
+    gGpuCuller.Upload();
+}
+
+
+// Casts a ray from the camera through the screen center and reports the scene node it hits
+void UPickObject()
+{
+    float distance;
+    int node = gScene.Pick(gCamera.Position, gCamera.Front, distance);
+    if (node >= 0)
+        cout << "Picked " << gScene.Nodes[node].Name << " at distance " << distance << endl;
+    else
+        cout << "Picked nothing" << endl;
+}
+
+
+// Culls the scene and records one draw packet per visible node, spread over the render queue's threads.
+// Workers only read the scene (brought up to date by the caller) and write their own packet lists and
+// per-slot stats; the LOD selector's per-node state is reserved up front so concurrent selects never resize it.
+// In GPU driven mode the compute pass culls and picks detail levels for the objects, so only the lamps are recorded.
+void URecordDrawPackets(const glm::mat4& view, const glm::mat4& projection)
+{
+    const Frustum frustum(projection * view);
+    if (gGpuDriven)
+    {
+        gRenderQueue.Record(1, [&](int, int, vector<DrawPacket>& packets)
+        {
+            for (size_t i = 0; i < gLampNodes.size(); i++)
+            {
+                const SceneNode& node = gScene.Nodes[gLampNodes[i]];
+                if (!frustum.TestBox(node.WorldBounds))
+                    continue;
+                const Renderable& renderable = gRenderables[node.Renderable];
+
+                DrawPacket packet;
+                packet.Node = gLampNodes[i];
+                packet.Model = gScene.World(gLampNodes[i]);
+                packet.Vao = renderable.mesh->vao;
+                packet.Texture = 0;
+                packet.Flags = DRAW_PACKET_LAMP;
+                packet.FirstIndex = 0;
+                packet.Count = renderable.mesh->nVertices;
+                float viewDepth = -(view * glm::vec4(node.WorldBounds.Center(), 1.0f)).z;
+                packet.SortKey = MakeSortKey(true, packet.Texture, packet.Vao, viewDepth);
+                packets.push_back(packet);
+            }
+        });
+        gLod.BeginFrame();
+        gCullStats.Tested = (unsigned int)gLampNodes.size();
+        gCullStats.Culled = gCullStats.Tested - (unsigned int)gRenderQueue.Packets.size();
+        return;
+    }
+
+    const glm::vec3 cameraPosition = gCamera.Position;
+    const float zoom = gCamera.Zoom;
+    const bool orthographic = perspective;  // perspective is set while the orthographic view is active
+    const bool testHiZ = gOcclusionMode == OCCLUSION_HIZ;
+    // without the pre-pass, drawing nearest first is what lets early depth testing skip hidden fragments
+    const bool frontToBack = !gDepthPrePass;
+
+    // a few subtrees per thread so an uneven split still balances
+    int slots = gRenderQueue.SlotCount();
+    gScene.CullRoots(slots * 4, gCullRoots);
+    gSlotVisibleNodes.resize(slots);
+    LodStats noTriangles = { 0, 0 };
+    gSlotLodStats.assign(slots, noTriangles);
+    gLod.Reserve((int)gScene.Nodes.size());
+
+    gRenderQueue.Record((int)gCullRoots.size(), [&](int task, int slot, vector<DrawPacket>& packets)
+    {
+        vector<int>& visible = gSlotVisibleNodes[slot];
+        visible.clear();
+        gScene.CullSubtree(frustum, gCullRoots[task], visible);
+        for (size_t i = 0; i < visible.size(); i++)
+        {
+            const SceneNode& node = gScene.Nodes[visible[i]];
+            const Renderable& renderable = gRenderables[node.Renderable];
+
+            DrawPacket packet;
+            packet.Node = visible[i];
+            packet.Model = gScene.World(visible[i]);
+            packet.Vao = renderable.mesh->vao;
+            packet.Texture = renderable.lamp ? 0 : renderable.texture;
+            packet.Flags = 0;
+            if (renderable.lamp)
+            {
+                packet.Flags |= DRAW_PACKET_LAMP;
+                packet.FirstIndex = 0;
+                packet.Count = renderable.mesh->nVertices;
+            }
+            else
+            {
+                // the ortho view's half height is 5
+                float screenSize = LodSelector::ScreenSize(node.WorldBounds.Sphere(), cameraPosition, zoom, orthographic, 5.0f);
+                const LodLevel& lod = renderable.mesh->lods[gLod.Select(packet.Node, renderable.mesh->lods, screenSize, gSlotLodStats[slot])];
+                packet.FirstIndex = lod.FirstIndex;
+                packet.Count = lod.IndexCount;
+                if (testHiZ && gHiZ.IsOccluded(node.WorldBounds))
+                    packet.Flags |= DRAW_PACKET_HIDDEN;
+            }
+            float viewDepth = -(view * glm::vec4(node.WorldBounds.Center(), 1.0f)).z;
+            packet.SortKey = MakeSortKey(renderable.lamp, packet.Texture, packet.Vao, viewDepth, frontToBack);
+            packets.push_back(packet);
+        }
+    });
+
+    // merge the per-thread counters
+    gLod.BeginFrame();
+    for (int i = 0; i < slots; i++)
+    {
+        gLod.Stats.FullTriangles += gSlotLodStats[i].FullTriangles;
+        gLod.Stats.DrawnTriangles += gSlotLodStats[i].DrawnTriangles;
+    }
+    gCullStats.Tested = gScene.ItemCount();
+    gCullStats.Culled = gCullStats.Tested - (unsigned int)gRenderQueue.Packets.size();
+}
+
+
 // Implements the UCreateMesh function
 void UCreateMesh(GLMesh& mesh)
 {
@@ -960,14 +2607,19 @@ void UCreateMesh(GLMesh& mesh)
     const GLuint floatsPerUV = 2;
 
     mesh.nVertices = sizeof(tverts) / (sizeof(tverts[0]) * (floatsPerVertex + floatsPerNormal + floatsPerUV));
+    mesh.bounds = ComputeBounds(tverts, mesh.nVertices, floatsPerVertex + floatsPerNormal + floatsPerUV); // Model space bounds for culling
+    mesh.sphere = mesh.bounds.Sphere();
 
     glGenVertexArrays(1, &mesh.vao); // we can also generate multiple VAOs or buffers at the same time
-    glBindVertexArray(mesh.vao);
+    GLStats::BindVertexArray(mesh.vao);
 
     // Create VBO
     glGenBuffers(1, &mesh.vbo);
     glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo); // Activates the buffer
-    glBufferData(GL_ARRAY_BUFFER, sizeof(tverts), tverts, GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
+    GLStats::BufferData(GL_ARRAY_BUFFER, sizeof(tverts), tverts, GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
+
+    // Index buffer with the simplified detail levels, recorded into the VAO
+    UCreateLods(mesh, tverts, floatsPerVertex + floatsPerNormal + floatsPerUV);
 
     // Strides between vertex coordinates
     GLint stride = sizeof(float) * (floatsPerVertex + floatsPerNormal + floatsPerUV);
@@ -1103,14 +2755,19 @@ void UCreateLegs(GLMesh& mesh)
     const GLuint floatsPerUV = 2;
 
     mesh.nVertices = sizeof(dverts) / (sizeof(dverts[0]) * (floatsPerVertex + floatsPerNormal + floatsPerUV));
+    mesh.bounds = ComputeBounds(dverts, mesh.nVertices, floatsPerVertex + floatsPerNormal + floatsPerUV); // Model space bounds for culling
+    mesh.sphere = mesh.bounds.Sphere();
 
     glGenVertexArrays(1, &mesh.vao); // we can also generate multiple VAOs or buffers at the same time
-    glBindVertexArray(mesh.vao);
+    GLStats::BindVertexArray(mesh.vao);
 
     // Create VBO
     glGenBuffers(1, &mesh.vbo);
     glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo); // Activates the buffer
-    glBufferData(GL_ARRAY_BUFFER, sizeof(dverts), dverts, GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
+    GLStats::BufferData(GL_ARRAY_BUFFER, sizeof(dverts), dverts, GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
+
+    // Index buffer with the simplified detail levels, recorded into the VAO
+    UCreateLods(mesh, dverts, floatsPerVertex + floatsPerNormal + floatsPerUV);
 
     // Strides between vertex coordinates
     GLint stride = sizeof(float) * (floatsPerVertex + floatsPerNormal + floatsPerUV);
@@ -1191,14 +2848,19 @@ void UCreateDrawer(GLMesh& mesh)
     const GLuint floatsPerUV = 2;
 
     mesh.nVertices = sizeof(dverts) / (sizeof(dverts[0]) * (floatsPerVertex + floatsPerNormal + floatsPerUV));
+    mesh.bounds = ComputeBounds(dverts, mesh.nVertices, floatsPerVertex + floatsPerNormal + floatsPerUV); // Model space bounds for culling
+    mesh.sphere = mesh.bounds.Sphere();
 
     glGenVertexArrays(1, &mesh.vao); // we can also generate multiple VAOs or buffers at the same time
-    glBindVertexArray(mesh.vao);
+    GLStats::BindVertexArray(mesh.vao);
 
     // Create VBO
     glGenBuffers(1, &mesh.vbo);
     glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo); // Activates the buffer
-    glBufferData(GL_ARRAY_BUFFER, sizeof(dverts), dverts, GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
+    GLStats::BufferData(GL_ARRAY_BUFFER, sizeof(dverts), dverts, GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
+
+    // Index buffer with the simplified detail levels, recorded into the VAO
+    UCreateLods(mesh, dverts, floatsPerVertex + floatsPerNormal + floatsPerUV);
 
     // Strides between vertex coordinates
     GLint stride = sizeof(float) * (floatsPerVertex + floatsPerNormal + floatsPerUV);
@@ -1232,14 +2894,19 @@ void UCreatePlane(GLMesh& mesh)
     const GLuint floatsPerUV = 2;
 
     mesh.nVertices = sizeof(planeverts) / (sizeof(planeverts[0]) * (floatsPerVertex + floatsPerNormal + floatsPerUV));
+    mesh.bounds = ComputeBounds(planeverts, mesh.nVertices, floatsPerVertex + floatsPerNormal + floatsPerUV); // Model space bounds for culling
+    mesh.sphere = mesh.bounds.Sphere();
 
     glGenVertexArrays(1, &mesh.vao); // we can also generate multiple VAOs or buffers at the same time
-    glBindVertexArray(mesh.vao);
+    GLStats::BindVertexArray(mesh.vao);
 
     // Create VBO
     glGenBuffers(1, &mesh.vbo);
     glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo); // Activates the buffer
-    glBufferData(GL_ARRAY_BUFFER, sizeof(planeverts), planeverts, GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
+    GLStats::BufferData(GL_ARRAY_BUFFER, sizeof(planeverts), planeverts, GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
+
+    // Index buffer with the simplified detail levels, recorded into the VAO
+    UCreateLods(mesh, planeverts, floatsPerVertex + floatsPerNormal + floatsPerUV);
 
     // Strides between vertex coordinates
     GLint stride = sizeof(float) * (floatsPerVertex + floatsPerNormal + floatsPerUV);
@@ -1289,14 +2956,19 @@ void UCreatePyramidLight(GLMesh& mesh)
     const GLuint floatsPerUV = 2;
 
     mesh.nVertices = sizeof(verts) / (sizeof(verts[0]) * (floatsPerVertex + floatsPerNormal + floatsPerUV));
+    mesh.bounds = ComputeBounds(verts, mesh.nVertices, floatsPerVertex + floatsPerNormal + floatsPerUV); // Model space bounds for culling
+    mesh.sphere = mesh.bounds.Sphere();
 
     glGenVertexArrays(1, &mesh.vao); // we can also generate multiple VAOs or buffers at the same time
-    glBindVertexArray(mesh.vao);
+    GLStats::BindVertexArray(mesh.vao);
 
     // Create VBO
     glGenBuffers(1, &mesh.vbo);
     glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo); // Activates the buffer
-    glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
+    GLStats::BufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
+
+    // Index buffer with the simplified detail levels, recorded into the VAO
+    UCreateLods(mesh, verts, floatsPerVertex + floatsPerNormal + floatsPerUV);
 
     // Strides between vertex coordinates
     GLint stride = sizeof(float) * (floatsPerVertex + floatsPerNormal + floatsPerUV);
@@ -1330,14 +3002,19 @@ void UCreateLight(GLMesh& mesh)
     const GLuint floatsPerUV = 2;
 
     mesh.nVertices = sizeof(verts) / (sizeof(verts[0]) * (floatsPerVertex + floatsPerNormal + floatsPerUV));
+    mesh.bounds = ComputeBounds(verts, mesh.nVertices, floatsPerVertex + floatsPerNormal + floatsPerUV); // Model space bounds for culling
+    mesh.sphere = mesh.bounds.Sphere();
 
     glGenVertexArrays(1, &mesh.vao); // we can also generate multiple VAOs or buffers at the same time
-    glBindVertexArray(mesh.vao);
+    GLStats::BindVertexArray(mesh.vao);
 
     // Create VBO
     glGenBuffers(1, &mesh.vbo);
     glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo); // Activates the buffer
-    glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
+    GLStats::BufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
+
+    // Index buffer with the simplified detail levels, recorded into the VAO
+    UCreateLods(mesh, verts, floatsPerVertex + floatsPerNormal + floatsPerUV);
 
     // Strides between vertex coordinates
     GLint stride = sizeof(float) * (floatsPerVertex + floatsPerNormal + floatsPerUV);
@@ -1353,23 +3030,50 @@ void UCreateLight(GLMesh& mesh)
     glEnableVertexAttribArray(2);
 }
 
+// Simplifies the mesh into its detail levels and uploads them as one index buffer; the mesh's VAO must be bound
+void UCreateLods(GLMesh& mesh, const GLfloat* verts, GLuint floatsPerVertexTotal)
+{
+    // The meshes are plain triangle lists, so full detail is just every vertex in order
+    vector<glm::vec3> positions(mesh.nVertices);
+    vector<GLuint> indices(mesh.nVertices);
+    for (GLuint i = 0; i < mesh.nVertices; i++)
+    {
+        positions[i] = glm::vec3(verts[i * floatsPerVertexTotal], verts[i * floatsPerVertexTotal + 1], verts[i * floatsPerVertexTotal + 2]);
+        indices[i] = i;
+    }
+    vector<GLuint> chain = BuildLodChain(positions, indices, mesh.lods);
+
+    glGenBuffers(1, &mesh.ebo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.ebo);
+    GLStats::BufferData(GL_ELEMENT_ARRAY_BUFFER, chain.size() * sizeof(GLuint), &chain[0], GL_STATIC_DRAW);
+}
+
 void UDestroyMesh(GLMesh& mesh)
 {
     glDeleteVertexArrays(1, &mesh.vao);
     glDeleteBuffers(1, &mesh.vbo);
+    glDeleteBuffers(1, &mesh.ebo);
 }
 
-/*Generate and load the texture*/
-bool UCreateTexture(const char* filename, GLuint& textureId)
+/*Decode an image file into memory; touches no GL state, so it can run on any thread*/
+bool UDecodeImage(DecodedImage& image)
 {
-    int width, height, channels;
-    unsigned char* image = stbi_load(filename, &width, &height, &channels, 0);
+    image.pixels = stbi_load(image.filename, &image.width, &image.height, &image.channels, 0);
+    if (!image.pixels)
+        return false;
+    flipImageVertically(image.pixels, image.width, image.height, image.channels);
+    return true;
+}
+
+/*Generate and load the texture from a decoded image; the caller frees the pixels*/
+bool UCreateTexture(DecodedImage& decoded, GLuint& textureId)
+{
+    int width = decoded.width, height = decoded.height, channels = decoded.channels;
+    unsigned char* image = decoded.pixels;
     if (image)
     {
-        flipImageVertically(image, width, height, channels);
-
         glGenTextures(1, &textureId);
-        glBindTexture(GL_TEXTURE_2D, textureId);
+        GLStats::BindTexture(GL_TEXTURE_2D, textureId);
 
         // set the texture wrapping parameters
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
@@ -1378,20 +3082,24 @@ bool UCreateTexture(const char* filename, GLuint& textureId)
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
+        // stb_image packs the rows tightly; with the default 4 byte alignment GL would read past the end of
+        // RGB images whose width isn't a multiple of 4
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
         if (channels == 3)
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
+            GLStats::TexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
         else if (channels == 4)
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
+            GLStats::TexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
         else
         {
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
             cout << "Not implemented to handle image with " << channels << " channels" << endl;
             return false;
         }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
 
         glGenerateMipmap(GL_TEXTURE_2D);
 
-        stbi_image_free(image);
-        glBindTexture(GL_TEXTURE_2D, 0); // Unbind the texture
+        GLStats::BindTexture(GL_TEXTURE_2D, 0); // Unbind the texture
 
         return true;
     }
@@ -1463,7 +3171,41 @@ bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSou
         return false;
     }
 
-    glUseProgram(programId);    // Uses the shader program
+    GLStats::UseProgram(programId);    // Uses the shader program
+
+    return true;
+}
+
+
+// Compiles and links a program made of one compute shader
+bool UCreateComputeProgram(const char* computeShaderSource, GLuint& programId)
+{
+    int success = 0;
+    char infoLog[512];
+
+    programId = glCreateProgram();
+    GLuint computeShaderId = glCreateShader(GL_COMPUTE_SHADER);
+    glShaderSource(computeShaderId, 1, &computeShaderSource, NULL);
+    glCompileShader(computeShaderId);
+    glGetShaderiv(computeShaderId, GL_COMPILE_STATUS, &success);
+    if (!success)
+    {
+        glGetShaderInfoLog(computeShaderId, sizeof(infoLog), NULL, infoLog);
+        std::cout << "ERROR::SHADER::COMPUTE::COMPILATION_FAILED\n" << infoLog << std::endl;
+
+        return false;
+    }
+
+    glAttachShader(programId, computeShaderId);
+    glLinkProgram(programId);
+    glGetProgramiv(programId, GL_LINK_STATUS, &success);
+    if (!success)
+    {
+        glGetProgramInfoLog(programId, sizeof(infoLog), NULL, infoLog);
+        std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+
+        return false;
+    }
 
     return true;
 }
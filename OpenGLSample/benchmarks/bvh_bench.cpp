@@ -0,0 +1,168 @@
+// BVH ray pick check and benchmark.
+// First checks BoundingBox::Intersect and Bvh::Raycast against rays parallel to box faces, the case picking
+// hits whenever the camera looks straight along an axis: direction components of +0 and -0 with the origin
+// inside a slab, on either of its planes and just outside it. Then times Bvh::Raycast on a random scene and
+// prints nanoseconds per ray.
+//
+// Usage: bvh_bench [--check] [boxes] [rays]
+//   --check  only run the checks (exit code 1 on any failure)
+
+#include <glm/glm.hpp>
+
+#include "../bvh.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+namespace
+{
+    int gFailures = 0;
+
+    void UExpect(bool condition, const char* what, glm::vec3 origin, glm::vec3 direction)
+    {
+        if (condition)
+            return;
+        printf("FAIL %s: origin (%g, %g, %g) direction (%g, %g, %g)\n", what, origin.x, origin.y, origin.z, direction.x, direction.y, direction.z);
+        gFailures++;
+    }
+
+    glm::vec3 UInverse(glm::vec3 direction)
+    {
+        return glm::vec3(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+    }
+
+    // rays along each axis through the unit box, with the other two origin coordinates inside, on a plane or
+    // just outside, and the zero direction components signed both ways
+    void UCheckBox()
+    {
+        BoundingBox box;
+        box.Min = glm::vec3(0.0f);
+        box.Max = glm::vec3(1.0f);
+        const float across[] = { 0.0f, 0.5f, 1.0f, -0.001f, 1.001f };
+        for (int axis = 0; axis < 3; axis++)
+        {
+            int u = (axis + 1) % 3, v = (axis + 2) % 3;
+            for (int forward = 0; forward < 2; forward++)
+            {
+                for (int zeros = 0; zeros < 4; zeros++)
+                {
+                    for (int a = 0; a < 5; a++)
+                    {
+                        for (int b = 0; b < 5; b++)
+                        {
+                            glm::vec3 origin, direction;
+                            origin[axis] = forward ? -1.0f : 2.0f;
+                            origin[u] = across[a];
+                            origin[v] = across[b];
+                            direction[axis] = forward ? 1.0f : -1.0f;
+                            direction[u] = (zeros & 1) ? -0.0f : 0.0f;
+                            direction[v] = (zeros & 2) ? -0.0f : 0.0f;
+                            float distance = box.Intersect(origin, UInverse(direction));
+                            bool inside = a < 3 && b < 3;
+                            if (inside)
+                                UExpect(distance == 1.0f, "axis aligned ray misses the box", origin, direction);
+                            else
+                                UExpect(distance < 0.0f, "axis aligned ray hits a box it passes beside", origin, direction);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    // a floor of unit boxes sharing their side planes, picked straight down along the grid lines
+    void UCheckBvh()
+    {
+        const int GRID = 8;
+        std::vector<BoundingBox> boxes;
+        for (int x = 0; x < GRID; x++)
+        {
+            for (int z = 0; z < GRID; z++)
+            {
+                BoundingBox box;
+                box.Min = glm::vec3((float)x, 0.0f, (float)z);
+                box.Max = glm::vec3((float)(x + 1), 1.0f, (float)(z + 1));
+                boxes.push_back(box);
+            }
+        }
+        Bvh bvh;
+        bvh.Build(boxes.data(), (int)boxes.size());
+
+        for (int x = 0; x <= GRID; x++)
+        {
+            for (int z = 0; z <= GRID; z++)
+            {
+                for (int zeros = 0; zeros < 4; zeros++)
+                {
+                    glm::vec3 origin((float)x, 3.0f, (float)z);
+                    glm::vec3 direction((zeros & 1) ? -0.0f : 0.0f, -1.0f, (zeros & 2) ? -0.0f : 0.0f);
+                    float distance = 0.0f;
+                    int item = bvh.Raycast(boxes.data(), origin, direction, distance);
+                    UExpect(item >= 0 && distance == 2.0f, "pick along a grid line misses the floor", origin, direction);
+                    if (item >= 0)
+                        UExpect(boxes[item].Contains(origin + direction * distance), "pick returns a box the ray doesn't enter", origin, direction);
+                }
+            }
+        }
+
+        glm::vec3 beside((float)GRID + 0.001f, 3.0f, 0.5f);
+        glm::vec3 down(0.0f, -1.0f, 0.0f);
+        float distance = 0.0f;
+        UExpect(bvh.Raycast(boxes.data(), beside, down, distance) < 0, "pick beside the floor hits it", beside, down);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    bool checkOnly = argc > 1 && strcmp(argv[1], "--check") == 0;
+    int first = checkOnly ? 2 : 1;
+    int boxCount = argc > first ? atoi(argv[first]) : 100000;
+    int rayCount = argc > first + 1 ? atoi(argv[first + 1]) : 100000;
+
+    UCheckBox();
+    UCheckBvh();
+    printf("ray checks: %s\n", gFailures == 0 ? "ok" : "FAILED");
+    if (checkOnly || gFailures > 0)
+        return gFailures == 0 ? 0 : 1;
+
+    // random boxes up to 2 units across in a 100 unit cube, rays from random points in random directions
+    std::mt19937 random(330);
+    std::uniform_real_distribution<float> position(0.0f, 100.0f);
+    std::uniform_real_distribution<float> size(0.1f, 2.0f);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    std::vector<BoundingBox> boxes(boxCount);
+    for (int i = 0; i < boxCount; i++)
+    {
+        boxes[i].Min = glm::vec3(position(random), position(random), position(random));
+        boxes[i].Max = boxes[i].Min + glm::vec3(size(random), size(random), size(random));
+    }
+    std::vector<glm::vec3> origins(rayCount), directions(rayCount);
+    for (int i = 0; i < rayCount; i++)
+    {
+        origins[i] = glm::vec3(position(random), position(random), position(random));
+        directions[i] = glm::normalize(glm::vec3(unit(random), unit(random), unit(random)) + glm::vec3(0.0f, 0.0f, 1e-3f));
+    }
+
+    Bvh bvh;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    bvh.Build(boxes.data(), boxCount);
+    double buildTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    int hits = 0;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < rayCount; i++)
+    {
+        float distance = 0.0f;
+        if (bvh.Raycast(boxes.data(), origins[i], directions[i], distance) >= 0)
+            hits++;
+    }
+    double rayTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("%d boxes: build %.2f ms, %d rays %.1f ns per ray (%d hit)\n", boxCount, buildTime * 1e3, rayCount, rayTime * 1e9 / rayCount, hits);
+    return 0;
+}
@@ -0,0 +1,107 @@
+// Job system scaling benchmark.
+// Runs the engine's per-frame CPU work (world bounds transform, frustum culling) for a large synthetic scene
+// through JobSystem::ParallelFor and a TaskGraph, with 1 to 32 threads, and prints the speedup over one thread.
+//
+// Usage: jobs_bench [objects] [frames]
+
+#include <glm/glm.hpp>
+#include <glm/gtx/transform.hpp>
+
+#include "../bounds.h"
+#include "../jobs.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+namespace
+{
+    // Synthetic scene: unit boxes on a grid, each with its own model matrix
+    struct BenchScene
+    {
+        std::vector<BoundingBox> localBounds;
+        std::vector<glm::mat4> world;
+        std::vector<BoundingBox> worldBounds;
+        std::vector<unsigned char> visible;
+    };
+
+    void UCreateBenchScene(BenchScene& scene, int objects)
+    {
+        scene.localBounds.assign(objects, BoundingBox(glm::vec3(-0.5f), glm::vec3(0.5f)));
+        scene.world.resize(objects);
+        scene.worldBounds.resize(objects);
+        scene.visible.resize(objects);
+        for (int i = 0; i < objects; i++)
+        {
+            glm::vec3 position((float)(i % 100) - 50.0f, (float)(i / 100 % 100) - 50.0f, -(float)(i / 10000) * 2.0f);
+            scene.world[i] = glm::translate(position) * glm::rotate(0.01f * i, glm::vec3(0.0f, 1.0f, 0.0f));
+        }
+    }
+
+    double UMeasure(int threads, int objects, int frames, unsigned int& visibleCount)
+    {
+        JobSystem jobs;
+        jobs.Start(threads - 1);
+
+        BenchScene scene;
+        UCreateBenchScene(scene, objects);
+        Frustum frustum(glm::perspective(glm::radians(45.0f), 4.0f / 3.0f, 0.1f, 100.0f) * glm::lookAt(glm::vec3(0.0f, 0.0f, 30.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f)));
+        const int grain = 1024;
+
+        // One frame: transform every box into world space, then cull them, both split into chunks
+        TaskGraph graph;
+        int transforms = graph.Add("transforms", [&]
+        {
+            jobs.ParallelFor(objects, grain, [&](int begin, int end)
+            {
+                for (int i = begin; i < end; i++)
+                    scene.worldBounds[i] = scene.localBounds[i].Transform(scene.world[i]);
+            });
+        });
+        graph.Add("cull", [&]
+        {
+            std::vector<CullStats> stats(jobs.ThreadCount());
+            jobs.ParallelFor(objects, grain, [&](int begin, int end)
+            {
+                CullStats& threadStats = stats[JobSystem::CurrentThread()];
+                frustum.CullBoxes(&scene.worldBounds[begin], end - begin, &scene.visible[begin], threadStats);
+            });
+        }, { transforms });
+
+        // warm up caches and thread wakeups before timing
+        graph.Run(jobs);
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (int frame = 0; frame < frames; frame++)
+            graph.Run(jobs);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        visibleCount = 0;
+        for (int i = 0; i < objects; i++)
+            visibleCount += scene.visible[i];
+        jobs.Stop();
+        return seconds * 1000.0 / frames;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    int objects = argc > 1 ? atoi(argv[1]) : 1000000;
+    int frames = argc > 2 ? atoi(argv[2]) : 50;
+    printf("%d objects, %d frames, %u hardware threads\n", objects, frames, std::thread::hardware_concurrency());
+    printf("threads   ms/frame   speedup   efficiency   visible\n");
+
+    double baseline = 0.0;
+    const int threadCounts[] = { 1, 2, 4, 8, 16, 32 };
+    for (int threads : threadCounts)
+    {
+        unsigned int visible = 0;
+        double milliseconds = UMeasure(threads, objects, frames, visible);
+        if (threads == 1)
+            baseline = milliseconds;
+        double speedup = baseline / milliseconds;
+        printf("%7d   %8.3f   %7.2fx   %9.0f%%   %7u\n", threads, milliseconds, speedup, 100.0 * speedup / threads, visible);
+    }
+    return 0;
+}
@@ -0,0 +1,61 @@
+#!/bin/sh
+# Profile guided, ThinLTO optimized release build of the viewer:
+#   1. builds an instrumented viewer (-fprofile-generate)
+#   2. trains it on the canned camera flythrough (--flythrough), rendered headlessly on Mesa's llvmpipe
+#   3. merges the profiles and builds the final viewer with -fprofile-use and ThinLTO
+#   4. runs the flythrough on a plain ThinLTO release build and on the PGO build and prints both timings
+#
+#   pgo_build.sh [build root (default: <repo>/build-pgo)] [training frames (default: 1200)]
+#
+# Needs clang, lld and llvm-profdata (ThinLTO is clang only). CC/CXX/LLVM_PROFDATA override the tools,
+# e.g. CXX=clang++-17 LLVM_PROFDATA=llvm-profdata-17. The optimized viewer ends up in
+# <build root>/use/OpenGLSample.
+set -e
+
+repo=$(cd "$(dirname "$0")/../.." && pwd)
+out=${1:-$repo/build-pgo}
+frames=${2:-1200}
+profiles=$out/profiles
+
+export CC=${CC:-clang}
+export CXX=${CXX:-clang++}
+profdata=${LLVM_PROFDATA:-llvm-profdata}
+
+# Force the software rasterizer so training doesn't depend on the GPU driver
+export LIBGL_ALWAYS_SOFTWARE=1
+export GALLIUM_DRIVER=llvmpipe
+
+# runs the viewer at <path> on the flythrough from the source directory (textures load relative to it)
+flythrough() {
+    viewer=$1
+    shift
+    if [ -z "$DISPLAY" ] && [ -z "$WAYLAND_DISPLAY" ] && command -v xvfb-run >/dev/null 2>&1; then
+        (cd "$repo/OpenGLSample" && xvfb-run -a -s "-screen 0 1920x1080x24" "$viewer" --flythrough "$frames" "$@")
+    else
+        (cd "$repo/OpenGLSample" && "$viewer" --flythrough "$frames" "$@")
+    fi
+}
+
+build() {
+    dir=$1
+    shift
+    cmake -S "$repo" -B "$dir" -DCMAKE_BUILD_TYPE=Release -DOPENGLSAMPLE_LTO=ON -DOPENGLSAMPLE_PGO_DIR="$profiles" "$@"
+    cmake --build "$dir" --target OpenGLSample -j
+}
+
+echo "== instrumented build"
+rm -rf "$profiles"
+build "$out/generate" -DOPENGLSAMPLE_PGO=GENERATE
+
+echo "== training run"
+flythrough "$out/generate/OpenGLSample" > "$out/training.txt"
+"$profdata" merge -o "$profiles/default.profdata" "$profiles"/*.profraw
+
+echo "== optimized builds"
+build "$out/release" -DOPENGLSAMPLE_PGO=OFF
+build "$out/use" -DOPENGLSAMPLE_PGO=USE
+
+echo "== ThinLTO release"
+flythrough "$out/release/OpenGLSample" | tee "$out/release.txt"
+echo "== ThinLTO + PGO"
+flythrough "$out/use/OpenGLSample" | tee "$out/use.txt"
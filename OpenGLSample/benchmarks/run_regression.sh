@@ -0,0 +1,35 @@
+#!/bin/sh
+# Render regression gate: renders the scene headlessly on Mesa's llvmpipe software rasterizer at every
+# regression resolution and light count, then checks the final images against the goldens committed in
+# regression/goldens and the frame times against this machine's baselines (see regression.h). Exits
+# non-zero when a case renders differently, has no golden or got slower.
+#
+#   run_regression.sh <viewer executable> <results directory> [--record] [--record-baselines]
+#
+# --record rewrites the goldens after an intended rendering change; commit them with it.
+# --record-baselines writes the frame time baselines into the results directory. Frame times are only
+# comparable on the hardware they were recorded on, so they aren't committed, and until they are recorded
+# a case's frame times go unchecked. Keep the results directory between runs on the same machine.
+set -e
+
+if [ $# -lt 2 ]; then
+    echo "usage: $0 <viewer executable> <results directory> [--record] [--record-baselines]" >&2
+    exit 2
+fi
+
+viewer=$(cd "$(dirname "$1")" && pwd)/$(basename "$1")
+mkdir -p "$2"
+results=$(cd "$2" && pwd)
+shift 2
+
+# Force the software rasterizer so images don't depend on the GPU or its driver version
+export LIBGL_ALWAYS_SOFTWARE=1
+export GALLIUM_DRIVER=llvmpipe
+
+# Textures are loaded relative to the working directory
+cd "$(dirname "$0")/.."
+
+if [ -z "$DISPLAY" ] && [ -z "$WAYLAND_DISPLAY" ] && command -v xvfb-run >/dev/null 2>&1; then
+    exec xvfb-run -a -s "-screen 0 1920x1080x24" "$viewer" --regression "$results" "$@"
+fi
+exec "$viewer" --regression "$results" "$@"
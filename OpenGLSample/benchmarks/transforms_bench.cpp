@@ -0,0 +1,107 @@
+// Scene transform benchmark.
+// Composes the world matrices of a large flat scene (100k objects by default, every tenth one parented to the
+// previous) and prints nanoseconds per object for:
+//   glm         one translate * scale * rotate(angle, axis) chain per object, the old per node update
+//   soa all     TransformStore::Compose with every object dirty, written to a separate instance array
+//   soa 10%     one object in ten changed since the last frame
+//   soa idle    nothing changed; only the instance array copy is left
+//
+// Usage: transforms_bench [objects] [repeats]
+
+#include <glm/glm.hpp>
+#include <glm/gtx/transform.hpp>
+
+#include "../transforms.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+namespace
+{
+    struct BenchObject
+    {
+        glm::vec3 position;
+        float angle;
+        glm::vec3 axis;
+        glm::vec3 scale;
+        int parent;
+    };
+
+    template <typename Function>
+    double UMeasure(int repeats, Function function)
+    {
+        function();
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (int repeat = 0; repeat < repeats; repeat++)
+            function();
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / repeats;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    int objects = argc > 1 ? atoi(argv[1]) : 100000;
+    int repeats = argc > 2 ? atoi(argv[2]) : 50;
+
+    std::vector<BenchObject> scene(objects);
+    TransformStore store;
+    for (int i = 0; i < objects; i++)
+    {
+        BenchObject& object = scene[i];
+        object.position = glm::vec3((float)(i % 300), 0.0f, (float)(i / 300));
+        object.angle = 0.001f * i;
+        object.axis = glm::normalize(glm::vec3(0.3f, 1.0f, 0.1f));
+        object.scale = glm::vec3(1.0f + 0.01f * (i % 7));
+        object.parent = i % 10 == 9 ? i - 1 : -1;
+        store.Add(object.position, glm::angleAxis(object.angle, object.axis), object.scale, object.parent);
+    }
+
+    // 16 byte aligned like a mapped buffer, so the streaming store path is the one being measured
+    std::vector<glm::vec4> instanceStorage(objects * 4);
+    glm::mat4* instances = (glm::mat4*)instanceStorage.data();
+    std::vector<glm::mat4> world(objects);
+
+    double glmTime = UMeasure(repeats, [&]
+        {
+            for (int i = 0; i < objects; i++)
+            {
+                const BenchObject& object = scene[i];
+                glm::mat4 local = glm::translate(object.position) * glm::scale(object.scale) * glm::rotate(object.angle, object.axis);
+                world[i] = object.parent >= 0 ? world[object.parent] * local : local;
+            }
+        });
+
+    double allTime = UMeasure(repeats, [&]
+        {
+            std::fill(store.Dirty.begin(), store.Dirty.end(), (unsigned char)1);
+            store.Compose(instances);
+        });
+
+    int changed = 0;
+    double someTime = UMeasure(repeats, [&]
+        {
+            for (int i = 0; i < objects; i += 10)
+                store.Dirty[i] = 1;
+            changed = store.Compose(instances);
+        });
+
+    double idleTime = UMeasure(repeats, [&] { store.Compose(instances); });
+
+    // Both paths must agree before the numbers mean anything
+    float maxError = 0.0f;
+    for (int i = 0; i < objects; i++)
+        for (int c = 0; c < 4; c++)
+            for (int r = 0; r < 4; r++)
+                maxError = std::max(maxError, std::abs(instances[i][c][r] - world[i][c][r]));
+
+    printf("%d objects, %d repeats, max difference to glm %g (ns per object)\n", objects, repeats, maxError);
+    printf("glm       %8.2f\n", glmTime * 1e9 / objects);
+    printf("soa all   %8.2f\n", allTime * 1e9 / objects);
+    printf("soa 10%%   %8.2f  (%d recomposed)\n", someTime * 1e9 / objects, changed);
+    printf("soa idle  %8.2f\n", idleTime * 1e9 / objects);
+    return maxError < 1e-3f ? 0 : 1;
+}
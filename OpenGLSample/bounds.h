@@ -0,0 +1,265 @@
+#ifndef BOUNDS_H
+#define BOUNDS_H
+
+#include <glm/glm.hpp>
+
+#include <cfloat>
+#include <cmath>
+#include <cstddef>
+
+// SSE is available on every x64 target and on x86 when /arch:SSE or higher is set
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define BOUNDS_USE_SSE 1
+#include <xmmintrin.h>
+#endif
+
+// Sphere enclosing a mesh, used for cheap distance and screen-size estimates
+struct BoundingSphere {
+	glm::vec3 Center;
+	float Radius;
+};
+
+// Axis aligned bounding box in either model or world space
+struct BoundingBox {
+	glm::vec3 Min;
+	glm::vec3 Max;
+
+	BoundingBox() : Min(glm::vec3(FLT_MAX)), Max(glm::vec3(-FLT_MAX))
+	{
+	}
+
+	BoundingBox(glm::vec3 min, glm::vec3 max) : Min(min), Max(max)
+	{
+	}
+
+	// grows the box so that it contains the given point
+	void Expand(glm::vec3 point)
+	{
+		Min = glm::min(Min, point);
+		Max = glm::max(Max, point);
+	}
+
+	glm::vec3 Center() const
+	{
+		return (Min + Max) * 0.5f;
+	}
+
+	glm::vec3 Extents() const
+	{
+		return (Max - Min) * 0.5f;
+	}
+
+	// grows the box so that it contains another box
+	void Expand(const BoundingBox& box)
+	{
+		Min = glm::min(Min, box.Min);
+		Max = glm::max(Max, box.Max);
+	}
+
+	bool IsEmpty() const
+	{
+		return Min.x > Max.x;
+	}
+
+	bool Contains(glm::vec3 point) const
+	{
+		return point.x >= Min.x && point.y >= Min.y && point.z >= Min.z && point.x <= Max.x && point.y <= Max.y && point.z <= Max.z;
+	}
+
+	// half the surface area, which is all the SAH needs to compare split candidates
+	float HalfArea() const
+	{
+		glm::vec3 size = Max - Min;
+		return size.x * size.y + size.y * size.z + size.z * size.x;
+	}
+
+	// slab test; returns the entry distance along the ray or a negative value when it misses
+	float Intersect(glm::vec3 origin, glm::vec3 inverseDirection) const
+	{
+		float tNear = 0.0f;
+		float tFar = FLT_MAX;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			// a ray parallel to the slab stays inside it (on a plane counts as inside) or never enters; the
+			// products below would be 0 * inf = NaN for an origin on a plane
+			if (std::isinf(inverseDirection[axis]))
+			{
+				if (origin[axis] < Min[axis] || origin[axis] > Max[axis])
+					return -1.0f;
+				continue;
+			}
+			float t0 = (Min[axis] - origin[axis]) * inverseDirection[axis];
+			float t1 = (Max[axis] - origin[axis]) * inverseDirection[axis];
+			if (t0 > t1)
+			{
+				float swap = t0;
+				t0 = t1;
+				t1 = swap;
+			}
+			tNear = t0 > tNear ? t0 : tNear;
+			tFar = t1 < tFar ? t1 : tFar;
+			if (tNear > tFar)
+				return -1.0f;
+		}
+		return tNear;
+	}
+
+	BoundingSphere Sphere() const
+	{
+		BoundingSphere sphere;
+		sphere.Center = Center();
+		sphere.Radius = glm::length(Extents());
+		return sphere;
+	}
+
+	// returns the world space box enclosing this box after the affine transform (Arvo's method)
+	BoundingBox Transform(const glm::mat4& model) const
+	{
+		glm::vec3 center = glm::vec3(model * glm::vec4(Center(), 1.0f));
+		glm::vec3 extents = Extents();
+		glm::vec3 worldExtents;
+		for (int row = 0; row < 3; row++)
+			worldExtents[row] = std::fabs(model[0][row]) * extents.x + std::fabs(model[1][row]) * extents.y + std::fabs(model[2][row]) * extents.z;
+		return BoundingBox(center - worldExtents, center + worldExtents);
+	}
+};
+
+// Computes the bounds of interleaved vertex data whose first three floats of each vertex are the position
+inline BoundingBox ComputeBounds(const float* vertices, size_t vertexCount, size_t floatsPerVertex)
+{
+	BoundingBox box;
+	for (size_t i = 0; i < vertexCount; i++)
+	{
+		const float* position = vertices + i * floatsPerVertex;
+		box.Expand(glm::vec3(position[0], position[1], position[2]));
+	}
+	return box;
+}
+
+// Counters describing how much work the visibility test saved this frame
+struct CullStats {
+	unsigned int Tested;
+	unsigned int Culled;
+};
+
+// View frustum extracted from a combined projection * view matrix (Gribb/Hartmann)
+class Frustum
+{
+public:
+	// plane equations (xyz = inward normal, w = distance) in the order left, right, bottom, top, near, far
+	glm::vec4 Planes[6];
+
+	Frustum(const glm::mat4& viewProjection)
+	{
+		for (int i = 0; i < 3; i++)
+		{
+			for (int side = 0; side < 2; side++)
+			{
+				float sign = side == 0 ? 1.0f : -1.0f;
+				glm::vec4 plane;
+				for (int column = 0; column < 4; column++)
+					plane[column] = viewProjection[column][3] + sign * viewProjection[column][i];
+				// normalize so that plane distances are in world units
+				float length = glm::length(glm::vec3(plane.x, plane.y, plane.z));
+				Planes[i * 2 + side] = plane / length;
+			}
+		}
+	}
+
+	// true when some part of the world space box lies inside all six planes
+	bool TestBox(const BoundingBox& box) const
+	{
+		glm::vec3 center = box.Center();
+		glm::vec3 extents = box.Extents();
+		for (int i = 0; i < 6; i++)
+		{
+			const glm::vec4& plane = Planes[i];
+			float distance = plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w;
+			float radius = std::fabs(plane.x) * extents.x + std::fabs(plane.y) * extents.y + std::fabs(plane.z) * extents.z;
+			if (distance + radius < 0.0f)
+				return false;
+		}
+		return true;
+	}
+
+	enum Containment { OUTSIDE, INTERSECTS, INSIDE };
+
+	// like TestBox, but also reports when the box is entirely inside so hierarchies can skip testing its children
+	Containment ClassifyBox(const BoundingBox& box) const
+	{
+		glm::vec3 center = box.Center();
+		glm::vec3 extents = box.Extents();
+		Containment result = INSIDE;
+		for (int i = 0; i < 6; i++)
+		{
+			const glm::vec4& plane = Planes[i];
+			float distance = plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w;
+			float radius = std::fabs(plane.x) * extents.x + std::fabs(plane.y) * extents.y + std::fabs(plane.z) * extents.z;
+			if (distance + radius < 0.0f)
+				return OUTSIDE;
+			if (distance - radius < 0.0f)
+				result = INTERSECTS;
+		}
+		return result;
+	}
+
+	bool TestSphere(const BoundingSphere& sphere) const
+	{
+		for (int i = 0; i < 6; i++)
+		{
+			const glm::vec4& plane = Planes[i];
+			if (plane.x * sphere.Center.x + plane.y * sphere.Center.y + plane.z * sphere.Center.z + plane.w < -sphere.Radius)
+				return false;
+		}
+		return true;
+	}
+
+	// tests a batch of world space boxes, writing 1 (visible) or 0 (culled) per box and accumulating the counters
+	void CullBoxes(const BoundingBox* boxes, size_t count, unsigned char* visible, CullStats& stats) const
+	{
+		size_t i = 0;
+#ifdef BOUNDS_USE_SSE
+		// four boxes per iteration, laid out as structure of arrays so each plane test is a handful of vector ops
+		const __m128 signMask = _mm_set1_ps(-0.0f);
+		for (; i + 4 <= count; i += 4)
+		{
+			glm::vec3 c0 = boxes[i].Center(), c1 = boxes[i + 1].Center(), c2 = boxes[i + 2].Center(), c3 = boxes[i + 3].Center();
+			glm::vec3 e0 = boxes[i].Extents(), e1 = boxes[i + 1].Extents(), e2 = boxes[i + 2].Extents(), e3 = boxes[i + 3].Extents();
+			__m128 cx = _mm_setr_ps(c0.x, c1.x, c2.x, c3.x);
+			__m128 cy = _mm_setr_ps(c0.y, c1.y, c2.y, c3.y);
+			__m128 cz = _mm_setr_ps(c0.z, c1.z, c2.z, c3.z);
+			__m128 ex = _mm_setr_ps(e0.x, e1.x, e2.x, e3.x);
+			__m128 ey = _mm_setr_ps(e0.y, e1.y, e2.y, e3.y);
+			__m128 ez = _mm_setr_ps(e0.z, e1.z, e2.z, e3.z);
+
+			__m128 outside = _mm_setzero_ps();
+			for (int p = 0; p < 6; p++)
+			{
+				__m128 px = _mm_set1_ps(Planes[p].x);
+				__m128 py = _mm_set1_ps(Planes[p].y);
+				__m128 pz = _mm_set1_ps(Planes[p].z);
+				__m128 pw = _mm_set1_ps(Planes[p].w);
+				__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px, cx), _mm_mul_ps(py, cy)), _mm_add_ps(_mm_mul_ps(pz, cz), pw));
+				__m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_andnot_ps(signMask, px), ex), _mm_mul_ps(_mm_andnot_ps(signMask, py), ey)), _mm_mul_ps(_mm_andnot_ps(signMask, pz), ez));
+				outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, radius), _mm_setzero_ps()));
+			}
+
+			int mask = _mm_movemask_ps(outside);
+			for (int lane = 0; lane < 4; lane++)
+			{
+				visible[i + lane] = (mask & (1 << lane)) ? 0 : 1;
+				stats.Culled += (mask >> lane) & 1;
+			}
+			stats.Tested += 4;
+		}
+#endif
+		// scalar tail (and the whole batch when SSE is unavailable)
+		for (; i < count; i++)
+		{
+			visible[i] = TestBox(boxes[i]) ? 1 : 0;
+			stats.Culled += visible[i] ? 0 : 1;
+			stats.Tested++;
+		}
+	}
+};
+#endif
@@ -0,0 +1,321 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <glm/glm.hpp>
+
+#include "bounds.h"
+
+#include <vector>
+
+// Dynamic bounding volume hierarchy over a set of boxes identified by item index.
+// The tree is built top-down with a binned surface area heuristic and refit in place when items move,
+// so frustum queries and ray picks visit O(log n) nodes instead of every object. Leaves hold up to
+// LEAF_SIZE items so a partially visible leaf is finished with one SIMD batch from Frustum::CullBoxes.
+class Bvh
+{
+public:
+	struct Node {
+		BoundingBox Bounds;
+		int Left;       // child indices, -1 for leaves
+		int Right;
+		int Parent;     // -1 for the root
+		int FirstItem;  // range of Items stored in a leaf, empty for interior nodes
+		int ItemCount;
+	};
+
+	static const int LEAF_SIZE = 4;
+
+	// nodes are stored parent-before-children, so a reverse walk always visits children first
+	std::vector<Node> Nodes;
+	// item indices grouped by leaf
+	std::vector<int> Items;
+
+	// rebuilds the whole tree from scratch, use when items are added or removed
+	void Build(const BoundingBox* boxes, int count)
+	{
+		Nodes.clear();
+		Items.resize(count);
+		leafOfItem.assign(count, -1);
+		if (count == 0)
+			return;
+
+		std::vector<glm::vec3> centers(count);
+		for (int i = 0; i < count; i++)
+		{
+			Items[i] = i;
+			centers[i] = boxes[i].Center();
+		}
+		Nodes.reserve(count * 2 / LEAF_SIZE + 1);
+		buildRange(boxes, centers, 0, count, -1);
+	}
+
+	// updates the leaf holding a moved item and propagates the change to the root
+	void Refit(const BoundingBox* boxes, int item)
+	{
+		int node = leafOfItem[item];
+		Nodes[node].Bounds = leafBounds(boxes, Nodes[node]);
+		for (node = Nodes[node].Parent; node >= 0; node = Nodes[node].Parent)
+		{
+			BoundingBox merged = Nodes[Nodes[node].Left].Bounds;
+			merged.Expand(Nodes[Nodes[node].Right].Bounds);
+			Nodes[node].Bounds = merged;
+		}
+	}
+
+	// refits every node bottom-up, cheaper than per-item refits once many items have moved
+	void RefitAll(const BoundingBox* boxes)
+	{
+		for (int node = (int)Nodes.size() - 1; node >= 0; node--)
+		{
+			Node& current = Nodes[node];
+			if (current.ItemCount > 0)
+			{
+				current.Bounds = leafBounds(boxes, current);
+				continue;
+			}
+			current.Bounds = Nodes[current.Left].Bounds;
+			current.Bounds.Expand(Nodes[current.Right].Bounds);
+		}
+	}
+
+	// appends every item of the subtree under root whose box touches the frustum;
+	// subtrees fully inside are accepted without further tests
+	void Query(const Frustum& frustum, const BoundingBox* boxes, std::vector<int>& visibleItems, CullStats& stats, int root = 0) const
+	{
+		if (Nodes.empty())
+			return;
+
+		std::vector<int> stack;
+		stack.reserve(64);
+		stack.push_back(root);
+		while (!stack.empty())
+		{
+			int node = stack.back();
+			stack.pop_back();
+			const Node& current = Nodes[node];
+			Frustum::Containment containment = frustum.ClassifyBox(current.Bounds);
+			if (containment == Frustum::OUTSIDE)
+				continue;
+			if (containment == Frustum::INSIDE)
+			{
+				collect(node, visibleItems);
+				continue;
+			}
+			if (current.ItemCount > 0)
+			{
+				// leaf straddling the frustum: test its items in one batch
+				BoundingBox leafBoxes[LEAF_SIZE];
+				unsigned char visible[LEAF_SIZE];
+				for (int i = 0; i < current.ItemCount; i++)
+					leafBoxes[i] = boxes[Items[current.FirstItem + i]];
+				frustum.CullBoxes(leafBoxes, current.ItemCount, visible, stats);
+				for (int i = 0; i < current.ItemCount; i++)
+				{
+					if (visible[i])
+						visibleItems.push_back(Items[current.FirstItem + i]);
+				}
+				continue;
+			}
+			stack.push_back(Nodes[node].Left);
+			stack.push_back(Nodes[node].Right);
+		}
+	}
+
+	// splits the tree into at most maxRoots disjoint subtrees covering every item, for querying them in parallel
+	void Split(int maxRoots, std::vector<int>& roots) const
+	{
+		roots.clear();
+		if (Nodes.empty())
+			return;
+		roots.push_back(0);
+		// keep opening the first interior node; breadth first, so subtrees stay roughly balanced
+		for (size_t i = 0; i < roots.size() && (int)roots.size() < maxRoots; )
+		{
+			const Node& node = Nodes[roots[i]];
+			if (node.ItemCount > 0)
+			{
+				i++;
+				continue;
+			}
+			roots[i] = node.Left;
+			roots.push_back(node.Right);
+		}
+	}
+
+	// returns the item whose box the ray enters first, or -1 when nothing is hit
+	int Raycast(const BoundingBox* boxes, glm::vec3 origin, glm::vec3 direction, float& hitDistance) const
+	{
+		int hitItem = -1;
+		hitDistance = FLT_MAX;
+		if (Nodes.empty())
+			return hitItem;
+
+		glm::vec3 inverseDirection(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+		std::vector<int> stack;
+		stack.reserve(64);
+		stack.push_back(0);
+		while (!stack.empty())
+		{
+			int node = stack.back();
+			stack.pop_back();
+			float distance = Nodes[node].Bounds.Intersect(origin, inverseDirection);
+			if (distance < 0.0f || distance >= hitDistance)
+				continue;
+			if (Nodes[node].ItemCount > 0)
+			{
+				for (int i = 0; i < Nodes[node].ItemCount; i++)
+				{
+					int item = Items[Nodes[node].FirstItem + i];
+					float itemDistance = boxes[item].Intersect(origin, inverseDirection);
+					if (itemDistance >= 0.0f && itemDistance < hitDistance)
+					{
+						hitDistance = itemDistance;
+						hitItem = item;
+					}
+				}
+				continue;
+			}
+			stack.push_back(Nodes[node].Left);
+			stack.push_back(Nodes[node].Right);
+		}
+		return hitItem;
+	}
+
+private:
+	static const int BIN_COUNT = 12;
+
+	std::vector<int> leafOfItem;
+
+	// builds the subtree over Items[first, last) and returns its node index
+	int buildRange(const BoundingBox* boxes, const std::vector<glm::vec3>& centers, int first, int last, int parent)
+	{
+		int nodeIndex = (int)Nodes.size();
+		Nodes.push_back(Node());
+		Node node;
+		node.Parent = parent;
+		node.Left = node.Right = -1;
+		node.FirstItem = first;
+		node.ItemCount = 0;
+		for (int i = first; i < last; i++)
+			node.Bounds.Expand(boxes[Items[i]]);
+
+		if (last - first <= LEAF_SIZE)
+		{
+			node.ItemCount = last - first;
+			for (int i = first; i < last; i++)
+				leafOfItem[Items[i]] = nodeIndex;
+			Nodes[nodeIndex] = node;
+			return nodeIndex;
+		}
+
+		int middle = partition(boxes, centers, first, last);
+		Nodes[nodeIndex] = node;
+		int left = buildRange(boxes, centers, first, middle, nodeIndex);
+		int right = buildRange(boxes, centers, middle, last, nodeIndex);
+		Nodes[nodeIndex].Left = left;
+		Nodes[nodeIndex].Right = right;
+		return nodeIndex;
+	}
+
+	// picks the cheapest binned SAH split over all three axes and partitions the items around it
+	int partition(const BoundingBox* boxes, const std::vector<glm::vec3>& centers, int first, int last)
+	{
+		BoundingBox centerBounds;
+		for (int i = first; i < last; i++)
+			centerBounds.Expand(centers[Items[i]]);
+
+		int bestAxis = -1;
+		int bestBin = 0;
+		float bestCost = FLT_MAX;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			float minimum = centerBounds.Min[axis];
+			float extent = centerBounds.Max[axis] - minimum;
+			if (extent <= 0.0f)
+				continue;
+
+			BoundingBox binBounds[BIN_COUNT];
+			int binCounts[BIN_COUNT] = { 0 };
+			for (int i = first; i < last; i++)
+			{
+				int bin = binOf(centers[Items[i]][axis], minimum, extent);
+				binBounds[bin].Expand(boxes[Items[i]]);
+				binCounts[bin]++;
+			}
+
+			// sweep from the right so each split's right-hand area and count are available in one pass
+			float rightArea[BIN_COUNT];
+			int rightCount[BIN_COUNT];
+			BoundingBox accumulated;
+			int count = 0;
+			for (int bin = BIN_COUNT - 1; bin > 0; bin--)
+			{
+				accumulated.Expand(binBounds[bin]);
+				count += binCounts[bin];
+				rightArea[bin] = accumulated.IsEmpty() ? 0.0f : accumulated.HalfArea();
+				rightCount[bin] = count;
+			}
+
+			accumulated = BoundingBox();
+			count = 0;
+			for (int bin = 0; bin < BIN_COUNT - 1; bin++)
+			{
+				accumulated.Expand(binBounds[bin]);
+				count += binCounts[bin];
+				float leftArea = accumulated.IsEmpty() ? 0.0f : accumulated.HalfArea();
+				float cost = leftArea * count + rightArea[bin + 1] * rightCount[bin + 1];
+				if (count > 0 && rightCount[bin + 1] > 0 && cost < bestCost)
+				{
+					bestCost = cost;
+					bestAxis = axis;
+					bestBin = bin;
+				}
+			}
+		}
+
+		// every center coincides, so any split is as good as another
+		if (bestAxis < 0)
+			return (first + last) / 2;
+
+		float minimum = centerBounds.Min[bestAxis];
+		float extent = centerBounds.Max[bestAxis] - minimum;
+		int middle = first;
+		for (int i = first; i < last; i++)
+		{
+			if (binOf(centers[Items[i]][bestAxis], minimum, extent) <= bestBin)
+			{
+				int swap = Items[i];
+				Items[i] = Items[middle];
+				Items[middle] = swap;
+				middle++;
+			}
+		}
+		return middle;
+	}
+
+	static int binOf(float value, float minimum, float extent)
+	{
+		int bin = (int)((value - minimum) / extent * BIN_COUNT);
+		return bin < 0 ? 0 : (bin >= BIN_COUNT ? BIN_COUNT - 1 : bin);
+	}
+
+	BoundingBox leafBounds(const BoundingBox* boxes, const Node& leaf) const
+	{
+		BoundingBox bounds;
+		for (int i = 0; i < leaf.ItemCount; i++)
+			bounds.Expand(boxes[Items[leaf.FirstItem + i]]);
+		return bounds;
+	}
+
+	void collect(int node, std::vector<int>& items) const
+	{
+		if (Nodes[node].ItemCount > 0)
+		{
+			items.insert(items.end(), Items.begin() + Nodes[node].FirstItem, Items.begin() + Nodes[node].FirstItem + Nodes[node].ItemCount);
+			return;
+		}
+		collect(Nodes[node].Left, items);
+		collect(Nodes[node].Right, items);
+	}
+};
+#endif
@@ -0,0 +1,159 @@
+#ifndef FRAMEBUFFERS_H
+#define FRAMEBUFFERS_H
+
+#include "gl_loader.h"
+
+#include "glstats.h"
+
+#include <vector>
+
+// Tracks the window's framebuffer size and lends the offscreen targets their textures. Textures come in size
+// classes, each axis rounded up to 1, 1.25, 1.5 or 1.75 times a power of two, and targets render into the
+// lower left of them. A target only swaps textures when its size class changes, and the old ones wait in a
+// pool, so dragging the window edge reuses a few allocations instead of reallocating every target on every
+// frame. Textures left in the pool for POOL_FRAMES frames are deleted by Trim.
+class FramebufferManager
+{
+public:
+	static const int MIN_SIZE_CLASS = 64;
+	static const int POOL_FRAMES = 120;
+
+	// the window's framebuffer size
+	int Width, Height;
+	// textures created and deleted since the start
+	unsigned int Allocations, Deletions;
+
+	FramebufferManager() : Width(0), Height(0), Allocations(0), Deletions(0), frame(0)
+	{
+	}
+
+	// deletes every texture, lent or pooled
+	void Destroy()
+	{
+		for (size_t i = 0; i < lent.size(); i++)
+			deleteTexture(lent[i].Texture);
+		for (size_t i = 0; i < pool.size(); i++)
+			deleteTexture(pool[i].Texture);
+		lent.clear();
+		pool.clear();
+	}
+
+	// records the framebuffer size from the resize callback; targets pick it up the next time they are used
+	void Resize(int width, int height)
+	{
+		Width = width;
+		Height = height;
+	}
+
+	// width over height, 1 while the window is minimized
+	float Aspect() const
+	{
+		return Width > 0 && Height > 0 ? (float)Width / (float)Height : 1.0f;
+	}
+
+	// the smallest size class holding size
+	static int SizeClass(int size)
+	{
+		if (size <= MIN_SIZE_CLASS)
+			return MIN_SIZE_CLASS;
+		int base = MIN_SIZE_CLASS;
+		while (base * 2 < size)
+			base *= 2;
+		int step = base / 4;
+		return base + (size - base + step - 1) / step * step;
+	}
+
+	// a texture of the format sized to the size classes of width and height, with that many mip levels, from the
+	// pool when it has one. New textures filter with GL_NEAREST and clamp to the edge; whoever needs other
+	// parameters sets them.
+	GLuint Acquire(GLenum format, int width, int height, int levels = 1)
+	{
+		PooledTexture texture = { 0, format, SizeClass(width), SizeClass(height), levels, frame };
+		for (size_t i = 0; i < pool.size(); i++)
+		{
+			if (pool[i].Format == texture.Format && pool[i].Width == texture.Width && pool[i].Height == texture.Height
+				&& pool[i].Levels == texture.Levels)
+			{
+				texture.Texture = pool[i].Texture;
+				pool.erase(pool.begin() + i);
+				break;
+			}
+		}
+		if (texture.Texture == 0)
+		{
+			glGenTextures(1, &texture.Texture);
+			GLStats::BindTexture(GL_TEXTURE_2D, texture.Texture);
+			glTexStorage2D(GL_TEXTURE_2D, levels, format, texture.Width, texture.Height);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+			GLStats::BindTexture(GL_TEXTURE_2D, 0);
+			Allocations++;
+		}
+		lent.push_back(texture);
+		return texture.Texture;
+	}
+
+	// hands a texture from Acquire back; it stays in the pool for a while in case its size class comes back
+	void Release(GLuint texture)
+	{
+		for (size_t i = 0; i < lent.size(); i++)
+		{
+			if (lent[i].Texture == texture)
+			{
+				lent[i].Released = frame;
+				pool.push_back(lent[i]);
+				lent.erase(lent.begin() + i);
+				return;
+			}
+		}
+	}
+
+	// once a frame: deletes the pooled textures nobody took back in POOL_FRAMES frames
+	void Trim()
+	{
+		frame++;
+		for (size_t i = 0; i < pool.size();)
+		{
+			if (frame - pool[i].Released > POOL_FRAMES)
+			{
+				deleteTexture(pool[i].Texture);
+				pool.erase(pool.begin() + i);
+			}
+			else
+				i++;
+		}
+	}
+
+	// textures lent out and waiting in the pool
+	int LentTextures() const
+	{
+		return (int)lent.size();
+	}
+
+	int PooledTextures() const
+	{
+		return (int)pool.size();
+	}
+
+private:
+	struct PooledTexture {
+		GLuint Texture;
+		GLenum Format;
+		int Width, Height;      // size classes
+		int Levels;
+		uint64_t Released;      // frame it went back to the pool
+	};
+
+	std::vector<PooledTexture> lent;
+	std::vector<PooledTexture> pool;
+	uint64_t frame;
+
+	void deleteTexture(GLuint texture)
+	{
+		glDeleteTextures(1, &texture);
+		Deletions++;
+	}
+};
+#endif
@@ -0,0 +1,162 @@
+#ifndef GBUFFER_H
+#define GBUFFER_H
+
+#include "gl_loader.h"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "framebuffers.h"
+#include "glstats.h"
+
+// A light as the deferred lighting pass sees it; lights with a black color are skipped
+struct DeferredLight {
+	glm::vec3 Position;
+	glm::vec3 Color;
+	int Shadow;                 // the light's index in the shadow atlas, -1 for no shadows
+};
+
+// Deferred shading: the object pass writes each visible surface's albedo with its specular intensity (RGBA8)
+// and its octahedral packed normal (RG16F) once, next to a depth texture, and the lighting pass then shades
+// only the pixels left in the G-buffer, one additive fullscreen pass per light. Positions are rebuilt from
+// depth. The scene's lights have no falloff, so a light volume would cover the whole screen anyway.
+class GBuffer
+{
+public:
+	// lights drawn by the last Light call
+	int LightPasses;
+
+	GBuffer() : LightPasses(0), framebuffers(nullptr), width(0), height(0), fbo(0), albedoSpecularTexture(0), normalTexture(0), depthTexture(0), emptyVao(0)
+	{
+	}
+
+	// the program draws a fullscreen triangle on the far plane from gl_VertexID and takes the sampler2Ds
+	// "albedoSpecular", "packedNormal" and "depth", a mat4 "inverseViewProjection", vec3s "lightPosition"
+	// and "lightColor", an int "shadowLight" and a vec2 "viewportSize"; its sampler2DShadow "shadowAtlas"
+	// reads texture unit 3. The textures come from the framebuffer manager.
+	void Init(GLuint lightProgram, FramebufferManager& framebufferManager)
+	{
+		program = lightProgram;
+		framebuffers = &framebufferManager;
+		inverseViewProjectionLoc = glGetUniformLocation(program, "inverseViewProjection");
+		lightPositionLoc = glGetUniformLocation(program, "lightPosition");
+		lightColorLoc = glGetUniformLocation(program, "lightColor");
+		shadowLightLoc = glGetUniformLocation(program, "shadowLight");
+		viewportSizeLoc = glGetUniformLocation(program, "viewportSize");
+		GLStats::UseProgram(program);
+		GLStats::Uniform1i(glGetUniformLocation(program, "albedoSpecular"), 0);
+		GLStats::Uniform1i(glGetUniformLocation(program, "packedNormal"), 1);
+		GLStats::Uniform1i(glGetUniformLocation(program, "depth"), 2);
+		GLStats::Uniform1i(glGetUniformLocation(program, "shadowAtlas"), 3);
+		GLStats::UseProgram(0);
+		glGenVertexArrays(1, &emptyVao);
+		glGenFramebuffers(1, &fbo);
+	}
+
+	void Destroy()
+	{
+		release();
+		glDeleteVertexArrays(1, &emptyVao);
+		glDeleteFramebuffers(1, &fbo);
+	}
+
+	// binds the G-buffer (with new textures when the size moved to another size class) and clears it, for
+	// the object pass. The viewport is left alone; the objects fill the lower left of the textures.
+	void Begin(int framebufferWidth, int framebufferHeight)
+	{
+		if (FramebufferManager::SizeClass(framebufferWidth) != width || FramebufferManager::SizeClass(framebufferHeight) != height)
+			allocate(framebufferWidth, framebufferHeight);
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+		const GLenum attachments[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+		glDrawBuffers(2, attachments);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	}
+
+	// copies the depth of the lower left viewportWidth x viewportHeight the objects filled to the target
+	// framebuffer (for the lamps and the Hi-Z pyramid), then adds each light's contribution there. The depth
+	// test against the copy (GL_GREATER with the triangle on the far plane) skips the pixels no object
+	// covered. Leaves the target bound.
+	void Light(const DeferredLight* lights, int count, const glm::mat4& viewProjection, GLuint target, int viewportWidth, int viewportHeight)
+	{
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target);
+		glBlitFramebuffer(0, 0, viewportWidth, viewportHeight, 0, 0, viewportWidth, viewportHeight, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+		glBindFramebuffer(GL_FRAMEBUFFER, target);
+
+		glDepthMask(GL_FALSE);
+		glDepthFunc(GL_GREATER);
+		glEnable(GL_BLEND);
+		glBlendFunc(GL_ONE, GL_ONE);
+		GLStats::UseProgram(program);
+		GLStats::BindVertexArray(emptyVao);
+		glActiveTexture(GL_TEXTURE1);
+		GLStats::BindTexture(GL_TEXTURE_2D, normalTexture);
+		glActiveTexture(GL_TEXTURE2);
+		GLStats::BindTexture(GL_TEXTURE_2D, depthTexture);
+		glActiveTexture(GL_TEXTURE0);
+		GLStats::BindTexture(GL_TEXTURE_2D, albedoSpecularTexture);
+		GLStats::UniformMatrix4fv(inverseViewProjectionLoc, 1, GL_FALSE, glm::value_ptr(glm::inverse(viewProjection)));
+		GLStats::Uniform2f(viewportSizeLoc, (float)viewportWidth, (float)viewportHeight);
+		LightPasses = 0;
+		for (int i = 0; i < count; i++)
+		{
+			const DeferredLight& light = lights[i];
+			if (light.Color == glm::vec3(0.0f))
+				continue;
+			GLStats::Uniform3f(lightPositionLoc, light.Position.x, light.Position.y, light.Position.z);
+			GLStats::Uniform3f(lightColorLoc, light.Color.x, light.Color.y, light.Color.z);
+			GLStats::Uniform1i(shadowLightLoc, light.Shadow);
+			GLStats::DrawArrays(GL_TRIANGLES, 0, 3);
+			LightPasses++;
+		}
+
+		glActiveTexture(GL_TEXTURE2);
+		GLStats::BindTexture(GL_TEXTURE_2D, 0);
+		glActiveTexture(GL_TEXTURE1);
+		GLStats::BindTexture(GL_TEXTURE_2D, 0);
+		glActiveTexture(GL_TEXTURE0);
+		GLStats::BindTexture(GL_TEXTURE_2D, 0);
+		GLStats::BindVertexArray(0);
+		glDisable(GL_BLEND);
+		glDepthFunc(GL_LESS);
+		glDepthMask(GL_TRUE);
+	}
+
+private:
+	FramebufferManager* framebuffers;
+	int width, height;          // size classes of the textures
+	GLuint fbo;
+	GLuint albedoSpecularTexture, normalTexture, depthTexture;
+	GLuint emptyVao;
+	GLuint program;
+	GLint inverseViewProjectionLoc, lightPositionLoc, lightColorLoc, shadowLightLoc, viewportSizeLoc;
+
+	void release()
+	{
+		if (albedoSpecularTexture != 0)
+			framebuffers->Release(albedoSpecularTexture);
+		if (normalTexture != 0)
+			framebuffers->Release(normalTexture);
+		if (depthTexture != 0)
+			framebuffers->Release(depthTexture);
+		albedoSpecularTexture = normalTexture = depthTexture = 0;
+	}
+
+	void allocate(int framebufferWidth, int framebufferHeight)
+	{
+		release();
+		width = FramebufferManager::SizeClass(framebufferWidth);
+		height = FramebufferManager::SizeClass(framebufferHeight);
+
+		// depth matches the default framebuffer's (GLFW default 24 bit depth + 8 bit stencil) so it can be blitted
+		albedoSpecularTexture = framebuffers->Acquire(GL_RGBA8, width, height);
+		normalTexture = framebuffers->Acquire(GL_RG16F, width, height);
+		depthTexture = framebuffers->Acquire(GL_DEPTH24_STENCIL8, width, height);
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, albedoSpecularTexture, 0);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, normalTexture, 0);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+};
+#endif
@@ -0,0 +1,72 @@
+#include "gl_loader.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+	GLLoader::ProcAddressFunction getProcAddress = nullptr;
+	int resolvedCount = 0;
+	GLint contextMajor = 0, contextMinor = 0;
+}
+
+// Every pointer starts at a stub that resolves the entry point, patches the pointer so later calls go
+// straight to the driver, and forwards the first call
+#define GL_LOADER_DEFINE(ret, name, params, args) \
+	static ret GL_LOADER_APIENTRY resolve_##name params \
+	{ \
+		gl_loader_##name = (PFNGL_LOADER_##name)GLLoader::Resolve("gl" #name); \
+		return gl_loader_##name args; \
+	} \
+	PFNGL_LOADER_##name gl_loader_##name = resolve_##name;
+GL_LOADER_FUNCTIONS(GL_LOADER_DEFINE)
+#undef GL_LOADER_DEFINE
+
+bool GLLoader::Init(ProcAddressFunction function, int requiredMajor, int requiredMinor)
+{
+	getProcAddress = function;
+	glGetIntegerv(GL_MAJOR_VERSION, &contextMajor);
+	glGetIntegerv(GL_MINOR_VERSION, &contextMinor);
+	if (!HasVersion(requiredMajor, requiredMinor))
+	{
+		fprintf(stderr, "OpenGL %d.%d is required, the context is %d.%d\n", requiredMajor, requiredMinor, contextMajor, contextMinor);
+		return false;
+	}
+	return true;
+}
+
+bool GLLoader::HasVersion(int major, int minor)
+{
+	return contextMajor > major || (contextMajor == major && contextMinor >= minor);
+}
+
+bool GLLoader::HasExtension(const char* name)
+{
+	GLint count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+	for (GLint i = 0; i < count; i++)
+	{
+		const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, (GLuint)i);
+		if (extension && strcmp(extension, name) == 0)
+			return true;
+	}
+	return false;
+}
+
+int GLLoader::ResolvedCount()
+{
+	return resolvedCount;
+}
+
+void* GLLoader::Resolve(const char* name)
+{
+	void* function = getProcAddress ? getProcAddress(name) : nullptr;
+	if (!function)
+	{
+		fprintf(stderr, "OpenGL entry point %s is not available%s\n", name, getProcAddress ? "" : " (GLLoader::Init was not called)");
+		abort();
+	}
+	resolvedCount++;
+	return function;
+}
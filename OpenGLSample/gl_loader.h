@@ -0,0 +1,390 @@
+#ifndef GL_LOADER_H
+#define GL_LOADER_H
+
+// The project's only OpenGL loader (replaces GLEW and GLAD). It declares just the types, enums and entry
+// points the renderer uses; every entry point starts out as a stub that looks up the real function on its
+// first call, so a run resolves only the functions it actually calls. Add an entry to GL_LOADER_FUNCTIONS
+// (and any new enums) before using a GL function for the first time.
+
+#include <cstddef>
+#include <cstdint>
+
+// keep the system GL headers (and the copy GLFW would include) out, as GLEW and GLAD do
+#define __gl_h_
+#define __GL_H__
+#define __glext_h_
+#define __gl_glcorearb_h_
+#ifndef GLFW_INCLUDE_NONE
+#define GLFW_INCLUDE_NONE
+#endif
+
+#if defined(_WIN32) && !defined(__CYGWIN__)
+#define GL_LOADER_APIENTRY __stdcall
+#else
+#define GL_LOADER_APIENTRY
+#endif
+
+typedef unsigned int GLenum;
+typedef unsigned char GLboolean;
+typedef unsigned int GLbitfield;
+typedef void GLvoid;
+typedef int GLint;
+typedef unsigned int GLuint;
+typedef int GLsizei;
+typedef float GLfloat;
+typedef double GLdouble;
+typedef char GLchar;
+typedef unsigned char GLubyte;
+typedef std::ptrdiff_t GLintptr;
+typedef std::ptrdiff_t GLsizeiptr;
+typedef int64_t GLint64;
+typedef uint64_t GLuint64;
+typedef struct __GLsync* GLsync;
+
+#define GL_FALSE 0
+#define GL_NONE 0
+#define GL_TRUE 1
+
+// primitives and types
+#define GL_TRIANGLES 0x0004
+#define GL_TRIANGLE_STRIP 0x0005
+#define GL_TRIANGLE_FAN 0x0006
+#define GL_UNSIGNED_BYTE 0x1401
+#define GL_UNSIGNED_INT 0x1405
+#define GL_FLOAT 0x1406
+
+// state
+#define GL_DEPTH_BUFFER_BIT 0x00000100
+#define GL_COLOR_BUFFER_BIT 0x00004000
+#define GL_ONE 1
+#define GL_LESS 0x0201
+#define GL_EQUAL 0x0202
+#define GL_LEQUAL 0x0203
+#define GL_GREATER 0x0204
+#define GL_SRC_ALPHA 0x0302
+#define GL_ONE_MINUS_SRC_ALPHA 0x0303
+#define GL_BACK 0x0405
+#define GL_DEPTH_TEST 0x0B71
+#define GL_BLEND 0x0BE2
+#define GL_SCISSOR_TEST 0x0C11
+#define GL_UNPACK_ALIGNMENT 0x0CF5
+#define GL_PACK_ALIGNMENT 0x0D05
+#define GL_POLYGON_OFFSET_FILL 0x8037
+#define GL_VERSION 0x1F02
+#define GL_EXTENSIONS 0x1F03
+#define GL_MAJOR_VERSION 0x821B
+#define GL_MINOR_VERSION 0x821C
+#define GL_NUM_EXTENSIONS 0x821D
+
+// textures
+#define GL_TEXTURE_2D 0x0DE1
+#define GL_RED 0x1903
+#define GL_RGB 0x1907
+#define GL_RGBA 0x1908
+#define GL_NEAREST 0x2600
+#define GL_LINEAR 0x2601
+#define GL_NEAREST_MIPMAP_NEAREST 0x2700
+#define GL_TEXTURE_MAG_FILTER 0x2800
+#define GL_TEXTURE_MIN_FILTER 0x2801
+#define GL_TEXTURE_WRAP_S 0x2802
+#define GL_TEXTURE_WRAP_T 0x2803
+#define GL_REPEAT 0x2901
+#define GL_RGB8 0x8051
+#define GL_RGBA8 0x8058
+#define GL_CLAMP_TO_EDGE 0x812F
+#define GL_TEXTURE_BASE_LEVEL 0x813C
+#define GL_TEXTURE_MAX_LEVEL 0x813D
+#define GL_RG 0x8227
+#define GL_R8 0x8229
+#define GL_R32F 0x822E
+#define GL_RG16F 0x822F
+#define GL_R32UI 0x8236
+#define GL_TEXTURE0 0x84C0
+#define GL_TEXTURE1 0x84C1
+#define GL_TEXTURE2 0x84C2
+#define GL_TEXTURE3 0x84C3
+#define GL_TEXTURE_COMPARE_MODE 0x884C
+#define GL_TEXTURE_COMPARE_FUNC 0x884D
+#define GL_COMPARE_REF_TO_TEXTURE 0x884E
+#define GL_DEPTH24_STENCIL8 0x88F0
+#define GL_DEPTH_COMPONENT32F 0x8CAC
+#define GL_RED_INTEGER 0x8D94
+
+// buffers
+#define GL_MAP_READ_BIT 0x0001
+#define GL_MAP_WRITE_BIT 0x0002
+#define GL_MAP_INVALIDATE_BUFFER_BIT 0x0008
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#define GL_MAP_COHERENT_BIT 0x0080
+#define GL_PARAMETER_BUFFER 0x80EE
+#define GL_ARRAY_BUFFER 0x8892
+#define GL_ELEMENT_ARRAY_BUFFER 0x8893
+#define GL_STREAM_DRAW 0x88E0
+#define GL_STREAM_READ 0x88E1
+#define GL_STATIC_DRAW 0x88E4
+#define GL_DYNAMIC_DRAW 0x88E8
+#define GL_DYNAMIC_COPY 0x88EA
+#define GL_PIXEL_PACK_BUFFER 0x88EB
+#define GL_UNIFORM_BUFFER 0x8A11
+#define GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT 0x8A34
+#define GL_COPY_WRITE_BUFFER 0x8F37
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#define GL_SHADER_STORAGE_BUFFER 0x90D2
+
+// framebuffers
+#define GL_DEPTH_STENCIL_ATTACHMENT 0x821A
+#define GL_READ_FRAMEBUFFER 0x8CA8
+#define GL_DRAW_FRAMEBUFFER 0x8CA9
+#define GL_COLOR_ATTACHMENT0 0x8CE0
+#define GL_COLOR_ATTACHMENT1 0x8CE1
+#define GL_DEPTH_ATTACHMENT 0x8D00
+#define GL_FRAMEBUFFER 0x8D40
+
+// shaders
+#define GL_FRAGMENT_SHADER 0x8B30
+#define GL_VERTEX_SHADER 0x8B31
+#define GL_COMPILE_STATUS 0x8B81
+#define GL_LINK_STATUS 0x8B82
+#define GL_INFO_LOG_LENGTH 0x8B84
+#define GL_GEOMETRY_SHADER 0x8DD9
+#define GL_COMPUTE_SHADER 0x91B9
+#define GL_COMMAND_BARRIER_BIT 0x00000040
+
+// queries and sync
+#define GL_SYNC_FLUSH_COMMANDS_BIT 0x00000001
+#define GL_QUERY_RESULT 0x8866
+#define GL_QUERY_RESULT_AVAILABLE 0x8867
+#define GL_SAMPLES_PASSED 0x8914
+#define GL_ANY_SAMPLES_PASSED 0x8C2F
+#define GL_ANY_SAMPLES_PASSED_CONSERVATIVE 0x8D6A
+#define GL_TIMESTAMP 0x8E28
+#define GL_SYNC_GPU_COMMANDS_COMPLETE 0x9117
+#define GL_ALREADY_SIGNALED 0x911A
+#define GL_TIMEOUT_EXPIRED 0x911B
+#define GL_CONDITION_SATISFIED 0x911C
+#define GL_WAIT_FAILED 0x911D
+
+// X(return type, name without the gl prefix, parameters, arguments) for every entry point in use
+#define GL_LOADER_FUNCTIONS(X) \
+	X(void, ActiveTexture, (GLenum texture), (texture)) \
+	X(void, AttachShader, (GLuint program, GLuint shader), (program, shader)) \
+	X(void, BeginQuery, (GLenum target, GLuint id), (target, id)) \
+	X(void, BindBuffer, (GLenum target, GLuint buffer), (target, buffer)) \
+	X(void, BindBufferBase, (GLenum target, GLuint index, GLuint buffer), (target, index, buffer)) \
+	X(void, BindBufferRange, (GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size), (target, index, buffer, offset, size)) \
+	X(void, BindFramebuffer, (GLenum target, GLuint framebuffer), (target, framebuffer)) \
+	X(void, BindTexture, (GLenum target, GLuint texture), (target, texture)) \
+	X(void, BindVertexArray, (GLuint array), (array)) \
+	X(void, BlendFunc, (GLenum sfactor, GLenum dfactor), (sfactor, dfactor)) \
+	X(void, BlitFramebuffer, (GLint srcX0, GLint srcY0, GLint srcX1, GLint srcY1, GLint dstX0, GLint dstY0, GLint dstX1, GLint dstY1, GLbitfield mask, GLenum filter), (srcX0, srcY0, srcX1, srcY1, dstX0, dstY0, dstX1, dstY1, mask, filter)) \
+	X(void, BufferData, (GLenum target, GLsizeiptr size, const void* data, GLenum usage), (target, size, data, usage)) \
+	X(void, BufferStorage, (GLenum target, GLsizeiptr size, const void* data, GLbitfield flags), (target, size, data, flags)) \
+	X(void, BufferSubData, (GLenum target, GLintptr offset, GLsizeiptr size, const void* data), (target, offset, size, data)) \
+	X(void, Clear, (GLbitfield mask), (mask)) \
+	X(void, ClearBufferData, (GLenum target, GLenum internalformat, GLenum format, GLenum type, const void* data), (target, internalformat, format, type, data)) \
+	X(void, ClearColor, (GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha), (red, green, blue, alpha)) \
+	X(GLenum, ClientWaitSync, (GLsync sync, GLbitfield flags, GLuint64 timeout), (sync, flags, timeout)) \
+	X(void, ColorMask, (GLboolean red, GLboolean green, GLboolean blue, GLboolean alpha), (red, green, blue, alpha)) \
+	X(void, CompileShader, (GLuint shader), (shader)) \
+	X(GLuint, CreateProgram, (), ()) \
+	X(GLuint, CreateShader, (GLenum type), (type)) \
+	X(void, DeleteBuffers, (GLsizei n, const GLuint* buffers), (n, buffers)) \
+	X(void, DeleteFramebuffers, (GLsizei n, const GLuint* framebuffers), (n, framebuffers)) \
+	X(void, DeleteProgram, (GLuint program), (program)) \
+	X(void, DeleteQueries, (GLsizei n, const GLuint* ids), (n, ids)) \
+	X(void, DeleteShader, (GLuint shader), (shader)) \
+	X(void, DeleteSync, (GLsync sync), (sync)) \
+	X(void, DeleteTextures, (GLsizei n, const GLuint* textures), (n, textures)) \
+	X(void, DeleteVertexArrays, (GLsizei n, const GLuint* arrays), (n, arrays)) \
+	X(void, DepthFunc, (GLenum func), (func)) \
+	X(void, DepthMask, (GLboolean flag), (flag)) \
+	X(void, DetachShader, (GLuint program, GLuint shader), (program, shader)) \
+	X(void, Disable, (GLenum cap), (cap)) \
+	X(void, DispatchCompute, (GLuint num_groups_x, GLuint num_groups_y, GLuint num_groups_z), (num_groups_x, num_groups_y, num_groups_z)) \
+	X(void, DrawArrays, (GLenum mode, GLint first, GLsizei count), (mode, first, count)) \
+	X(void, DrawBuffers, (GLsizei n, const GLenum* bufs), (n, bufs)) \
+	X(void, DrawElements, (GLenum mode, GLsizei count, GLenum type, const void* indices), (mode, count, type, indices)) \
+	X(void, DrawElementsIndirect, (GLenum mode, GLenum type, const void* indirect), (mode, type, indirect)) \
+	X(void, Enable, (GLenum cap), (cap)) \
+	X(void, EnableVertexAttribArray, (GLuint index), (index)) \
+	X(void, EndQuery, (GLenum target), (target)) \
+	X(GLsync, FenceSync, (GLenum condition, GLbitfield flags), (condition, flags)) \
+	X(void, Finish, (), ()) \
+	X(void, FramebufferTexture2D, (GLenum target, GLenum attachment, GLenum textarget, GLuint texture, GLint level), (target, attachment, textarget, texture, level)) \
+	X(void, GenBuffers, (GLsizei n, GLuint* buffers), (n, buffers)) \
+	X(void, GenFramebuffers, (GLsizei n, GLuint* framebuffers), (n, framebuffers)) \
+	X(void, GenQueries, (GLsizei n, GLuint* ids), (n, ids)) \
+	X(void, GenTextures, (GLsizei n, GLuint* textures), (n, textures)) \
+	X(void, GenVertexArrays, (GLsizei n, GLuint* arrays), (n, arrays)) \
+	X(void, GenerateMipmap, (GLenum target), (target)) \
+	X(void, GetInteger64v, (GLenum pname, GLint64* data), (pname, data)) \
+	X(void, GetIntegerv, (GLenum pname, GLint* data), (pname, data)) \
+	X(void, GetProgramInfoLog, (GLuint program, GLsizei bufSize, GLsizei* length, GLchar* infoLog), (program, bufSize, length, infoLog)) \
+	X(void, GetProgramiv, (GLuint program, GLenum pname, GLint* params), (program, pname, params)) \
+	X(void, GetQueryObjectiv, (GLuint id, GLenum pname, GLint* params), (id, pname, params)) \
+	X(void, GetQueryObjectui64v, (GLuint id, GLenum pname, GLuint64* params), (id, pname, params)) \
+	X(void, GetQueryObjectuiv, (GLuint id, GLenum pname, GLuint* params), (id, pname, params)) \
+	X(void, GetShaderInfoLog, (GLuint shader, GLsizei bufSize, GLsizei* length, GLchar* infoLog), (shader, bufSize, length, infoLog)) \
+	X(void, GetShaderiv, (GLuint shader, GLenum pname, GLint* params), (shader, pname, params)) \
+	X(const GLubyte*, GetString, (GLenum name), (name)) \
+	X(const GLubyte*, GetStringi, (GLenum name, GLuint index), (name, index)) \
+	X(GLint, GetUniformLocation, (GLuint program, const GLchar* name), (program, name)) \
+	X(void, LinkProgram, (GLuint program), (program)) \
+	X(void*, MapBufferRange, (GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access), (target, offset, length, access)) \
+	X(void, MemoryBarrier, (GLbitfield barriers), (barriers)) \
+	X(void, MultiDrawElementsIndirectCount, (GLenum mode, GLenum type, const void* indirect, GLintptr drawcount, GLsizei maxdrawcount, GLsizei stride), (mode, type, indirect, drawcount, maxdrawcount, stride)) \
+	X(void, PixelStorei, (GLenum pname, GLint param), (pname, param)) \
+	X(void, PolygonOffset, (GLfloat factor, GLfloat units), (factor, units)) \
+	X(void, QueryCounter, (GLuint id, GLenum target), (id, target)) \
+	X(void, ReadBuffer, (GLenum src), (src)) \
+	X(void, ReadPixels, (GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type, void* pixels), (x, y, width, height, format, type, pixels)) \
+	X(void, Scissor, (GLint x, GLint y, GLsizei width, GLsizei height), (x, y, width, height)) \
+	X(void, ShaderSource, (GLuint shader, GLsizei count, const GLchar* const* string, const GLint* length), (shader, count, string, length)) \
+	X(void, TexImage2D, (GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type, const void* pixels), (target, level, internalformat, width, height, border, format, type, pixels)) \
+	X(void, TexParameteri, (GLenum target, GLenum pname, GLint param), (target, pname, param)) \
+	X(void, TexStorage2D, (GLenum target, GLsizei levels, GLenum internalformat, GLsizei width, GLsizei height), (target, levels, internalformat, width, height)) \
+	X(void, Uniform1f, (GLint location, GLfloat v0), (location, v0)) \
+	X(void, Uniform1i, (GLint location, GLint v0), (location, v0)) \
+	X(void, Uniform1ui, (GLint location, GLuint v0), (location, v0)) \
+	X(void, Uniform2i, (GLint location, GLint v0, GLint v1), (location, v0, v1)) \
+	X(void, Uniform2f, (GLint location, GLfloat v0, GLfloat v1), (location, v0, v1)) \
+	X(void, Uniform2fv, (GLint location, GLsizei count, const GLfloat* value), (location, count, value)) \
+	X(void, Uniform3f, (GLint location, GLfloat v0, GLfloat v1, GLfloat v2), (location, v0, v1, v2)) \
+	X(void, Uniform3fv, (GLint location, GLsizei count, const GLfloat* value), (location, count, value)) \
+	X(void, Uniform4f, (GLint location, GLfloat v0, GLfloat v1, GLfloat v2, GLfloat v3), (location, v0, v1, v2, v3)) \
+	X(void, Uniform4fv, (GLint location, GLsizei count, const GLfloat* value), (location, count, value)) \
+	X(void, UniformMatrix2fv, (GLint location, GLsizei count, GLboolean transpose, const GLfloat* value), (location, count, transpose, value)) \
+	X(void, UniformMatrix3fv, (GLint location, GLsizei count, GLboolean transpose, const GLfloat* value), (location, count, transpose, value)) \
+	X(void, UniformMatrix4fv, (GLint location, GLsizei count, GLboolean transpose, const GLfloat* value), (location, count, transpose, value)) \
+	X(GLboolean, UnmapBuffer, (GLenum target), (target)) \
+	X(void, UseProgram, (GLuint program), (program)) \
+	X(void, VertexAttribDivisor, (GLuint index, GLuint divisor), (index, divisor)) \
+	X(void, VertexAttribPointer, (GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const void* pointer), (index, size, type, normalized, stride, pointer)) \
+	X(void, Viewport, (GLint x, GLint y, GLsizei width, GLsizei height), (x, y, width, height))
+
+// one function pointer per entry point, reached through the usual gl names
+#define GL_LOADER_DECLARE(ret, name, params, args) \
+	typedef ret (GL_LOADER_APIENTRY* PFNGL_LOADER_##name) params; \
+	extern PFNGL_LOADER_##name gl_loader_##name;
+GL_LOADER_FUNCTIONS(GL_LOADER_DECLARE)
+#undef GL_LOADER_DECLARE
+
+#define glActiveTexture gl_loader_ActiveTexture
+#define glAttachShader gl_loader_AttachShader
+#define glBeginQuery gl_loader_BeginQuery
+#define glBindBuffer gl_loader_BindBuffer
+#define glBindBufferBase gl_loader_BindBufferBase
+#define glBindBufferRange gl_loader_BindBufferRange
+#define glBindFramebuffer gl_loader_BindFramebuffer
+#define glBindTexture gl_loader_BindTexture
+#define glBindVertexArray gl_loader_BindVertexArray
+#define glBlendFunc gl_loader_BlendFunc
+#define glBlitFramebuffer gl_loader_BlitFramebuffer
+#define glBufferData gl_loader_BufferData
+#define glBufferStorage gl_loader_BufferStorage
+#define glBufferSubData gl_loader_BufferSubData
+#define glClear gl_loader_Clear
+#define glClearBufferData gl_loader_ClearBufferData
+#define glClearColor gl_loader_ClearColor
+#define glClientWaitSync gl_loader_ClientWaitSync
+#define glColorMask gl_loader_ColorMask
+#define glCompileShader gl_loader_CompileShader
+#define glCreateProgram gl_loader_CreateProgram
+#define glCreateShader gl_loader_CreateShader
+#define glDeleteBuffers gl_loader_DeleteBuffers
+#define glDeleteFramebuffers gl_loader_DeleteFramebuffers
+#define glDeleteProgram gl_loader_DeleteProgram
+#define glDeleteQueries gl_loader_DeleteQueries
+#define glDeleteShader gl_loader_DeleteShader
+#define glDeleteSync gl_loader_DeleteSync
+#define glDeleteTextures gl_loader_DeleteTextures
+#define glDeleteVertexArrays gl_loader_DeleteVertexArrays
+#define glDepthFunc gl_loader_DepthFunc
+#define glDepthMask gl_loader_DepthMask
+#define glDetachShader gl_loader_DetachShader
+#define glDisable gl_loader_Disable
+#define glDispatchCompute gl_loader_DispatchCompute
+#define glDrawArrays gl_loader_DrawArrays
+#define glDrawBuffers gl_loader_DrawBuffers
+#define glDrawElements gl_loader_DrawElements
+#define glDrawElementsIndirect gl_loader_DrawElementsIndirect
+#define glEnable gl_loader_Enable
+#define glEnableVertexAttribArray gl_loader_EnableVertexAttribArray
+#define glEndQuery gl_loader_EndQuery
+#define glFenceSync gl_loader_FenceSync
+#define glFinish gl_loader_Finish
+#define glFramebufferTexture2D gl_loader_FramebufferTexture2D
+#define glGenBuffers gl_loader_GenBuffers
+#define glGenFramebuffers gl_loader_GenFramebuffers
+#define glGenQueries gl_loader_GenQueries
+#define glGenTextures gl_loader_GenTextures
+#define glGenVertexArrays gl_loader_GenVertexArrays
+#define glGenerateMipmap gl_loader_GenerateMipmap
+#define glGetInteger64v gl_loader_GetInteger64v
+#define glGetIntegerv gl_loader_GetIntegerv
+#define glGetProgramInfoLog gl_loader_GetProgramInfoLog
+#define glGetProgramiv gl_loader_GetProgramiv
+#define glGetQueryObjectiv gl_loader_GetQueryObjectiv
+#define glGetQueryObjectui64v gl_loader_GetQueryObjectui64v
+#define glGetQueryObjectuiv gl_loader_GetQueryObjectuiv
+#define glGetShaderInfoLog gl_loader_GetShaderInfoLog
+#define glGetShaderiv gl_loader_GetShaderiv
+#define glGetString gl_loader_GetString
+#define glGetStringi gl_loader_GetStringi
+#define glGetUniformLocation gl_loader_GetUniformLocation
+#define glLinkProgram gl_loader_LinkProgram
+#define glMapBufferRange gl_loader_MapBufferRange
+#define glMemoryBarrier gl_loader_MemoryBarrier
+#define glMultiDrawElementsIndirectCount gl_loader_MultiDrawElementsIndirectCount
+#define glPixelStorei gl_loader_PixelStorei
+#define glPolygonOffset gl_loader_PolygonOffset
+#define glQueryCounter gl_loader_QueryCounter
+#define glReadBuffer gl_loader_ReadBuffer
+#define glReadPixels gl_loader_ReadPixels
+#define glScissor gl_loader_Scissor
+#define glShaderSource gl_loader_ShaderSource
+#define glTexImage2D gl_loader_TexImage2D
+#define glTexParameteri gl_loader_TexParameteri
+#define glTexStorage2D gl_loader_TexStorage2D
+#define glUniform1f gl_loader_Uniform1f
+#define glUniform1i gl_loader_Uniform1i
+#define glUniform1ui gl_loader_Uniform1ui
+#define glUniform2i gl_loader_Uniform2i
+#define glUniform2f gl_loader_Uniform2f
+#define glUniform2fv gl_loader_Uniform2fv
+#define glUniform3f gl_loader_Uniform3f
+#define glUniform3fv gl_loader_Uniform3fv
+#define glUniform4f gl_loader_Uniform4f
+#define glUniform4fv gl_loader_Uniform4fv
+#define glUniformMatrix2fv gl_loader_UniformMatrix2fv
+#define glUniformMatrix3fv gl_loader_UniformMatrix3fv
+#define glUniformMatrix4fv gl_loader_UniformMatrix4fv
+#define glUnmapBuffer gl_loader_UnmapBuffer
+#define glUseProgram gl_loader_UseProgram
+#define glVertexAttribDivisor gl_loader_VertexAttribDivisor
+#define glVertexAttribPointer gl_loader_VertexAttribPointer
+#define glViewport gl_loader_Viewport
+
+class GLLoader
+{
+public:
+	// returns the address of a GL function by name, e.g. glfwGetProcAddress
+	typedef void* (*ProcAddressFunction)(const char* name);
+
+	// call once the context is current: remembers how to look functions up and checks that the context
+	// is new enough, reporting the version it got
+	static bool Init(ProcAddressFunction getProcAddress, int requiredMajor, int requiredMinor);
+
+	// whether the context is at least the given version (valid after Init)
+	static bool HasVersion(int major, int minor);
+
+	// whether the context advertises the extension, e.g. "GL_ARB_indirect_parameters"
+	static bool HasExtension(const char* name);
+
+	// entry points looked up so far
+	static int ResolvedCount();
+
+	// looks up one entry point; a missing one is fatal, the renderer can't run without it
+	static void* Resolve(const char* name);
+};
+#endif
@@ -0,0 +1,334 @@
+#ifndef GLSTATS_H
+#define GLSTATS_H
+
+#include "gl_loader.h"
+
+#include <cstdio>
+#include <cstring>
+
+// What the GL calls of one frame cost
+struct GLCounters {
+	unsigned int DrawCalls;
+	unsigned long long Vertices;     // vertices or indices submitted, times instances
+	unsigned long long Triangles;
+	unsigned int ProgramBinds;
+	unsigned int VertexArrayBinds;
+	unsigned int TextureBinds;
+	unsigned int UniformUploads;
+	unsigned int BufferUploads;      // buffer and texture data uploads
+	unsigned long long UploadBytes;
+
+	// binds that change pipeline state
+	unsigned int StateChanges() const
+	{
+		return ProgramBinds + VertexArrayBinds + TextureBinds;
+	}
+};
+
+// Counting wrappers around the GL calls the renderer uses. They forward to GL unchanged and bump the
+// current frame's counters; EndFrame moves them to Last() and starts over. GL thread only.
+class GLStats
+{
+public:
+	static GLCounters& Current()
+	{
+		static GLCounters counters = GLCounters();
+		return counters;
+	}
+
+	// counters of the last finished frame
+	static GLCounters& Last()
+	{
+		static GLCounters counters = GLCounters();
+		return counters;
+	}
+
+	static void EndFrame()
+	{
+		Last() = Current();
+		Current() = GLCounters();
+	}
+
+	static void UseProgram(GLuint program)
+	{
+		Current().ProgramBinds++;
+		glUseProgram(program);
+	}
+
+	static void BindVertexArray(GLuint vao)
+	{
+		Current().VertexArrayBinds++;
+		glBindVertexArray(vao);
+	}
+
+	static void BindTexture(GLenum target, GLuint texture)
+	{
+		Current().TextureBinds++;
+		glBindTexture(target, texture);
+	}
+
+	static void Uniform1i(GLint location, GLint x) { Current().UniformUploads++; glUniform1i(location, x); }
+	static void Uniform1ui(GLint location, GLuint x) { Current().UniformUploads++; glUniform1ui(location, x); }
+	static void Uniform1f(GLint location, GLfloat x) { Current().UniformUploads++; glUniform1f(location, x); }
+	static void Uniform2i(GLint location, GLint x, GLint y) { Current().UniformUploads++; glUniform2i(location, x, y); }
+	static void Uniform2f(GLint location, GLfloat x, GLfloat y) { Current().UniformUploads++; glUniform2f(location, x, y); }
+	static void Uniform2fv(GLint location, GLsizei count, const GLfloat* value) { Current().UniformUploads++; glUniform2fv(location, count, value); }
+	static void Uniform3f(GLint location, GLfloat x, GLfloat y, GLfloat z) { Current().UniformUploads++; glUniform3f(location, x, y, z); }
+	static void Uniform3fv(GLint location, GLsizei count, const GLfloat* value) { Current().UniformUploads++; glUniform3fv(location, count, value); }
+	static void Uniform4f(GLint location, GLfloat x, GLfloat y, GLfloat z, GLfloat w) { Current().UniformUploads++; glUniform4f(location, x, y, z, w); }
+	static void Uniform4fv(GLint location, GLsizei count, const GLfloat* value) { Current().UniformUploads++; glUniform4fv(location, count, value); }
+	static void UniformMatrix2fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat* value) { Current().UniformUploads++; glUniformMatrix2fv(location, count, transpose, value); }
+	static void UniformMatrix3fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat* value) { Current().UniformUploads++; glUniformMatrix3fv(location, count, transpose, value); }
+	static void UniformMatrix4fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat* value) { Current().UniformUploads++; glUniformMatrix4fv(location, count, transpose, value); }
+
+	static void BufferData(GLenum target, GLsizeiptr size, const void* data, GLenum usage)
+	{
+		countUpload(data ? (unsigned long long)size : 0);
+		glBufferData(target, size, data, usage);
+	}
+
+	static void BufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const void* data)
+	{
+		countUpload((unsigned long long)size);
+		glBufferSubData(target, offset, size, data);
+	}
+
+	static void TexImage2D(GLenum target, GLint level, GLint internalFormat, GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type, const void* pixels)
+	{
+		// only 8 bit formats are ever uploaded with data; storage-only calls pass no pixels
+		unsigned long long channels = format == GL_RGBA ? 4 : (format == GL_RGB ? 3 : (format == GL_RG ? 2 : 1));
+		countUpload(pixels && type == GL_UNSIGNED_BYTE ? (unsigned long long)width * height * channels : 0);
+		glTexImage2D(target, level, internalFormat, width, height, border, format, type, pixels);
+	}
+
+	static void DrawArrays(GLenum mode, GLint first, GLsizei count)
+	{
+		countDraw(mode, count, 1);
+		glDrawArrays(mode, first, count);
+	}
+
+	static void DrawElements(GLenum mode, GLsizei count, GLenum type, const void* indices)
+	{
+		countDraw(mode, count, 1);
+		glDrawElements(mode, count, type, indices);
+	}
+
+	// indirect draws read their counts from a GPU buffer, so the caller passes the values it wrote there
+	static void DrawElementsIndirect(GLenum mode, GLenum type, const void* indirect, GLuint count, GLuint instanceCount)
+	{
+		countDraw(mode, count, instanceCount);
+		glDrawElementsIndirect(mode, type, indirect);
+	}
+
+	// the draw count and the commands are written on the GPU, so only the call itself is counted
+	static void MultiDrawElementsIndirectCount(GLenum mode, GLenum type, const void* indirect, GLintptr drawCount, GLsizei maxDrawCount, GLsizei stride)
+	{
+		Current().DrawCalls++;
+		glMultiDrawElementsIndirectCount(mode, type, indirect, drawCount, maxDrawCount, stride);
+	}
+
+private:
+	static void countDraw(GLenum mode, GLsizei count, GLuint instances)
+	{
+		GLCounters& counters = Current();
+		counters.DrawCalls++;
+		counters.Vertices += (unsigned long long)count * instances;
+		if (mode == GL_TRIANGLES)
+			counters.Triangles += (unsigned long long)(count / 3) * instances;
+		else if ((mode == GL_TRIANGLE_STRIP || mode == GL_TRIANGLE_FAN) && count > 2)
+			counters.Triangles += (unsigned long long)(count - 2) * instances;
+	}
+
+	static void countUpload(unsigned long long bytes)
+	{
+		Current().BufferUploads++;
+		Current().UploadBytes += bytes;
+	}
+};
+
+// Counts the fragments passing the depth test between Begin and End (a GL_SAMPLES_PASSED query) and reads
+// the count back a few frames later, once the GPU has it, so the CPU never waits. It can't overlap another
+// occlusion query.
+class FragmentCounter
+{
+public:
+	static const int LATENCY = 4;
+
+	FragmentCounter() : next(0)
+	{
+		for (int i = 0; i < LATENCY; i++)
+		{
+			queries[i] = 0;
+			pending[i] = false;
+		}
+	}
+
+	void Init()
+	{
+		glGenQueries(LATENCY, queries);
+	}
+
+	void Destroy()
+	{
+		glDeleteQueries(LATENCY, queries);
+	}
+
+	// reads the oldest outstanding count when it is available; call before Begin, which reuses its query
+	bool Resolve(GLuint64& fragments)
+	{
+		if (!pending[next])
+			return false;
+		GLuint available = 0;
+		glGetQueryObjectuiv(queries[next], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available)
+			return false;
+		glGetQueryObjectui64v(queries[next], GL_QUERY_RESULT, &fragments);
+		pending[next] = false;
+		return true;
+	}
+
+	// false while the query Begin would reuse still holds an unread count (the GPU is more than LATENCY frames
+	// behind); skip Begin and End then, or that count is lost and the ring falls out of step
+	bool Ready() const
+	{
+		return !pending[next];
+	}
+
+	void Begin()
+	{
+		glBeginQuery(GL_SAMPLES_PASSED, queries[next]);
+	}
+
+	void End()
+	{
+		glEndQuery(GL_SAMPLES_PASSED);
+		pending[next] = true;
+		next = (next + 1) % LATENCY;
+	}
+
+private:
+	GLuint queries[LATENCY];
+	bool pending[LATENCY];
+	int next;
+};
+
+// GPU time between Begin and End (two GL_TIMESTAMP queries, so it nests with the profiler's scopes), read
+// back a few frames later like FragmentCounter
+class GpuFrameTimer
+{
+public:
+	static const int LATENCY = 4;
+
+	GpuFrameTimer() : next(0)
+	{
+		for (int i = 0; i < LATENCY; i++)
+			pending[i] = false;
+	}
+
+	void Init()
+	{
+		glGenQueries(LATENCY * 2, queries);
+	}
+
+	void Destroy()
+	{
+		glDeleteQueries(LATENCY * 2, queries);
+	}
+
+	// reads the oldest outstanding time when it is available; call before Begin, which reuses its queries
+	bool Resolve(double& milliseconds)
+	{
+		if (!pending[next])
+			return false;
+		GLuint available = 0;
+		glGetQueryObjectuiv(queries[next * 2 + 1], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available)
+			return false;
+		GLuint64 begin = 0, end = 0;
+		glGetQueryObjectui64v(queries[next * 2], GL_QUERY_RESULT, &begin);
+		glGetQueryObjectui64v(queries[next * 2 + 1], GL_QUERY_RESULT, &end);
+		milliseconds = (end - begin) / 1e6;
+		pending[next] = false;
+		return true;
+	}
+
+	// false while the queries Begin would reuse still hold an unread time; skip Begin and End then
+	bool Ready() const
+	{
+		return !pending[next];
+	}
+
+	void Begin()
+	{
+		glQueryCounter(queries[next * 2], GL_TIMESTAMP);
+	}
+
+	void End()
+	{
+		glQueryCounter(queries[next * 2 + 1], GL_TIMESTAMP);
+		pending[next] = true;
+		next = (next + 1) % LATENCY;
+	}
+
+private:
+	GLuint queries[LATENCY * 2];
+	bool pending[LATENCY];
+	int next;
+};
+
+// Per-frame counter log for tooling: CSV with a header row, or JSON lines (one object per frame) when the
+// file name ends in .json
+class StatsLog
+{
+public:
+	StatsLog() : file(nullptr), json(false)
+	{
+	}
+
+	~StatsLog()
+	{
+		Close();
+	}
+
+	bool Open(const char* path)
+	{
+		Close();
+		file = fopen(path, "w");
+		if (!file)
+			return false;
+		size_t length = strlen(path);
+		json = length >= 5 && strcmp(path + length - 5, ".json") == 0;
+		if (!json)
+			fprintf(file, "frame,ms,draws,vertices,triangles,program_binds,vao_binds,texture_binds,state_changes,uniforms,uploads,upload_bytes\n");
+		return true;
+	}
+
+	bool IsOpen() const
+	{
+		return file != nullptr;
+	}
+
+	void Write(unsigned long long frame, double milliseconds, const GLCounters& counters)
+	{
+		if (!file)
+			return;
+		const char* format = json
+			? "{\"frame\":%llu,\"ms\":%.3f,\"draws\":%u,\"vertices\":%llu,\"triangles\":%llu,\"program_binds\":%u,\"vao_binds\":%u,\"texture_binds\":%u,\"state_changes\":%u,\"uniforms\":%u,\"uploads\":%u,\"upload_bytes\":%llu}\n"
+			: "%llu,%.3f,%u,%llu,%llu,%u,%u,%u,%u,%u,%u,%llu\n";
+		fprintf(file, format, frame, milliseconds, counters.DrawCalls, counters.Vertices, counters.Triangles,
+			counters.ProgramBinds, counters.VertexArrayBinds, counters.TextureBinds, counters.StateChanges(),
+			counters.UniformUploads, counters.BufferUploads, counters.UploadBytes);
+	}
+
+	void Close()
+	{
+		if (file)
+			fclose(file);
+		file = nullptr;
+	}
+
+private:
+	FILE* file;
+	bool json;
+};
+#endif
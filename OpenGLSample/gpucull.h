@@ -0,0 +1,174 @@
+#ifndef GPUCULL_H
+#define GPUCULL_H
+
+#include "gl_loader.h"
+
+#include <glm/glm.hpp>
+
+#include "bounds.h"
+#include "glstats.h"
+#include "hiz.h"
+#include "lod.h"
+
+#include <vector>
+
+// One object as the cull shader reads it (std430 layout)
+struct GpuCullObject {
+	glm::vec3 BoundsMin;                    // model space bounds
+	GLuint Node;                            // instance matrix index, relative to the frame's instance base
+	glm::vec3 BoundsMax;
+	GLuint Batch;
+	GLuint FirstIndex[MAX_LOD_LEVELS];      // index range of each detail level
+	GLuint IndexCount[MAX_LOD_LEVELS];
+	GLuint LevelCount;
+	GLuint CommandBase;                     // first command slot of the batch, filled in by Upload
+	GLuint Padding[2];
+};
+
+// Objects sharing a vertex array and texture; their commands are drawn with one call
+struct GpuCullBatch {
+	GLuint Vao;
+	GLuint Texture;
+	GLuint CommandBase;
+	GLuint Capacity;                        // objects in the batch, the most commands it can get
+};
+
+// GPU driven submission: a compute pass frustum culls every object, picks its detail level and appends a
+// DrawElementsIndirectCommand to its batch's range, counting the commands per batch. Each batch is then drawn
+// with one glMultiDrawElementsIndirectCount, so the CPU issues the same few calls however many objects there
+// are. Needs GL 4.6 or GL_ARB_indirect_parameters.
+class GpuCuller
+{
+public:
+	static const int GROUP_SIZE = 64;
+
+	// filled by the caller, then sent to the GPU with Upload
+	std::vector<GpuCullObject> Objects;
+	std::vector<GpuCullBatch> Batches;
+
+	GpuCuller() : program(0), objectBuffer(0), commandBuffer(0), countBuffer(0), commandCount(0)
+	{
+	}
+
+	// the program is the cull compute shader; returns false when the context can't draw with a GPU count
+	bool Init(GLuint cullProgram)
+	{
+		if (!GLLoader::HasVersion(4, 6))
+		{
+			if (!GLLoader::HasExtension("GL_ARB_indirect_parameters"))
+				return false;
+			// same entry point before it became core
+			gl_loader_MultiDrawElementsIndirectCount = (PFNGL_LOADER_MultiDrawElementsIndirectCount)GLLoader::Resolve("glMultiDrawElementsIndirectCountARB");
+		}
+		program = cullProgram;
+		objectCountLoc = glGetUniformLocation(program, "objectCount");
+		instanceBaseLoc = glGetUniformLocation(program, "instanceBase");
+		frustumPlanesLoc = glGetUniformLocation(program, "frustumPlanes");
+		cameraPositionLoc = glGetUniformLocation(program, "cameraPosition");
+		lodProjectionLoc = glGetUniformLocation(program, "lodProjection");
+		lodThresholdsLoc = glGetUniformLocation(program, "lodThresholds");
+		glGenBuffers(1, &objectBuffer);
+		glGenBuffers(1, &commandBuffer);
+		glGenBuffers(1, &countBuffer);
+		return true;
+	}
+
+	void Destroy()
+	{
+		glDeleteBuffers(1, &objectBuffer);
+		glDeleteBuffers(1, &commandBuffer);
+		glDeleteBuffers(1, &countBuffer);
+	}
+
+	// adds a batch and returns its index
+	int AddBatch(GLuint vao, GLuint texture)
+	{
+		GpuCullBatch batch = { vao, texture, 0, 0 };
+		Batches.push_back(batch);
+		return (int)Batches.size() - 1;
+	}
+
+	// lays the batches' command ranges out and uploads the objects; call again after changing them
+	void Upload()
+	{
+		commandCount = 0;
+		for (size_t i = 0; i < Batches.size(); i++)
+			Batches[i].Capacity = 0;
+		for (size_t i = 0; i < Objects.size(); i++)
+			Batches[Objects[i].Batch].Capacity++;
+		for (size_t i = 0; i < Batches.size(); i++)
+		{
+			Batches[i].CommandBase = commandCount;
+			commandCount += Batches[i].Capacity;
+		}
+		for (size_t i = 0; i < Objects.size(); i++)
+			Objects[i].CommandBase = Batches[Objects[i].Batch].CommandBase;
+
+		if (Objects.empty())
+			return;
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, objectBuffer);
+		GLStats::BufferData(GL_SHADER_STORAGE_BUFFER, Objects.size() * sizeof(GpuCullObject), &Objects[0], GL_STATIC_DRAW);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, commandBuffer);
+		GLStats::BufferData(GL_SHADER_STORAGE_BUFFER, commandCount * sizeof(DrawElementsIndirectCommand), NULL, GL_DYNAMIC_COPY);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, countBuffer);
+		GLStats::BufferData(GL_SHADER_STORAGE_BUFFER, Batches.size() * sizeof(GLuint), NULL, GL_DYNAMIC_COPY);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	}
+
+	// runs the cull pass. Instance matrices are read from instanceBuffer at instanceBase + node, and commands
+	// reference them with that base instance. lodProjection is (tan(fovy / 2), 0) in perspective and
+	// (0, ortho half height) in orthographic views; lodThresholds are the LodSelector thresholds.
+	void Cull(const Frustum& frustum, glm::vec3 cameraPosition, glm::vec2 lodProjection, const float* lodThresholds, GLuint instanceBuffer, GLuint instanceBase)
+	{
+		if (Objects.empty())
+			return;
+		const GLuint zero = 0;
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, countBuffer);
+		glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+		GLStats::UseProgram(program);
+		GLStats::Uniform1ui(objectCountLoc, (GLuint)Objects.size());
+		GLStats::Uniform1ui(instanceBaseLoc, instanceBase);
+		GLStats::Uniform4fv(frustumPlanesLoc, 6, &frustum.Planes[0].x);
+		GLStats::Uniform3f(cameraPositionLoc, cameraPosition.x, cameraPosition.y, cameraPosition.z);
+		GLStats::Uniform2f(lodProjectionLoc, lodProjection.x, lodProjection.y);
+		GLStats::Uniform3fv(lodThresholdsLoc, 1, lodThresholds);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, objectBuffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, instanceBuffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, commandBuffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, countBuffer);
+		glDispatchCompute((GLuint)(Objects.size() + GROUP_SIZE - 1) / GROUP_SIZE, 1, 1);
+		// the draws read the commands and counts as indirect parameters
+		glMemoryBarrier(GL_COMMAND_BARRIER_BIT);
+	}
+
+	// draws every batch with the commands Cull wrote; binds each batch's vertex array and texture on the
+	// active texture unit, with the caller's program
+	void Draw()
+	{
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+		glBindBuffer(GL_PARAMETER_BUFFER, countBuffer);
+		for (size_t i = 0; i < Batches.size(); i++)
+		{
+			const GpuCullBatch& batch = Batches[i];
+			if (batch.Capacity == 0)
+				continue;
+			GLStats::BindVertexArray(batch.Vao);
+			GLStats::BindTexture(GL_TEXTURE_2D, batch.Texture);
+			GLStats::MultiDrawElementsIndirectCount(GL_TRIANGLES, GL_UNSIGNED_INT, (const void*)(batch.CommandBase * sizeof(DrawElementsIndirectCommand)),
+				(GLintptr)(i * sizeof(GLuint)), (GLsizei)batch.Capacity, sizeof(DrawElementsIndirectCommand));
+		}
+		glBindBuffer(GL_PARAMETER_BUFFER, 0);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	}
+
+private:
+	GLuint program;
+	GLint objectCountLoc, instanceBaseLoc, frustumPlanesLoc, cameraPositionLoc, lodProjectionLoc, lodThresholdsLoc;
+	GLuint objectBuffer;    // GpuCullObject per object
+	GLuint commandBuffer;   // command ranges of the batches, written by the cull pass
+	GLuint countBuffer;     // commands written per batch
+	GLuint commandCount;
+};
+#endif
@@ -0,0 +1,301 @@
+#ifndef HIZ_H
+#define HIZ_H
+
+#include "gl_loader.h"
+
+#include <glm/glm.hpp>
+
+#include "bounds.h"
+#include "framebuffers.h"
+#include "glstats.h"
+
+#include <cstring>
+#include <vector>
+
+// Layout of one glDrawElementsIndirect command, as defined by the GL spec
+struct DrawElementsIndirectCommand {
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex;
+	GLint baseVertex;
+	GLuint baseInstance;
+};
+
+// Hierarchical depth buffer built from the previous frame's depth.
+// Each pyramid level stores the farthest depth of the 2x2 texels below it, so a box whose nearest point is
+// behind the stored depth over its whole screen footprint is guaranteed hidden. One coarse level is read
+// back asynchronously through a pixel buffer and tested on the CPU, so testing an object costs a few texel
+// reads instead of a GPU query round trip. The textures come from the framebuffer manager at the size class of
+// the rendered size and the pyramid is built from their lower left, so a render scale step reuses them.
+class HiZBuffer
+{
+public:
+	// the coarsest level no wider than this is read back for CPU tests
+	static const int READBACK_WIDTH = 128;
+	// boxes covering more readback texels than this are assumed visible (they are large on screen anyway)
+	static const int MAX_TEST_TEXELS = 256;
+
+	HiZBuffer() : framebuffers(nullptr), width(0), height(0), depthTexture(0), pyramidTexture(0), depthFbo(0), pyramidFbo(0), emptyVao(0),
+		levelCount(0), pixelBuffer(0), fence(0), hasDepths(false)
+	{
+	}
+
+	// the program draws a fullscreen triangle from gl_VertexID and takes a sampler2D "depthLevel", an int
+	// "sourceLevel" and an ivec2 "sourceSize" (the texels of that level that hold depth)
+	void Init(GLuint downsampleProgram, FramebufferManager& framebufferManager)
+	{
+		program = downsampleProgram;
+		framebuffers = &framebufferManager;
+		depthLevelLoc = glGetUniformLocation(program, "depthLevel");
+		sourceLevelLoc = glGetUniformLocation(program, "sourceLevel");
+		sourceSizeLoc = glGetUniformLocation(program, "sourceSize");
+		glGenVertexArrays(1, &emptyVao);
+		glGenFramebuffers(1, &depthFbo);
+		glGenFramebuffers(1, &pyramidFbo);
+		glGenBuffers(1, &pixelBuffer);
+	}
+
+	void Destroy()
+	{
+		release();
+		glDeleteVertexArrays(1, &emptyVao);
+		glDeleteFramebuffers(1, &depthFbo);
+		glDeleteFramebuffers(1, &pyramidFbo);
+		glDeleteBuffers(1, &pixelBuffer);
+	}
+
+	// copies the depth of the frame just rendered (the lower left framebufferWidth x framebufferHeight of the
+	// source framebuffer), builds the pyramid and starts reading back the coarse level. Call after all geometry
+	// is drawn; restores the source framebuffer and that viewport.
+	void Build(int framebufferWidth, int framebufferHeight, const glm::mat4& viewProjection, GLuint source)
+	{
+		if (framebufferWidth <= 1 || framebufferHeight <= 1)
+			return;
+		if (FramebufferManager::SizeClass(framebufferWidth) != width || FramebufferManager::SizeClass(framebufferHeight) != height)
+			allocate(framebufferWidth, framebufferHeight);
+
+		// a copy is still in flight; keep testing against the older one rather than stall
+		if (fence != 0)
+			return;
+
+		// each level covers the one below rounded up, so the readback texel of a pixel is its coordinate
+		// shifted right once per level
+		glm::ivec2 levelSizes[MAX_LEVELS];
+		levelSizes[0] = glm::ivec2((framebufferWidth + 1) / 2, (framebufferHeight + 1) / 2);
+		for (int level = 1; level < levelCount; level++)
+			levelSizes[level] = glm::ivec2((levelSizes[level - 1].x + 1) / 2, (levelSizes[level - 1].y + 1) / 2);
+
+		// 1. copy the source's depth (GLFW default 24 bit depth + 8 bit stencil, the copy matches it)
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, source);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, depthFbo);
+		glBlitFramebuffer(0, 0, framebufferWidth, framebufferHeight, 0, 0, framebufferWidth, framebufferHeight, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+
+		// 2. reduce level by level with a max filter
+		glDisable(GL_DEPTH_TEST);
+		glDepthMask(GL_FALSE);
+		GLStats::UseProgram(program);
+		GLStats::BindVertexArray(emptyVao);
+		glActiveTexture(GL_TEXTURE0);
+		GLStats::Uniform1i(depthLevelLoc, 0);
+		glBindFramebuffer(GL_FRAMEBUFFER, pyramidFbo);
+		GLStats::Uniform1i(sourceLevelLoc, 0);
+		for (int level = 0; level < levelCount; level++)
+		{
+			if (level == 0)
+			{
+				GLStats::BindTexture(GL_TEXTURE_2D, depthTexture);
+				GLStats::Uniform2i(sourceSizeLoc, framebufferWidth, framebufferHeight);
+			}
+			else
+			{
+				// only the source level may be sampled while the next one is rendered; texelFetch and
+				// textureSize count levels from the base level, so the source is lod 0
+				GLStats::BindTexture(GL_TEXTURE_2D, pyramidTexture);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level - 1);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, level - 1);
+				GLStats::Uniform2i(sourceSizeLoc, levelSizes[level - 1].x, levelSizes[level - 1].y);
+			}
+			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, pyramidTexture, level);
+			glViewport(0, 0, levelSizes[level].x, levelSizes[level].y);
+			GLStats::DrawArrays(GL_TRIANGLES, 0, 3);
+		}
+
+		// 3. start the asynchronous read of the coarse level
+		pending.ViewProjection = viewProjection;
+		pending.FramebufferWidth = framebufferWidth;
+		pending.FramebufferHeight = framebufferHeight;
+		pending.Width = levelSizes[levelCount - 1].x;
+		pending.Height = levelSizes[levelCount - 1].y;
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffer);
+		glReadBuffer(GL_COLOR_ATTACHMENT0);
+		glReadPixels(0, 0, pending.Width, pending.Height, GL_RED, GL_FLOAT, 0);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+		GLStats::BindTexture(GL_TEXTURE_2D, pyramidTexture);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+		GLStats::BindTexture(GL_TEXTURE_2D, 0);
+		glBindFramebuffer(GL_FRAMEBUFFER, source);
+		GLStats::BindVertexArray(0);
+		glViewport(0, 0, framebufferWidth, framebufferHeight);
+		glDepthMask(GL_TRUE);
+		glEnable(GL_DEPTH_TEST);
+	}
+
+	// drops the pyramid and any readback in flight; objects count as visible until the next Build resolves
+	void Invalidate()
+	{
+		if (fence != 0)
+		{
+			glDeleteSync(fence);
+			fence = 0;
+		}
+		hasDepths = false;
+	}
+
+	// picks up a finished readback if there is one; never waits for the GPU
+	void Resolve()
+	{
+		if (fence == 0)
+			return;
+		GLenum status = glClientWaitSync(fence, 0, 0);
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+			return;
+		glDeleteSync(fence);
+		fence = 0;
+
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffer);
+		const float* texels = (const float*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, pending.Width * pending.Height * sizeof(float), GL_MAP_READ_BIT);
+		if (texels)
+		{
+			depths.resize(pending.Width * pending.Height);
+			memcpy(&depths[0], texels, depths.size() * sizeof(float));
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+			current = pending;
+			hasDepths = true;
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	}
+
+	// true when the world space box is certainly hidden behind the depth of the frame the pyramid was built from
+	bool IsOccluded(const BoundingBox& box) const
+	{
+		if (!hasDepths)
+			return false;
+
+		glm::vec3 ndcMin(FLT_MAX);
+		glm::vec3 ndcMax(-FLT_MAX);
+		for (int corner = 0; corner < 8; corner++)
+		{
+			glm::vec4 point((corner & 1) ? box.Max.x : box.Min.x, (corner & 2) ? box.Max.y : box.Min.y, (corner & 4) ? box.Max.z : box.Min.z, 1.0f);
+			glm::vec4 clip = current.ViewProjection * point;
+			// crossing the camera plane, so the projected rectangle is meaningless
+			if (clip.w <= 0.0f)
+				return false;
+			glm::vec3 ndc = glm::vec3(clip) / clip.w;
+			ndcMin = glm::min(ndcMin, ndc);
+			ndcMax = glm::max(ndcMax, ndc);
+		}
+
+		// window depth of the nearest point of the box
+		float nearestDepth = ndcMin.z * 0.5f + 0.5f;
+		if (nearestDepth <= 0.0f)
+			return false;
+
+		int x0 = texelOf(ndcMin.x, current.FramebufferWidth, current.Width);
+		int x1 = texelOf(ndcMax.x, current.FramebufferWidth, current.Width);
+		int y0 = texelOf(ndcMin.y, current.FramebufferHeight, current.Height);
+		int y1 = texelOf(ndcMax.y, current.FramebufferHeight, current.Height);
+		if ((x1 - x0 + 1) * (y1 - y0 + 1) > MAX_TEST_TEXELS)
+			return false;
+
+		for (int y = y0; y <= y1; y++)
+		{
+			for (int x = x0; x <= x1; x++)
+			{
+				if (nearestDepth <= depths[y * current.Width + x])
+					return false;
+			}
+		}
+		return true;
+	}
+
+private:
+	// levels of the largest size class a 32 bit int can describe
+	static const int MAX_LEVELS = 32;
+
+	// what a readback holds: the frame's matrix, its rendered size and the texels read
+	struct Readback {
+		glm::mat4 ViewProjection;
+		int FramebufferWidth, FramebufferHeight;
+		int Width, Height;
+	};
+
+	FramebufferManager* framebuffers;
+	int width, height;          // size classes of the textures
+	GLuint depthTexture, pyramidTexture;
+	GLuint depthFbo, pyramidFbo;
+	GLuint emptyVao;
+	GLuint program;
+	GLint depthLevelLoc, sourceLevelLoc, sourceSizeLoc;
+	int levelCount;
+	GLuint pixelBuffer;
+	GLsync fence;
+	Readback pending;
+	// CPU copy of the readback level and the frame it came from
+	std::vector<float> depths;
+	Readback current;
+	bool hasDepths;
+
+	// maps an NDC coordinate to the readback texel whose footprint holds that framebuffer pixel
+	int texelOf(float ndc, int framebufferSize, int readbackSize) const
+	{
+		float pixel = (ndc * 0.5f + 0.5f) * framebufferSize;
+		if (pixel <= 0.0f)
+			return 0;
+		int texel = (int)pixel >> levelCount;
+		return texel >= readbackSize ? readbackSize - 1 : texel;
+	}
+
+	void release()
+	{
+		Invalidate();
+		if (depthTexture != 0)
+			framebuffers->Release(depthTexture);
+		if (pyramidTexture != 0)
+			framebuffers->Release(pyramidTexture);
+		depthTexture = pyramidTexture = 0;
+	}
+
+	void allocate(int framebufferWidth, int framebufferHeight)
+	{
+		release();
+		width = FramebufferManager::SizeClass(framebufferWidth);
+		height = FramebufferManager::SizeClass(framebufferHeight);
+
+		depthTexture = framebuffers->Acquire(GL_DEPTH24_STENCIL8, width, height);
+		glBindFramebuffer(GL_FRAMEBUFFER, depthFbo);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+
+		// pyramid level 0 is half the size class and each further level halves again down to the readback size.
+		// Level 0 is padded to a multiple of 2^(levels - 1) so every level of the mip chain glTexStorage2D
+		// allocates holds the rounded up half of the one below for any rendered size in the class.
+		levelCount = 1;
+		while ((((width + 1) / 2) >> (levelCount - 1)) > READBACK_WIDTH && levelCount < MAX_LEVELS)
+			levelCount++;
+		int alignment = 1 << (levelCount - 1);
+		glm::ivec2 size(((width + 1) / 2 + alignment - 1) / alignment * alignment, ((height + 1) / 2 + alignment - 1) / alignment * alignment);
+		pyramidTexture = framebuffers->Acquire(GL_R32F, size.x, size.y, levelCount);
+		GLStats::BindTexture(GL_TEXTURE_2D, pyramidTexture);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+		GLStats::BindTexture(GL_TEXTURE_2D, 0);
+
+		// room for the largest readback of the class
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffer);
+		GLStats::BufferData(GL_PIXEL_PACK_BUFFER, (size.x >> (levelCount - 1)) * (size.y >> (levelCount - 1)) * sizeof(float), NULL, GL_STREAM_READ);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+};
+#endif
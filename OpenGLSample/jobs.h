@@ -0,0 +1,285 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Number of jobs still running for a batch; Wait on it to join them
+struct JobCounter {
+	std::atomic<int> Pending;
+
+	JobCounter() : Pending(0) {}
+};
+
+// Work-stealing job scheduler. Every thread owns a deque: it pushes and pops its own jobs at the back
+// (newest first, still warm in cache) while idle threads steal the oldest jobs from the front of the others.
+// Waiting never blocks a thread that could be working: Wait keeps running jobs until its counter drains,
+// so jobs may freely spawn and wait for nested jobs.
+class JobSystem
+{
+public:
+	typedef std::function<void()> JobFunction;
+
+	JobSystem() : stopping(false)
+	{
+		queued = 0;
+		queues.push_back(std::unique_ptr<Queue>(new Queue()));
+	}
+
+	~JobSystem()
+	{
+		Stop();
+	}
+
+	// starts the workers; the calling thread becomes thread 0 and takes part whenever it waits
+	void Start(int workerCount)
+	{
+		Stop();
+		stopping = false;
+		queues.clear();
+		for (int i = 0; i <= workerCount; i++)
+			queues.push_back(std::unique_ptr<Queue>(new Queue()));
+		currentThread() = 0;
+		for (int i = 1; i <= workerCount; i++)
+			workers.push_back(std::thread(&JobSystem::workerLoop, this, i));
+	}
+
+	void Stop()
+	{
+		{
+			std::lock_guard<std::mutex> lock(sleepMutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		for (size_t i = 0; i < workers.size(); i++)
+			workers[i].join();
+		workers.clear();
+	}
+
+	// threads running jobs, including the one that called Start
+	int ThreadCount() const
+	{
+		return (int)queues.size();
+	}
+
+	// index of the calling thread in [0, ThreadCount()), for per-thread scratch data
+	static int CurrentThread()
+	{
+		return currentThread();
+	}
+
+	// queues a job on the calling thread's deque
+	void Run(const JobFunction& work, JobCounter& counter)
+	{
+		counter.Pending.fetch_add(1);
+		Job job = { work, &counter };
+		Queue& queue = *queues[ownQueue()];
+		{
+			std::lock_guard<std::mutex> lock(queue.Mutex);
+			queue.Jobs.push_back(job);
+		}
+		queued.fetch_add(1);
+		// taking the lock orders the push before a sleeper's check, so the wakeup can't be lost
+		{
+			std::lock_guard<std::mutex> lock(sleepMutex);
+		}
+		wake.notify_one();
+	}
+
+	// runs queued jobs (ours or stolen) until every job of the counter has finished
+	void Wait(JobCounter& counter)
+	{
+		int thread = ownQueue();
+		while (counter.Pending.load() > 0)
+		{
+			if (!runOne(thread))
+				std::this_thread::yield();
+		}
+	}
+
+	// calls body(begin, end) over [0, count) in chunks of about grain items and waits for all of them
+	void ParallelFor(int count, int grain, const std::function<void(int begin, int end)>& body)
+	{
+		if (count <= 0)
+			return;
+		if (grain < 1)
+			grain = 1;
+		if (count <= grain || ThreadCount() == 1)
+		{
+			body(0, count);
+			return;
+		}
+		JobCounter counter;
+		for (int begin = grain; begin < count; begin += grain)
+		{
+			int end = begin + grain < count ? begin + grain : count;
+			Run([&body, begin, end] { body(begin, end); }, counter);
+		}
+		// the caller does the first chunk itself instead of just waiting
+		body(0, grain);
+		Wait(counter);
+	}
+
+private:
+	struct Job {
+		JobFunction Work;
+		JobCounter* Counter;
+	};
+
+	struct Queue {
+		std::mutex Mutex;
+		std::deque<Job> Jobs;
+	};
+
+	std::vector<std::unique_ptr<Queue> > queues;
+	std::vector<std::thread> workers;
+	std::atomic<int> queued;
+	std::mutex sleepMutex;
+	std::condition_variable wake;
+	bool stopping;
+
+	static int& currentThread()
+	{
+		static thread_local int index = 0;
+		return index;
+	}
+
+	// threads that aren't ours share thread 0's deque
+	int ownQueue() const
+	{
+		int thread = currentThread();
+		return thread < (int)queues.size() ? thread : 0;
+	}
+
+	bool runOne(int thread)
+	{
+		Job job;
+		if (!pop(thread, job))
+		{
+			// steal round robin, starting after ourselves so thieves spread over the victims
+			bool stolen = false;
+			for (int i = 1; i < (int)queues.size() && !stolen; i++)
+				stolen = steal((thread + i) % (int)queues.size(), job);
+			if (!stolen)
+				return false;
+		}
+		job.Work();
+		job.Counter->Pending.fetch_sub(1);
+		return true;
+	}
+
+	bool pop(int thread, Job& job)
+	{
+		Queue& queue = *queues[thread];
+		std::lock_guard<std::mutex> lock(queue.Mutex);
+		if (queue.Jobs.empty())
+			return false;
+		job = queue.Jobs.back();
+		queue.Jobs.pop_back();
+		queued.fetch_sub(1);
+		return true;
+	}
+
+	bool steal(int victim, Job& job)
+	{
+		Queue& queue = *queues[victim];
+		std::lock_guard<std::mutex> lock(queue.Mutex);
+		if (queue.Jobs.empty())
+			return false;
+		job = queue.Jobs.front();
+		queue.Jobs.pop_front();
+		queued.fetch_sub(1);
+		return true;
+	}
+
+	void workerLoop(int index)
+	{
+		currentThread() = index;
+		for (;;)
+		{
+			if (runOne(index))
+				continue;
+			std::unique_lock<std::mutex> lock(sleepMutex);
+			// the timeout only bounds the cost of a missed wakeup, it is not needed for correctness
+			wake.wait_for(lock, std::chrono::milliseconds(10), [this] { return stopping || queued.load() > 0; });
+			if (stopping)
+				return;
+		}
+	}
+};
+
+// Graph of named tasks with dependencies, built once and run every frame. A task is queued as soon as
+// the last task it depends on finishes, so independent branches run concurrently on the job system.
+class TaskGraph
+{
+public:
+	// adds a task that runs after all of the given tasks and returns its handle
+	int Add(const char* name, const JobSystem::JobFunction& work, std::initializer_list<int> dependencies = {})
+	{
+		Task task;
+		task.Name = name;
+		task.Work = work;
+		task.DependencyCount = (int)dependencies.size();
+		int index = (int)tasks.size();
+		tasks.push_back(task);
+		for (int dependency : dependencies)
+			tasks[dependency].Successors.push_back(index);
+		return index;
+	}
+
+	const char* Name(int task) const
+	{
+		return tasks[task].Name;
+	}
+
+	// runs every task once, respecting dependencies, and returns when all have finished
+	void Run(JobSystem& jobs)
+	{
+		remaining.reset(new std::atomic<int>[tasks.size()]);
+		for (size_t i = 0; i < tasks.size(); i++)
+			remaining[i] = tasks[i].DependencyCount;
+
+		JobCounter counter;
+		for (size_t i = 0; i < tasks.size(); i++)
+		{
+			if (tasks[i].DependencyCount == 0)
+				submit(jobs, (int)i, counter);
+		}
+		jobs.Wait(counter);
+	}
+
+private:
+	struct Task {
+		const char* Name;
+		JobSystem::JobFunction Work;
+		std::vector<int> Successors;
+		int DependencyCount;
+	};
+
+	std::vector<Task> tasks;
+	std::unique_ptr<std::atomic<int>[]> remaining;
+
+	void submit(JobSystem& jobs, int task, JobCounter& counter)
+	{
+		// successors are queued before this job counts as finished, so the counter can't drain early
+		jobs.Run([this, &jobs, task, &counter]
+		{
+			tasks[task].Work();
+			for (size_t i = 0; i < tasks[task].Successors.size(); i++)
+			{
+				int successor = tasks[task].Successors[i];
+				if (remaining[successor].fetch_sub(1) == 1)
+					submit(jobs, successor, counter);
+			}
+		}, counter);
+	}
+};
+#endif
@@ -4,6 +4,7 @@
 #include <iostream>
 #include <cstdint>
 #include <cstring>
+#include <cmath>
 
 #ifdef LINMATH_NO_INLINE
 #define LINMATH_H_FUNC static
@@ -11,6 +12,27 @@
 #define LINMATH_H_FUNC static inline
 #endif
 
+/* SIMD backend, picked at compile time from the target instruction set (-march, /arch):
+ *   LINMATH_SIMD 2  AVX2, 256 bit: mat4x4_mul and mat4x4_mul_points handle two columns / points at once
+ *   LINMATH_SIMD 1  SSE4.1: mat4x4_mul, mat4x4_mul_vec4, mat4x4_transpose, mat4x4_invert, mat4x4_mul_points
+ *   LINMATH_SIMD 0  scalar loops
+ * Define LINMATH_SIMD before including to cap it. The SIMD routines perform the same float operations in the
+ * same order as their *_scalar versions, so results are bit identical as long as the compiler doesn't fuse
+ * the scalar a*b+c into FMAs (GCC and clang do when FMA is enabled, unless built with -ffp-contract=off). */
+#ifndef LINMATH_SIMD
+#if defined(__AVX2__)
+#define LINMATH_SIMD 2
+#elif defined(__SSE4_1__) || defined(__AVX__)
+#define LINMATH_SIMD 1
+#else
+#define LINMATH_SIMD 0
+#endif
+#endif
+
+#if LINMATH_SIMD
+#include <immintrin.h>
+#endif
+
 #define LINMATH_H_DEFINE_VEC(n) \
 typedef float vec##n[n]; \
 LINMATH_H_FUNC void vec##n##_add(vec##n r, vec##n const a, vec##n const b) \
@@ -97,6 +119,178 @@ LINMATH_H_FUNC void vec4_reflect(vec4 r, vec4 v, vec4 n)
 }
 
 typedef vec4 mat4x4[4];
+
+#if LINMATH_SIMD >= 1
+/* Unaligned loads and stores throughout, so plain float arrays work */
+LINMATH_H_FUNC void mat4x4_mul_sse41(mat4x4 M, mat4x4 a, mat4x4 b)
+{
+	__m128 const a0 = _mm_loadu_ps(a[0]);
+	__m128 const a1 = _mm_loadu_ps(a[1]);
+	__m128 const a2 = _mm_loadu_ps(a[2]);
+	__m128 const a3 = _mm_loadu_ps(a[3]);
+	int c;
+	for (c = 0; c < 4; ++c) {
+		__m128 r = _mm_setzero_ps();
+		r = _mm_add_ps(r, _mm_mul_ps(a0, _mm_set1_ps(b[c][0])));
+		r = _mm_add_ps(r, _mm_mul_ps(a1, _mm_set1_ps(b[c][1])));
+		r = _mm_add_ps(r, _mm_mul_ps(a2, _mm_set1_ps(b[c][2])));
+		r = _mm_add_ps(r, _mm_mul_ps(a3, _mm_set1_ps(b[c][3])));
+		_mm_storeu_ps(M[c], r);
+	}
+}
+LINMATH_H_FUNC void mat4x4_mul_vec4_sse41(vec4 r, mat4x4 M, vec4 v)
+{
+	__m128 p = _mm_setzero_ps();
+	p = _mm_add_ps(p, _mm_mul_ps(_mm_loadu_ps(M[0]), _mm_set1_ps(v[0])));
+	p = _mm_add_ps(p, _mm_mul_ps(_mm_loadu_ps(M[1]), _mm_set1_ps(v[1])));
+	p = _mm_add_ps(p, _mm_mul_ps(_mm_loadu_ps(M[2]), _mm_set1_ps(v[2])));
+	p = _mm_add_ps(p, _mm_mul_ps(_mm_loadu_ps(M[3]), _mm_set1_ps(v[3])));
+	_mm_storeu_ps(r, p);
+}
+LINMATH_H_FUNC void mat4x4_transpose_sse41(mat4x4 M, mat4x4 N)
+{
+	__m128 n0 = _mm_loadu_ps(N[0]);
+	__m128 n1 = _mm_loadu_ps(N[1]);
+	__m128 n2 = _mm_loadu_ps(N[2]);
+	__m128 n3 = _mm_loadu_ps(N[3]);
+	_MM_TRANSPOSE4_PS(n0, n1, n2, n3);
+	_mm_storeu_ps(M[0], n0);
+	_mm_storeu_ps(M[1], n1);
+	_mm_storeu_ps(M[2], n2);
+	_mm_storeu_ps(M[3], n3);
+}
+LINMATH_H_FUNC void mat4x4_invert_sse41(mat4x4 T, mat4x4 M)
+{
+	__m128 const m0 = _mm_loadu_ps(M[0]);
+	__m128 const m1 = _mm_loadu_ps(M[1]);
+	__m128 const m2 = _mm_loadu_ps(M[2]);
+	__m128 const m3 = _mm_loadu_ps(M[3]);
+
+	/* The 2x2 determinants s[] (columns 0, 1) and c[] (columns 2, 3) of mat4x4_invert_scalar: lanes s0..s3,
+	 * c0..c3 and s4 s5 c4 c5 */
+	__m128 const s0123 = _mm_sub_ps(
+		_mm_mul_ps(_mm_shuffle_ps(m0, m0, _MM_SHUFFLE(1, 0, 0, 0)), _mm_shuffle_ps(m1, m1, _MM_SHUFFLE(2, 3, 2, 1))),
+		_mm_mul_ps(_mm_shuffle_ps(m1, m1, _MM_SHUFFLE(1, 0, 0, 0)), _mm_shuffle_ps(m0, m0, _MM_SHUFFLE(2, 3, 2, 1))));
+	__m128 const c0123 = _mm_sub_ps(
+		_mm_mul_ps(_mm_shuffle_ps(m2, m2, _MM_SHUFFLE(1, 0, 0, 0)), _mm_shuffle_ps(m3, m3, _MM_SHUFFLE(2, 3, 2, 1))),
+		_mm_mul_ps(_mm_shuffle_ps(m3, m3, _MM_SHUFFLE(1, 0, 0, 0)), _mm_shuffle_ps(m2, m2, _MM_SHUFFLE(2, 3, 2, 1))));
+	__m128 const sc45 = _mm_sub_ps(
+		_mm_mul_ps(_mm_shuffle_ps(m0, m2, _MM_SHUFFLE(2, 1, 2, 1)), _mm_shuffle_ps(m1, m3, _MM_SHUFFLE(3, 3, 3, 3))),
+		_mm_mul_ps(_mm_shuffle_ps(m1, m3, _MM_SHUFFLE(2, 1, 2, 1)), _mm_shuffle_ps(m0, m2, _MM_SHUFFLE(3, 3, 3, 3))));
+
+	float s[8], c[4];
+	_mm_storeu_ps(s, s0123);
+	_mm_storeu_ps(s + 4, sc45);
+	_mm_storeu_ps(c, c0123);
+	float const c4 = s[6], c5 = s[7];
+
+	/* Assumes it is invertible */
+	float idet = 1.0f / (s[0] * c5 - s[1] * c4 + s[2] * c[3] + s[3] * c[2] - s[4] * c[1] + s[5] * c[0]);
+	__m128 const videt = _mm_set1_ps(idet);
+
+	/* y[k] = { c[k], c[k], s[k], s[k] }, the factor each lane of a result column multiplies with. Built from
+	 * the stored copies: broadcasts from memory keep the shuffle port free for the rest. */
+	__m128 const y0 = _mm_blend_ps(_mm_set1_ps(c[0]), _mm_set1_ps(s[0]), 0xc);
+	__m128 const y1 = _mm_blend_ps(_mm_set1_ps(c[1]), _mm_set1_ps(s[1]), 0xc);
+	__m128 const y2 = _mm_blend_ps(_mm_set1_ps(c[2]), _mm_set1_ps(s[2]), 0xc);
+	__m128 const y3 = _mm_blend_ps(_mm_set1_ps(c[3]), _mm_set1_ps(s[3]), 0xc);
+	__m128 const y4 = _mm_blend_ps(_mm_set1_ps(c4), _mm_set1_ps(s[4]), 0xc);
+	__m128 const y5 = _mm_blend_ps(_mm_set1_ps(c5), _mm_set1_ps(s[5]), 0xc);
+
+	/* p[k] = { M[1][k], M[0][k], M[3][k], M[2][k] } (a transpose with swapped pairs), negated in alternating
+	 * lanes. Negating a product's factor and flipping the following add / sub gives the same bits as the
+	 * scalar code's sign pattern. */
+	__m128 const u0 = _mm_unpacklo_ps(m1, m0);
+	__m128 const u1 = _mm_unpacklo_ps(m3, m2);
+	__m128 const u2 = _mm_unpackhi_ps(m1, m0);
+	__m128 const u3 = _mm_unpackhi_ps(m3, m2);
+	__m128 const p0 = _mm_movelh_ps(u0, u1);
+	__m128 const p1 = _mm_movehl_ps(u1, u0);
+	__m128 const p2 = _mm_movelh_ps(u2, u3);
+	__m128 const p3 = _mm_movehl_ps(u3, u2);
+	__m128 const odd = _mm_setr_ps(0.f, -0.f, 0.f, -0.f);
+	__m128 const even = _mm_setr_ps(-0.f, 0.f, -0.f, 0.f);
+
+	__m128 t;
+	t = _mm_sub_ps(_mm_mul_ps(_mm_xor_ps(p1, odd), y5), _mm_mul_ps(_mm_xor_ps(p2, odd), y4));
+	t = _mm_add_ps(t, _mm_mul_ps(_mm_xor_ps(p3, odd), y3));
+	_mm_storeu_ps(T[0], _mm_mul_ps(t, videt));
+
+	t = _mm_sub_ps(_mm_mul_ps(_mm_xor_ps(p0, even), y5), _mm_mul_ps(_mm_xor_ps(p2, even), y2));
+	t = _mm_add_ps(t, _mm_mul_ps(_mm_xor_ps(p3, even), y1));
+	_mm_storeu_ps(T[1], _mm_mul_ps(t, videt));
+
+	t = _mm_sub_ps(_mm_mul_ps(_mm_xor_ps(p0, odd), y4), _mm_mul_ps(_mm_xor_ps(p1, odd), y2));
+	t = _mm_add_ps(t, _mm_mul_ps(_mm_xor_ps(p3, odd), y0));
+	_mm_storeu_ps(T[2], _mm_mul_ps(t, videt));
+
+	t = _mm_sub_ps(_mm_mul_ps(_mm_xor_ps(p0, even), y3), _mm_mul_ps(_mm_xor_ps(p1, even), y1));
+	t = _mm_add_ps(t, _mm_mul_ps(_mm_xor_ps(p2, even), y0));
+	_mm_storeu_ps(T[3], _mm_mul_ps(t, videt));
+}
+LINMATH_H_FUNC void mat4x4_mul_points_sse41(vec4 *r, mat4x4 M, vec3 const *p, int count)
+{
+	__m128 const m0 = _mm_loadu_ps(M[0]);
+	__m128 const m1 = _mm_loadu_ps(M[1]);
+	__m128 const m2 = _mm_loadu_ps(M[2]);
+	__m128 const m3 = _mm_loadu_ps(M[3]);
+	int n;
+	for (n = 0; n < count; ++n) {
+		__m128 q = _mm_setzero_ps();
+		q = _mm_add_ps(q, _mm_mul_ps(m0, _mm_set1_ps(p[n][0])));
+		q = _mm_add_ps(q, _mm_mul_ps(m1, _mm_set1_ps(p[n][1])));
+		q = _mm_add_ps(q, _mm_mul_ps(m2, _mm_set1_ps(p[n][2])));
+		q = _mm_add_ps(q, m3);
+		_mm_storeu_ps(r[n], q);
+	}
+}
+#endif
+
+#if LINMATH_SIMD >= 2
+/* Both 128 bit halves hold the same column */
+LINMATH_H_FUNC __m256 mat4x4_column_avx2(vec4 const v)
+{
+	__m128 const c = _mm_loadu_ps(v);
+	return _mm256_insertf128_ps(_mm256_castps128_ps256(c), c, 1);
+}
+LINMATH_H_FUNC void mat4x4_mul_avx2(mat4x4 M, mat4x4 a, mat4x4 b)
+{
+	__m256 const a0 = mat4x4_column_avx2(a[0]);
+	__m256 const a1 = mat4x4_column_avx2(a[1]);
+	__m256 const a2 = mat4x4_column_avx2(a[2]);
+	__m256 const a3 = mat4x4_column_avx2(a[3]);
+	int c;
+	for (c = 0; c < 4; c += 2) {
+		/* columns c and c + 1 of b, one per half */
+		__m256 const bc = _mm256_loadu_ps(b[c]);
+		__m256 r = _mm256_setzero_ps();
+		r = _mm256_add_ps(r, _mm256_mul_ps(a0, _mm256_shuffle_ps(bc, bc, 0x00)));
+		r = _mm256_add_ps(r, _mm256_mul_ps(a1, _mm256_shuffle_ps(bc, bc, 0x55)));
+		r = _mm256_add_ps(r, _mm256_mul_ps(a2, _mm256_shuffle_ps(bc, bc, 0xaa)));
+		r = _mm256_add_ps(r, _mm256_mul_ps(a3, _mm256_shuffle_ps(bc, bc, 0xff)));
+		_mm256_storeu_ps(M[c], r);
+	}
+}
+LINMATH_H_FUNC void mat4x4_mul_points_avx2(vec4 *r, mat4x4 M, vec3 const *p, int count)
+{
+	__m256 const m0 = mat4x4_column_avx2(M[0]);
+	__m256 const m1 = mat4x4_column_avx2(M[1]);
+	__m256 const m2 = mat4x4_column_avx2(M[2]);
+	__m256 const m3 = mat4x4_column_avx2(M[3]);
+	int n;
+	for (n = 0; n + 1 < count; n += 2) {
+		__m256 q = _mm256_setzero_ps();
+		q = _mm256_add_ps(q, _mm256_mul_ps(m0, _mm256_setr_ps(p[n][0], p[n][0], p[n][0], p[n][0], p[n + 1][0], p[n + 1][0], p[n + 1][0], p[n + 1][0])));
+		q = _mm256_add_ps(q, _mm256_mul_ps(m1, _mm256_setr_ps(p[n][1], p[n][1], p[n][1], p[n][1], p[n + 1][1], p[n + 1][1], p[n + 1][1], p[n + 1][1])));
+		q = _mm256_add_ps(q, _mm256_mul_ps(m2, _mm256_setr_ps(p[n][2], p[n][2], p[n][2], p[n][2], p[n + 1][2], p[n + 1][2], p[n + 1][2], p[n + 1][2])));
+		q = _mm256_add_ps(q, m3);
+		_mm256_storeu_ps(r[n], q);
+	}
+	if (n < count)
+		mat4x4_mul_points_sse41(r + n, M, p + n, count - n);
+}
+#endif
+
 LINMATH_H_FUNC void mat4x4_identity(mat4x4 M)
 {
 	int i, j;
@@ -123,13 +317,21 @@ LINMATH_H_FUNC void mat4x4_col(vec4 r, mat4x4 M, int i)
 	for (k = 0; k < 4; ++k)
 		r[k] = M[i][k];
 }
-LINMATH_H_FUNC void mat4x4_transpose(mat4x4 M, mat4x4 N)
+LINMATH_H_FUNC void mat4x4_transpose_scalar(mat4x4 M, mat4x4 N)
 {
 	int i, j;
 	for (j = 0; j < 4; ++j)
 		for (i = 0; i < 4; ++i)
 			M[i][j] = N[j][i];
 }
+LINMATH_H_FUNC void mat4x4_transpose(mat4x4 M, mat4x4 N)
+{
+#if LINMATH_SIMD >= 1
+	mat4x4_transpose_sse41(M, N);
+#else
+	mat4x4_transpose_scalar(M, N);
+#endif
+}
 LINMATH_H_FUNC void mat4x4_add(mat4x4 M, mat4x4 a, mat4x4 b)
 {
 	int i;
@@ -158,7 +360,7 @@ LINMATH_H_FUNC void mat4x4_scale_aniso(mat4x4 M, mat4x4 a, float x, float y, flo
 		M[3][i] = a[3][i];
 	}
 }
-LINMATH_H_FUNC void mat4x4_mul(mat4x4 M, mat4x4 a, mat4x4 b)
+LINMATH_H_FUNC void mat4x4_mul_scalar(mat4x4 M, mat4x4 a, mat4x4 b)
 {
 	mat4x4 temp;
 	int k, r, c;
@@ -169,7 +371,17 @@ LINMATH_H_FUNC void mat4x4_mul(mat4x4 M, mat4x4 a, mat4x4 b)
 	}
 	mat4x4_dup(M, temp);
 }
-LINMATH_H_FUNC void mat4x4_mul_vec4(vec4 r, mat4x4 M, vec4 v)
+LINMATH_H_FUNC void mat4x4_mul(mat4x4 M, mat4x4 a, mat4x4 b)
+{
+#if LINMATH_SIMD >= 2
+	mat4x4_mul_avx2(M, a, b);
+#elif LINMATH_SIMD >= 1
+	mat4x4_mul_sse41(M, a, b);
+#else
+	mat4x4_mul_scalar(M, a, b);
+#endif
+}
+LINMATH_H_FUNC void mat4x4_mul_vec4_scalar(vec4 r, mat4x4 M, vec4 v)
 {
 	int i, j;
 	for (j = 0; j < 4; ++j) {
@@ -178,6 +390,33 @@ LINMATH_H_FUNC void mat4x4_mul_vec4(vec4 r, mat4x4 M, vec4 v)
 			r[j] += M[i][j] * v[i];
 	}
 }
+LINMATH_H_FUNC void mat4x4_mul_vec4(vec4 r, mat4x4 M, vec4 v)
+{
+#if LINMATH_SIMD >= 1
+	mat4x4_mul_vec4_sse41(r, M, v);
+#else
+	mat4x4_mul_vec4_scalar(r, M, v);
+#endif
+}
+/* r[n] = M * (p[n], 1) for count points */
+LINMATH_H_FUNC void mat4x4_mul_points_scalar(vec4 *r, mat4x4 M, vec3 const *p, int count)
+{
+	int n;
+	for (n = 0; n < count; ++n) {
+		vec4 v = { p[n][0], p[n][1], p[n][2], 1.f };
+		mat4x4_mul_vec4_scalar(r[n], M, v);
+	}
+}
+LINMATH_H_FUNC void mat4x4_mul_points(vec4 *r, mat4x4 M, vec3 const *p, int count)
+{
+#if LINMATH_SIMD >= 2
+	mat4x4_mul_points_avx2(r, M, p, count);
+#elif LINMATH_SIMD >= 1
+	mat4x4_mul_points_sse41(r, M, p, count);
+#else
+	mat4x4_mul_points_scalar(r, M, p, count);
+#endif
+}
 LINMATH_H_FUNC void mat4x4_translate(mat4x4 T, float x, float y, float z)
 {
 	mat4x4_identity(T);
@@ -272,7 +511,7 @@ LINMATH_H_FUNC void mat4x4_rotate_Z(mat4x4 Q, mat4x4 M, float angle)
 	};
 	mat4x4_mul(Q, M, R);
 }
-LINMATH_H_FUNC void mat4x4_invert(mat4x4 T, mat4x4 M)
+LINMATH_H_FUNC void mat4x4_invert_scalar(mat4x4 T, mat4x4 M)
 {
 	float s[6];
 	float c[6];
@@ -313,6 +552,14 @@ LINMATH_H_FUNC void mat4x4_invert(mat4x4 T, mat4x4 M)
 	T[3][2] = (-M[3][0] * s[3] + M[3][1] * s[1] - M[3][2] * s[0]) * idet;
 	T[3][3] = (M[2][0] * s[3] - M[2][1] * s[1] + M[2][2] * s[0]) * idet;
 }
+LINMATH_H_FUNC void mat4x4_invert(mat4x4 T, mat4x4 M)
+{
+#if LINMATH_SIMD >= 1
+	mat4x4_invert_sse41(T, M);
+#else
+	mat4x4_invert_scalar(T, M);
+#endif
+}
 LINMATH_H_FUNC void mat4x4_orthonormalize(mat4x4 R, mat4x4 M)
 {
 	mat4x4_dup(R, M);
@@ -0,0 +1,384 @@
+#ifndef LOD_H
+#define LOD_H
+
+#include <glm/glm.hpp>
+
+#include "bounds.h"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <queue>
+#include <vector>
+
+// Number of detail levels built per mesh, level 0 being the original
+const int MAX_LOD_LEVELS = 4;
+
+// Fraction of the original triangle count kept by each level
+const float LOD_TRIANGLE_RATIOS[MAX_LOD_LEVELS] = { 1.0f, 0.5f, 0.25f, 0.125f };
+
+// Largest error each level may introduce, as a fraction of the mesh's bounding box diagonal.
+// Coarse shapes (boxes, planes) hit this budget early and simply end up with fewer levels.
+const float LOD_MAX_ERRORS[MAX_LOD_LEVELS] = { 0.0f, 0.01f, 0.03f, 0.08f };
+
+// A range of a mesh's index buffer holding one level of detail
+struct LodLevel {
+	unsigned int FirstIndex;
+	unsigned int IndexCount;
+	float Error;  // largest geometric error (model space units) introduced by the simplification
+};
+
+// Symmetric 4x4 error quadric of Garland and Heckbert, stored as its 10 unique coefficients
+struct Quadric {
+	double A[10];
+
+	Quadric()
+	{
+		for (int i = 0; i < 10; i++)
+			A[i] = 0.0;
+	}
+
+	// quadric measuring the squared distance to the plane ax + by + cz + d = 0, scaled by weight
+	static Quadric FromPlane(double a, double b, double c, double d, double weight)
+	{
+		Quadric q;
+		q.A[0] = a * a * weight; q.A[1] = a * b * weight; q.A[2] = a * c * weight; q.A[3] = a * d * weight;
+		q.A[4] = b * b * weight; q.A[5] = b * c * weight; q.A[6] = b * d * weight;
+		q.A[7] = c * c * weight; q.A[8] = c * d * weight;
+		q.A[9] = d * d * weight;
+		return q;
+	}
+
+	void Add(const Quadric& other)
+	{
+		for (int i = 0; i < 10; i++)
+			A[i] += other.A[i];
+	}
+
+	double Evaluate(glm::vec3 p) const
+	{
+		double x = p.x, y = p.y, z = p.z;
+		return A[0] * x * x + 2.0 * A[1] * x * y + 2.0 * A[2] * x * z + 2.0 * A[3] * x
+			+ A[4] * y * y + 2.0 * A[5] * y * z + 2.0 * A[6] * y
+			+ A[7] * z * z + 2.0 * A[8] * z
+			+ A[9];
+	}
+};
+
+// Quadric error metric simplification by half-edge collapses: a vertex is always merged onto one of its
+// neighbours, so every level keeps indexing the original vertex buffer and only needs its own index range.
+// Vertices sharing a position (hard edges, UV seams) are welded for the topology and the surviving corner
+// keeps the attributes of the first vertex found at its position. Collapsing stops at the target size or once
+// the cheapest collapse would move the surface further than maxError. Returns the simplified triangle list.
+inline std::vector<unsigned int> SimplifyMesh(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices, size_t targetIndexCount, float maxError, float& error)
+{
+	error = 0.0f;
+	const size_t triangleCount = indices.size() / 3;
+
+	// weld vertices by exact position
+	std::map<std::vector<float>, unsigned int> positionIds;
+	std::vector<unsigned int> weldOf(positions.size());
+	std::vector<unsigned int> representative;
+	std::vector<glm::vec3> points;
+	for (size_t i = 0; i < positions.size(); i++)
+	{
+		std::vector<float> key(&positions[i].x, &positions[i].x + 3);
+		std::map<std::vector<float>, unsigned int>::iterator found = positionIds.find(key);
+		if (found == positionIds.end())
+		{
+			found = positionIds.insert(std::make_pair(key, (unsigned int)points.size())).first;
+			points.push_back(positions[i]);
+			representative.push_back((unsigned int)i);
+		}
+		weldOf[i] = found->second;
+	}
+
+	const size_t vertexCount = points.size();
+	std::vector<unsigned int> triangles(triangleCount * 3);
+	std::vector<bool> triangleAlive(triangleCount, true);
+	std::vector<std::vector<unsigned int> > vertexTriangles(vertexCount);
+	std::vector<Quadric> quadrics(vertexCount);
+	size_t aliveTriangles = 0;
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		for (int corner = 0; corner < 3; corner++)
+			triangles[t * 3 + corner] = weldOf[indices[t * 3 + corner]];
+		unsigned int a = triangles[t * 3], b = triangles[t * 3 + 1], c = triangles[t * 3 + 2];
+		if (a == b || b == c || a == c)
+		{
+			triangleAlive[t] = false;
+			continue;
+		}
+		aliveTriangles++;
+		glm::vec3 normal = glm::cross(points[b] - points[a], points[c] - points[a]);
+		float length = glm::length(normal);
+		if (length <= 0.0f)
+			continue;
+		normal /= length;
+		// unit weights keep the error in squared distance units, so it can be compared against maxError
+		Quadric plane = Quadric::FromPlane(normal.x, normal.y, normal.z, -glm::dot(normal, points[a]), 1.0);
+		for (int corner = 0; corner < 3; corner++)
+		{
+			quadrics[triangles[t * 3 + corner]].Add(plane);
+			vertexTriangles[triangles[t * 3 + corner]].push_back((unsigned int)t);
+		}
+	}
+
+	// open edges get a steep perpendicular plane so borders and holes keep their outline
+	std::map<std::pair<unsigned int, unsigned int>, int> edgeUse;
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		if (!triangleAlive[t])
+			continue;
+		for (int corner = 0; corner < 3; corner++)
+		{
+			unsigned int a = triangles[t * 3 + corner], b = triangles[t * 3 + (corner + 1) % 3];
+			edgeUse[std::make_pair(std::min(a, b), std::max(a, b))]++;
+		}
+	}
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		if (!triangleAlive[t])
+			continue;
+		glm::vec3 normal = glm::cross(points[triangles[t * 3 + 1]] - points[triangles[t * 3]], points[triangles[t * 3 + 2]] - points[triangles[t * 3]]);
+		for (int corner = 0; corner < 3; corner++)
+		{
+			unsigned int a = triangles[t * 3 + corner], b = triangles[t * 3 + (corner + 1) % 3];
+			if (edgeUse[std::make_pair(std::min(a, b), std::max(a, b))] != 1)
+				continue;
+			glm::vec3 border = glm::cross(points[b] - points[a], normal);
+			float length = glm::length(border);
+			if (length <= 0.0f)
+				continue;
+			border /= length;
+			Quadric plane = Quadric::FromPlane(border.x, border.y, border.z, -glm::dot(border, points[a]), 10.0);
+			quadrics[a].Add(plane);
+			quadrics[b].Add(plane);
+		}
+	}
+
+	// candidate collapses ordered by error; stale entries are recognised by the vertex versions
+	struct Collapse {
+		double Cost;
+		unsigned int From, To;
+		unsigned int FromVersion, ToVersion;
+		bool operator<(const Collapse& other) const { return Cost > other.Cost; }
+	};
+	std::vector<unsigned int> version(vertexCount, 0);
+	std::vector<bool> vertexAlive(vertexCount, true);
+	std::priority_queue<Collapse> candidates;
+
+	struct Local {
+		static void Push(std::priority_queue<Collapse>& heap, const std::vector<Quadric>& q, const std::vector<glm::vec3>& p, const std::vector<unsigned int>& v, unsigned int a, unsigned int b)
+		{
+			Quadric merged = q[a];
+			merged.Add(q[b]);
+			// collapse whichever direction is cheaper
+			double toB = merged.Evaluate(p[b]);
+			double toA = merged.Evaluate(p[a]);
+			Collapse collapse;
+			collapse.From = toB <= toA ? a : b;
+			collapse.To = toB <= toA ? b : a;
+			collapse.Cost = toB <= toA ? toB : toA;
+			collapse.FromVersion = v[collapse.From];
+			collapse.ToVersion = v[collapse.To];
+			heap.push(collapse);
+		}
+	};
+	for (std::map<std::pair<unsigned int, unsigned int>, int>::iterator edge = edgeUse.begin(); edge != edgeUse.end(); ++edge)
+		Local::Push(candidates, quadrics, points, version, edge->first.first, edge->first.second);
+
+	while (aliveTriangles * 3 > targetIndexCount && !candidates.empty())
+	{
+		Collapse collapse = candidates.top();
+		// every remaining candidate costs at least as much as the cheapest one
+		if (collapse.Cost > (double)maxError * maxError)
+			break;
+		candidates.pop();
+		unsigned int from = collapse.From, to = collapse.To;
+		if (!vertexAlive[from] || !vertexAlive[to] || version[from] != collapse.FromVersion || version[to] != collapse.ToVersion)
+			continue;
+
+		// reject collapses that would fold a surviving triangle over
+		bool flips = false;
+		for (size_t i = 0; i < vertexTriangles[from].size() && !flips; i++)
+		{
+			unsigned int t = vertexTriangles[from][i];
+			unsigned int* corners = &triangles[t * 3];
+			if (!triangleAlive[t] || corners[0] == to || corners[1] == to || corners[2] == to)
+				continue;
+			glm::vec3 before = glm::cross(points[corners[1]] - points[corners[0]], points[corners[2]] - points[corners[0]]);
+			glm::vec3 moved[3];
+			for (int corner = 0; corner < 3; corner++)
+				moved[corner] = corners[corner] == from ? points[to] : points[corners[corner]];
+			glm::vec3 after = glm::cross(moved[1] - moved[0], moved[2] - moved[0]);
+			flips = glm::dot(before, after) <= 0.0f;
+		}
+		if (flips)
+			continue;
+
+		// merge: triangles on the edge disappear, the rest now reference the surviving vertex
+		for (size_t i = 0; i < vertexTriangles[from].size(); i++)
+		{
+			unsigned int t = vertexTriangles[from][i];
+			if (!triangleAlive[t])
+				continue;
+			unsigned int* corners = &triangles[t * 3];
+			if (corners[0] == to || corners[1] == to || corners[2] == to)
+			{
+				triangleAlive[t] = false;
+				aliveTriangles--;
+				continue;
+			}
+			for (int corner = 0; corner < 3; corner++)
+			{
+				if (corners[corner] == from)
+					corners[corner] = to;
+			}
+			vertexTriangles[to].push_back(t);
+		}
+		vertexAlive[from] = false;
+		quadrics[to].Add(quadrics[from]);
+		version[to]++;
+		error = std::max(error, (float)std::sqrt(std::max(collapse.Cost, 0.0)));
+
+		// re-evaluate every edge around the surviving vertex
+		for (size_t i = 0; i < vertexTriangles[to].size(); i++)
+		{
+			unsigned int t = vertexTriangles[to][i];
+			if (!triangleAlive[t])
+				continue;
+			for (int corner = 0; corner < 3; corner++)
+			{
+				unsigned int neighbour = triangles[t * 3 + corner];
+				if (neighbour != to)
+					Local::Push(candidates, quadrics, points, version, to, neighbour);
+			}
+		}
+	}
+
+	std::vector<unsigned int> simplified;
+	simplified.reserve(aliveTriangles * 3);
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		if (!triangleAlive[t])
+			continue;
+		for (int corner = 0; corner < 3; corner++)
+		{
+			// corners that never moved keep their own vertex (and attributes)
+			unsigned int original = indices[t * 3 + corner];
+			simplified.push_back(weldOf[original] == triangles[t * 3 + corner] ? original : representative[triangles[t * 3 + corner]]);
+		}
+	}
+	return simplified;
+}
+
+// Builds the full chain: level 0 is the original index list, each further level is simplified from the
+// previous one. All levels are concatenated into one index buffer and described by their ranges.
+inline std::vector<unsigned int> BuildLodChain(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices, std::vector<LodLevel>& levels)
+{
+	std::vector<unsigned int> chain(indices);
+	LodLevel original = { 0, (unsigned int)indices.size(), 0.0f };
+	levels.assign(1, original);
+
+	BoundingBox bounds;
+	for (size_t i = 0; i < indices.size(); i++)
+		bounds.Expand(positions[indices[i]]);
+	float diagonal = bounds.IsEmpty() ? 0.0f : glm::length(bounds.Max - bounds.Min);
+
+	std::vector<unsigned int> previous(indices);
+	for (int level = 1; level < MAX_LOD_LEVELS; level++)
+	{
+		size_t target = (size_t)(indices.size() / 3 * LOD_TRIANGLE_RATIOS[level]) * 3;
+		float error = 0.0f;
+		std::vector<unsigned int> simplified = SimplifyMesh(positions, previous, target, LOD_MAX_ERRORS[level] * diagonal, error);
+		// stop once the mesh can't be reduced any further
+		if (simplified.empty() || simplified.size() >= previous.size())
+			break;
+
+		LodLevel lod = { (unsigned int)chain.size(), (unsigned int)simplified.size(), std::max(error, levels.back().Error) };
+		levels.push_back(lod);
+		chain.insert(chain.end(), simplified.begin(), simplified.end());
+		previous.swap(simplified);
+	}
+	return chain;
+}
+
+// Counters for the triangles LOD selection saved this frame
+struct LodStats {
+	unsigned int FullTriangles;   // triangles the visible objects have at full detail
+	unsigned int DrawnTriangles;  // triangles actually submitted
+};
+
+// Picks a level per object from its projected size on screen. Switching uses a band around each
+// threshold so an object sitting right at a boundary doesn't flip between levels every frame.
+class LodSelector
+{
+public:
+	// fraction of the viewport height below which level i + 1 is used
+	float Thresholds[MAX_LOD_LEVELS - 1];
+	// relative width of the band around each threshold
+	float Hysteresis;
+	// totals of the last frame, gathered by the caller from the stats passed to Select
+	LodStats Stats;
+
+	LodSelector() : Hysteresis(0.2f)
+	{
+		Thresholds[0] = 0.25f;
+		Thresholds[1] = 0.10f;
+		Thresholds[2] = 0.04f;
+		Stats.FullTriangles = 0;
+		Stats.DrawnTriangles = 0;
+	}
+
+	void BeginFrame()
+	{
+		Stats.FullTriangles = 0;
+		Stats.DrawnTriangles = 0;
+	}
+
+	// projected height of a world space sphere as a fraction of the viewport height
+	static float ScreenSize(const BoundingSphere& sphere, glm::vec3 cameraPosition, float fovyDegrees, bool orthographic, float orthoHalfHeight)
+	{
+		if (orthographic)
+			return sphere.Radius / orthoHalfHeight;
+		float distance = glm::length(sphere.Center - cameraPosition);
+		if (distance <= sphere.Radius)
+			return 1.0f;
+		return sphere.Radius / (distance * std::tan(glm::radians(fovyDegrees) * 0.5f));
+	}
+
+	// makes room for the given number of objects, so Select can then run on several threads at once
+	void Reserve(int objectCount)
+	{
+		if ((size_t)objectCount > current.size())
+			current.resize(objectCount, 0);
+	}
+
+	// returns the level to draw for the object and accounts it in the given stats
+	int Select(int object, const std::vector<LodLevel>& levels, float screenSize, LodStats& stats)
+	{
+		if ((size_t)object >= current.size())
+			current.resize(object + 1, 0);
+
+		int level = current[object];
+		int last = (int)levels.size() - 1;
+		if (level > last)
+			level = last;
+		// coarser while clearly below the threshold of the next level, finer while clearly above our own
+		while (level < last && screenSize < Thresholds[level] * (1.0f - Hysteresis))
+			level++;
+		while (level > 0 && screenSize > Thresholds[level - 1] * (1.0f + Hysteresis))
+			level--;
+		current[object] = level;
+
+		stats.FullTriangles += levels[0].IndexCount / 3;
+		stats.DrawnTriangles += levels[level].IndexCount / 3;
+		return level;
+	}
+
+private:
+	// level each object was drawn with last time
+	std::vector<int> current;
+};
+#endif
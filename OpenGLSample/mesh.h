@@ -1,12 +1,15 @@
 #ifndef MESH_H
 #define MESH_H
 
-#include <glad/glad.h> // holds all OpenGL type declarations
+#include "gl_loader.h" // holds all OpenGL type declarations
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
 #include "shader.h"
+#include "glstats.h"
+#include "bounds.h"
+#include "lod.h"
 
 #include <string>
 #include <vector>
@@ -38,6 +41,11 @@ public:
 	vector<unsigned int> indices;
 	vector<Texture>      textures;
 	unsigned int VAO;
+	// model space bounds used for visibility tests
+	BoundingBox bounds;
+	BoundingSphere sphere;
+	// index ranges of the detail levels, full detail first
+	vector<LodLevel> lods;
 
 	// constructor
 	Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
@@ -46,12 +54,22 @@ public:
 		this->indices = indices;
 		this->textures = textures;
 
+		// compute the bounds once at creation so culling never has to touch the vertex data; a mesh without
+		// vertices keeps the empty box and a zero sphere
+		sphere.Center = glm::vec3(0.0f);
+		sphere.Radius = 0.0f;
+		if (!this->vertices.empty())
+		{
+			bounds = ComputeBounds(&this->vertices.data()->Position.x, this->vertices.size(), sizeof(Vertex) / sizeof(float));
+			sphere = bounds.Sphere();
+		}
+
 		// now that we have all the required data, set the vertex buffers and its attribute pointers.
 		setupMesh();
 	}
 
-	// render the mesh
-	void Draw(Shader &shader)
+	// render the mesh at the given level of detail
+	void Draw(Shader &shader, int lod = 0)
 	{
 		// bind appropriate textures
 		unsigned int diffuseNr = 1;
@@ -74,15 +92,15 @@ public:
 				number = std::to_string(heightNr++); // transfer unsigned int to stream
 
 			// now set the sampler to the correct texture unit
-			glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
+			GLStats::Uniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
 			// and finally bind the texture
-			glBindTexture(GL_TEXTURE_2D, textures[i].id);
+			GLStats::BindTexture(GL_TEXTURE_2D, textures[i].id);
 		}
 
 		// draw mesh
-		glBindVertexArray(VAO);
-		glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-		glBindVertexArray(0);
+		GLStats::BindVertexArray(VAO);
+		GLStats::DrawElements(GL_TRIANGLES, lods[lod].IndexCount, GL_UNSIGNED_INT, (void*)(lods[lod].FirstIndex * sizeof(unsigned int)));
+		GLStats::BindVertexArray(0);
 
 		// always good practice to set everything back to defaults once configured.
 		glActiveTexture(GL_TEXTURE0);
@@ -100,16 +118,22 @@ private:
 		glGenBuffers(1, &VBO);
 		glGenBuffers(1, &EBO);
 
-		glBindVertexArray(VAO);
+		GLStats::BindVertexArray(VAO);
 		// load data into vertex buffers
 		glBindBuffer(GL_ARRAY_BUFFER, VBO);
 		// A great thing about structs is that their memory layout is sequential for all its items.
 		// The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
 		// again translates to 3/2 floats which translates to a byte array.
-		glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+		GLStats::BufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW);
+
+		// every level of detail shares the vertices and lives in one index buffer after the original indices
+		vector<glm::vec3> positions(vertices.size());
+		for (unsigned int i = 0; i < vertices.size(); i++)
+			positions[i] = vertices[i].Position;
+		vector<unsigned int> chain = BuildLodChain(positions, indices, lods);
 
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+		GLStats::BufferData(GL_ELEMENT_ARRAY_BUFFER, chain.size() * sizeof(unsigned int), chain.data(), GL_STATIC_DRAW);
 
 		// set the vertex attribute pointers
 		// vertex Positions
@@ -128,7 +152,7 @@ private:
 		glEnableVertexAttribArray(4);
 		glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
 
-		glBindVertexArray(0);
+		GLStats::BindVertexArray(0);
 	}
 };
 #endif
\ No newline at end of file
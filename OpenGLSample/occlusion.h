@@ -0,0 +1,226 @@
+#ifndef OCCLUSION_H
+#define OCCLUSION_H
+
+#include "gl_loader.h"
+
+#include <glm/glm.hpp>
+#include <glm/gtx/transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "bounds.h"
+#include "glstats.h"
+
+#include <vector>
+
+// Counters describing the occlusion pass of the last frame
+struct OcclusionStats {
+	unsigned int Queries;   // queries issued this frame
+	unsigned int Occluded;  // draws skipped because the object was hidden last time it was checked
+};
+
+// Temporally coherent occlusion culling on top of hardware occlusion queries, taking CHC++'s scheduling
+// (visibility carried over between frames, staggered re-checks of visible objects, batched queries for hidden
+// ones) but not its hierarchy: queries are per object, and no BVH node is queried or skipped as a group. The
+// BVH only does the frustum culling before this. With a scene of a dozen objects, interior node queries would
+// cost more than the draws they could save.
+// Results are only ever read once the GPU reports them available, so the CPU never stalls:
+// objects keep the visibility they had when last checked and their queries resolve a frame or two later.
+//  - visible objects are drawn and re-checked every few frames by wrapping their real draw in a query
+//  - hidden objects are not drawn; their bounding box is queried after the visible objects filled the depth buffer
+class OcclusionCuller
+{
+public:
+	// frames a visible object is assumed to stay visible before it is queried again
+	static const int VISIBLE_QUERY_INTERVAL = 5;
+
+	OcclusionStats Stats;
+	bool Enabled;
+
+	OcclusionCuller() : Enabled(true), target(GL_ANY_SAMPLES_PASSED), frame(0), boxVao(0), boxVbo(0)
+	{
+		Stats.Queries = 0;
+		Stats.Occluded = 0;
+	}
+
+	// creates the unit box geometry; the program must take a vec3 position at location 0 and model/view/projection uniforms
+	void Init(GLuint boxProgram)
+	{
+		program = boxProgram;
+		modelLoc = glGetUniformLocation(program, "model");
+		viewLoc = glGetUniformLocation(program, "view");
+		projLoc = glGetUniformLocation(program, "projection");
+
+		// conservative queries are cheaper (no exact sample counting) and available from GL 4.3
+		GLint major = 0, minor = 0;
+		glGetIntegerv(GL_MAJOR_VERSION, &major);
+		glGetIntegerv(GL_MINOR_VERSION, &minor);
+		if (major > 4 || (major == 4 && minor >= 3))
+			target = GL_ANY_SAMPLES_PASSED_CONSERVATIVE;
+
+		// 12 triangles of the [-1, 1] cube
+		const GLfloat corners[8][3] = {
+			{ -1.0f, -1.0f, -1.0f }, { 1.0f, -1.0f, -1.0f }, { 1.0f, 1.0f, -1.0f }, { -1.0f, 1.0f, -1.0f },
+			{ -1.0f, -1.0f,  1.0f }, { 1.0f, -1.0f,  1.0f }, { 1.0f, 1.0f,  1.0f }, { -1.0f, 1.0f,  1.0f }
+		};
+		const int indices[36] = {
+			0, 1, 2, 2, 3, 0,   4, 6, 5, 6, 4, 7,   0, 3, 7, 7, 4, 0,
+			1, 5, 6, 6, 2, 1,   3, 2, 6, 6, 7, 3,   0, 4, 5, 5, 1, 0
+		};
+		GLfloat verts[36 * 3];
+		for (int i = 0; i < 36; i++)
+		{
+			verts[i * 3 + 0] = corners[indices[i]][0];
+			verts[i * 3 + 1] = corners[indices[i]][1];
+			verts[i * 3 + 2] = corners[indices[i]][2];
+		}
+
+		glGenVertexArrays(1, &boxVao);
+		GLStats::BindVertexArray(boxVao);
+		glGenBuffers(1, &boxVbo);
+		glBindBuffer(GL_ARRAY_BUFFER, boxVbo);
+		GLStats::BufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_STATIC_DRAW);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(GLfloat) * 3, 0);
+		glEnableVertexAttribArray(0);
+		GLStats::BindVertexArray(0);
+	}
+
+	void Destroy()
+	{
+		for (size_t i = 0; i < objects.size(); i++)
+		{
+			if (objects[i].Query != 0)
+				glDeleteQueries(1, &objects[i].Query);
+		}
+		objects.clear();
+		glDeleteVertexArrays(1, &boxVao);
+		glDeleteBuffers(1, &boxVbo);
+	}
+
+	// collects every query result the GPU has finished since last frame, without waiting for the rest
+	void BeginFrame()
+	{
+		frame++;
+		Stats.Queries = 0;
+		Stats.Occluded = 0;
+		for (size_t i = 0; i < objects.size(); i++)
+		{
+			ObjectState& object = objects[i];
+			if (!object.Pending)
+				continue;
+			GLuint available = 0;
+			glGetQueryObjectuiv(object.Query, GL_QUERY_RESULT_AVAILABLE, &available);
+			if (!available)
+				continue;
+			GLuint anySamples = 0;
+			glGetQueryObjectuiv(object.Query, GL_QUERY_RESULT, &anySamples);
+			object.Visible = anySamples != 0;
+			object.Pending = false;
+		}
+	}
+
+	// decides whether an object inside the frustum should be drawn this frame
+	bool ShouldDraw(int object)
+	{
+		ObjectState& state = stateOf(object);
+		// objects re-entering the frustum have stale results, so they start out visible
+		if (state.LastSeen + 1 < frame)
+			state.Visible = true;
+		state.LastSeen = frame;
+
+		if (!Enabled || state.Visible)
+			return true;
+		Stats.Occluded++;
+		return false;
+	}
+
+	// true when a drawn object should be wrapped in a query to re-check its visibility
+	bool QueryDue(int object)
+	{
+		if (!Enabled)
+			return false;
+		const ObjectState& state = stateOf(object);
+		// spread re-checks over frames so they don't all land at once
+		return !state.Pending && (frame + object) % VISIBLE_QUERY_INTERVAL == 0;
+	}
+
+	void BeginQuery(int object)
+	{
+		ObjectState& state = stateOf(object);
+		if (state.Query == 0)
+			glGenQueries(1, &state.Query);
+		glBeginQuery(target, state.Query);
+	}
+
+	void EndQuery(int object)
+	{
+		glEndQuery(target);
+		stateOf(object).Pending = true;
+		Stats.Queries++;
+	}
+
+	// queries the bounding boxes of the hidden objects; call after all visible geometry is in the depth buffer
+	void QueryHidden(const std::vector<int>& hiddenObjects, const std::vector<BoundingBox>& worldBounds, glm::vec3 cameraPosition, const glm::mat4& view, const glm::mat4& projection)
+	{
+		if (!Enabled || hiddenObjects.empty())
+			return;
+
+		GLStats::UseProgram(program);
+		GLStats::UniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
+		GLStats::UniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
+		GLStats::BindVertexArray(boxVao);
+		glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+		glDepthMask(GL_FALSE);
+
+		for (size_t i = 0; i < hiddenObjects.size(); i++)
+		{
+			int object = hiddenObjects[i];
+			ObjectState& state = stateOf(object);
+			if (state.Pending)
+				continue;
+
+			// the box would be clipped by the near plane with the camera inside it, so just treat it as visible
+			const BoundingBox& box = worldBounds[i];
+			if (BoundingBox(box.Min - glm::vec3(0.2f), box.Max + glm::vec3(0.2f)).Contains(cameraPosition))
+			{
+				state.Visible = true;
+				continue;
+			}
+
+			glm::mat4 model = glm::translate(box.Center()) * glm::scale(glm::max(box.Extents(), glm::vec3(1e-4f)));
+			GLStats::UniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
+			BeginQuery(object);
+			GLStats::DrawArrays(GL_TRIANGLES, 0, 36);
+			EndQuery(object);
+		}
+
+		glDepthMask(GL_TRUE);
+		glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+		GLStats::BindVertexArray(0);
+	}
+
+private:
+	struct ObjectState {
+		GLuint Query;
+		bool Visible;
+		bool Pending;
+		unsigned int LastSeen;  // last frame the object was inside the frustum
+	};
+
+	std::vector<ObjectState> objects;
+	GLenum target;
+	unsigned int frame;
+	GLuint boxVao, boxVbo;
+	GLuint program;
+	GLint modelLoc, viewLoc, projLoc;
+
+	ObjectState& stateOf(int object)
+	{
+		if ((size_t)object >= objects.size())
+		{
+			ObjectState initial = { 0, true, false, 0 };
+			objects.resize(object + 1, initial);
+		}
+		return objects[object];
+	}
+};
+#endif
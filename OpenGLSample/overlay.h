@@ -0,0 +1,226 @@
+#ifndef OVERLAY_H
+#define OVERLAY_H
+
+#include "gl_loader.h"
+
+#include "streamring.h"
+
+#include <cctype>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Screen text drawn with a built-in 5x7 pixel font (ASCII 0x20-0x5F; lowercase is shown as uppercase).
+// It calls GL directly rather than through GLStats, so drawing the stats doesn't show up in them.
+class TextOverlay
+{
+public:
+	static const int FIRST_CHAR = 0x20;
+	static const int CHAR_COUNT = 64;
+	// glyph cell in font texels: 5x7 glyph plus one column and one row of spacing
+	static const int CELL_WIDTH = 6;
+	static const int CELL_HEIGHT = 8;
+	// clip space xy and texture uv
+	static const int VERTEX_SIZE = 4 * sizeof(GLfloat);
+
+	// screen pixels per font texel
+	int Scale;
+
+	TextOverlay() : Scale(2), program(0), vao(0), ring(nullptr), fontTexture(0)
+	{
+	}
+
+	// the program takes a vec4 (clip space xy, texture uv) at location 0 and a sampler2D "glyphs" whose red
+	// channel is 1 on glyph pixels. The vertices of each frame's text are written into the stream ring.
+	void Init(GLuint textProgram, StreamRing& streamRing)
+	{
+		program = textProgram;
+		ring = &streamRing;
+		glyphsLoc = glGetUniformLocation(program, "glyphs");
+
+		// font columns are bytes with the top row in bit 0; expand them into a one row atlas of cells
+		std::vector<unsigned char> texels(CHAR_COUNT * CELL_WIDTH * CELL_HEIGHT, 0);
+		for (int c = 0; c < CHAR_COUNT; c++)
+		{
+			for (int column = 0; column < 5; column++)
+			{
+				unsigned char bits = font()[c * 5 + column];
+				for (int row = 0; row < 7; row++)
+				{
+					if (bits & (1 << row))
+						texels[row * CHAR_COUNT * CELL_WIDTH + c * CELL_WIDTH + column] = 255;
+				}
+			}
+		}
+		glGenTextures(1, &fontTexture);
+		glBindTexture(GL_TEXTURE_2D, fontTexture);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, CHAR_COUNT * CELL_WIDTH, CELL_HEIGHT, 0, GL_RED, GL_UNSIGNED_BYTE, &texels[0]);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		// the attribute starts at the beginning of the ring; draws pick their vertices with the first vertex
+		glGenVertexArrays(1, &vao);
+		glBindVertexArray(vao);
+		glBindBuffer(GL_ARRAY_BUFFER, ring->Buffer());
+		glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, VERTEX_SIZE, 0);
+		glEnableVertexAttribArray(0);
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	void Destroy()
+	{
+		glDeleteTextures(1, &fontTexture);
+		glDeleteVertexArrays(1, &vao);
+	}
+
+	// draws the lines from the top left corner of the default framebuffer, over whatever was rendered
+	void Draw(const std::vector<std::string>& lines, int framebufferWidth, int framebufferHeight)
+	{
+		if (framebufferWidth <= 0 || framebufferHeight <= 0)
+			return;
+
+		vertices.clear();
+		const float texelWidth = 1.0f / (CHAR_COUNT * CELL_WIDTH);
+		for (size_t line = 0; line < lines.size(); line++)
+		{
+			for (size_t i = 0; i < lines[line].size(); i++)
+			{
+				int c = toupper((unsigned char)lines[line][i]) - FIRST_CHAR;
+				if (c < 0 || c >= CHAR_COUNT)
+					c = '?' - FIRST_CHAR;
+				// one more cell of margin around the text
+				float x0 = (float)((i + 1) * CELL_WIDTH * Scale);
+				float y0 = (float)((line + 1) * CELL_HEIGHT * Scale);
+				float u0 = c * CELL_WIDTH * texelWidth;
+				addQuad(x0, y0, x0 + CELL_WIDTH * Scale, y0 + CELL_HEIGHT * Scale, u0, u0 + CELL_WIDTH * texelWidth, framebufferWidth, framebufferHeight);
+			}
+		}
+		if (vertices.empty())
+			return;
+		GLintptr offset;
+		void* target = ring->Allocate(vertices.size() * sizeof(GLfloat), VERTEX_SIZE, offset);
+		if (!target)
+			return;
+		memcpy(target, &vertices[0], vertices.size() * sizeof(GLfloat));
+
+		glDisable(GL_DEPTH_TEST);
+		glEnable(GL_BLEND);
+		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+		glUseProgram(program);
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, fontTexture);
+		glUniform1i(glyphsLoc, 0);
+		glBindVertexArray(vao);
+		glDrawArrays(GL_TRIANGLES, (GLint)(offset / VERTEX_SIZE), (GLsizei)(vertices.size() / 4));
+		glBindVertexArray(0);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		glUseProgram(0);
+		glDisable(GL_BLEND);
+		glEnable(GL_DEPTH_TEST);
+	}
+
+private:
+	GLuint program;
+	GLint glyphsLoc;
+	GLuint vao;
+	StreamRing* ring;
+	GLuint fontTexture;
+	std::vector<GLfloat> vertices;
+
+	// two triangles for a rectangle given in pixels from the top left
+	void addQuad(float x0, float y0, float x1, float y1, float u0, float u1, int framebufferWidth, int framebufferHeight)
+	{
+		float left = x0 / framebufferWidth * 2.0f - 1.0f;
+		float right = x1 / framebufferWidth * 2.0f - 1.0f;
+		float top = 1.0f - y0 / framebufferHeight * 2.0f;
+		float bottom = 1.0f - y1 / framebufferHeight * 2.0f;
+		const GLfloat quad[] = {
+			left, top, u0, 0.0f,
+			left, bottom, u0, 1.0f,
+			right, bottom, u1, 1.0f,
+			left, top, u0, 0.0f,
+			right, bottom, u1, 1.0f,
+			right, top, u1, 0.0f
+		};
+		vertices.insert(vertices.end(), quad, quad + 24);
+	}
+
+	// classic 5x7 font, five column bytes per character from 0x20 to 0x5F
+	static const unsigned char* font()
+	{
+		static const unsigned char glyphs[CHAR_COUNT * 5] = {
+			0x00, 0x00, 0x00, 0x00, 0x00,  // space
+			0x00, 0x00, 0x5F, 0x00, 0x00,  // !
+			0x00, 0x07, 0x00, 0x07, 0x00,  // "
+			0x14, 0x7F, 0x14, 0x7F, 0x14,  // #
+			0x24, 0x2A, 0x7F, 0x2A, 0x12,  // $
+			0x23, 0x13, 0x08, 0x64, 0x62,  // %
+			0x36, 0x49, 0x56, 0x20, 0x50,  // &
+			0x00, 0x05, 0x03, 0x00, 0x00,  // '
+			0x00, 0x1C, 0x22, 0x41, 0x00,  // (
+			0x00, 0x41, 0x22, 0x1C, 0x00,  // )
+			0x14, 0x08, 0x3E, 0x08, 0x14,  // *
+			0x08, 0x08, 0x3E, 0x08, 0x08,  // +
+			0x00, 0x50, 0x30, 0x00, 0x00,  // ,
+			0x08, 0x08, 0x08, 0x08, 0x08,  // -
+			0x00, 0x60, 0x60, 0x00, 0x00,  // .
+			0x20, 0x10, 0x08, 0x04, 0x02,  // /
+			0x3E, 0x51, 0x49, 0x45, 0x3E,  // 0
+			0x00, 0x42, 0x7F, 0x40, 0x00,  // 1
+			0x42, 0x61, 0x51, 0x49, 0x46,  // 2
+			0x21, 0x41, 0x45, 0x4B, 0x31,  // 3
+			0x18, 0x14, 0x12, 0x7F, 0x10,  // 4
+			0x27, 0x45, 0x45, 0x45, 0x39,  // 5
+			0x3C, 0x4A, 0x49, 0x49, 0x30,  // 6
+			0x01, 0x71, 0x09, 0x05, 0x03,  // 7
+			0x36, 0x49, 0x49, 0x49, 0x36,  // 8
+			0x06, 0x49, 0x49, 0x29, 0x1E,  // 9
+			0x00, 0x36, 0x36, 0x00, 0x00,  // :
+			0x00, 0x56, 0x36, 0x00, 0x00,  // ;
+			0x08, 0x14, 0x22, 0x41, 0x00,  // <
+			0x14, 0x14, 0x14, 0x14, 0x14,  // =
+			0x00, 0x41, 0x22, 0x14, 0x08,  // >
+			0x02, 0x01, 0x51, 0x09, 0x06,  // ?
+			0x32, 0x49, 0x79, 0x41, 0x3E,  // @
+			0x7E, 0x11, 0x11, 0x11, 0x7E,  // A
+			0x7F, 0x49, 0x49, 0x49, 0x36,  // B
+			0x3E, 0x41, 0x41, 0x41, 0x22,  // C
+			0x7F, 0x41, 0x41, 0x22, 0x1C,  // D
+			0x7F, 0x49, 0x49, 0x49, 0x41,  // E
+			0x7F, 0x09, 0x09, 0x09, 0x01,  // F
+			0x3E, 0x41, 0x49, 0x49, 0x7A,  // G
+			0x7F, 0x08, 0x08, 0x08, 0x7F,  // H
+			0x00, 0x41, 0x7F, 0x41, 0x00,  // I
+			0x20, 0x40, 0x41, 0x3F, 0x01,  // J
+			0x7F, 0x08, 0x14, 0x22, 0x41,  // K
+			0x7F, 0x40, 0x40, 0x40, 0x40,  // L
+			0x7F, 0x02, 0x0C, 0x02, 0x7F,  // M
+			0x7F, 0x04, 0x08, 0x10, 0x7F,  // N
+			0x3E, 0x41, 0x41, 0x41, 0x3E,  // O
+			0x7F, 0x09, 0x09, 0x09, 0x06,  // P
+			0x3E, 0x41, 0x51, 0x21, 0x5E,  // Q
+			0x7F, 0x09, 0x19, 0x29, 0x46,  // R
+			0x46, 0x49, 0x49, 0x49, 0x31,  // S
+			0x01, 0x01, 0x7F, 0x01, 0x01,  // T
+			0x3F, 0x40, 0x40, 0x40, 0x3F,  // U
+			0x1F, 0x20, 0x40, 0x20, 0x1F,  // V
+			0x3F, 0x40, 0x38, 0x40, 0x3F,  // W
+			0x63, 0x14, 0x08, 0x14, 0x63,  // X
+			0x07, 0x08, 0x70, 0x08, 0x07,  // Y
+			0x61, 0x51, 0x49, 0x45, 0x43,  // Z
+			0x00, 0x7F, 0x41, 0x41, 0x00,  // [
+			0x02, 0x04, 0x08, 0x10, 0x20,  // backslash
+			0x00, 0x41, 0x41, 0x7F, 0x00,  // ]
+			0x04, 0x02, 0x01, 0x02, 0x04,  // ^
+			0x40, 0x40, 0x40, 0x40, 0x40   // _
+		};
+		return glyphs;
+	}
+};
+#endif
@@ -0,0 +1,357 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include "gl_loader.h"
+
+#include "timing.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Last SIZE samples of one timing, in milliseconds
+class RollingHistogram
+{
+public:
+	static const int SIZE = 240;
+
+	RollingHistogram() : next(0), count(0)
+	{
+	}
+
+	void Add(double milliseconds)
+	{
+		samples[next] = milliseconds;
+		next = (next + 1) % SIZE;
+		if (count < SIZE)
+			count++;
+	}
+
+	int Count() const
+	{
+		return count;
+	}
+
+	double Average() const
+	{
+		double sum = 0.0;
+		for (int i = 0; i < count; i++)
+			sum += samples[i];
+		return count > 0 ? sum / count : 0.0;
+	}
+
+	// value below which the given fraction of the samples fall, e.g. 0.95 for the 95th percentile
+	double Percentile(double fraction) const
+	{
+		if (count == 0)
+			return 0.0;
+		std::vector<double> sorted(samples, samples + count);
+		size_t index = std::min((size_t)(fraction * (count - 1) + 0.5), sorted.size() - 1);
+		std::nth_element(sorted.begin(), sorted.begin() + index, sorted.end());
+		return sorted[index];
+	}
+
+	// counts the samples into bucketCount buckets of bucketWidth ms, the last one also taking everything above
+	void Buckets(double bucketWidth, int bucketCount, std::vector<int>& buckets) const
+	{
+		buckets.assign(bucketCount, 0);
+		for (int i = 0; i < count; i++)
+			buckets[std::min((int)(samples[i] / bucketWidth), bucketCount - 1)]++;
+	}
+
+private:
+	double samples[SIZE];
+	int next;
+	int count;
+};
+
+// Frame profiler with CPU scopes (steady clock) and GPU scopes (GL_TIMESTAMP queries).
+// GPU queries go into a ring of GPU_FRAMES frames and are only read back once the GPU reports them
+// available, GPU_FRAMES - 1 frames later, so profiling never stalls the pipeline; results still missing
+// by then are dropped. Every scope feeds a rolling histogram, and the recent events can be written as
+// Chrome trace JSON (chrome://tracing, Perfetto) with one track per CPU thread plus one for the GPU.
+class Profiler
+{
+public:
+	static const int GPU_FRAMES = 4;
+	static const int MAX_GPU_SCOPES = 16;
+	// events kept for the trace, oldest dropped first (a few seconds of frames)
+	static const size_t TRACE_EVENTS = 20000;
+	// track id of the GPU in the trace
+	static const int GPU_TRACK = 1000;
+
+	bool Enabled;
+	// GPU scopes whose results weren't ready in time
+	unsigned int DroppedGpuScopes;
+
+	Profiler() : Enabled(true), DroppedGpuScopes(0), frameIndex(0), gpuOffset(0), initialized(false)
+	{
+	}
+
+	// creates the timer queries; needs a current GL context
+	void Init()
+	{
+		for (int frame = 0; frame < GPU_FRAMES; frame++)
+		{
+			glGenQueries(MAX_GPU_SCOPES * 2, gpuFrames[frame].Queries);
+			gpuFrames[frame].Count = 0;
+		}
+		// line the GPU clock up with ours so both share one timeline in the trace
+		GLint64 gpuNow = 0;
+		glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+		gpuOffset = FrameClock::Now() - gpuNow;
+		initialized = true;
+	}
+
+	void Destroy()
+	{
+		if (!initialized)
+			return;
+		for (int frame = 0; frame < GPU_FRAMES; frame++)
+			glDeleteQueries(MAX_GPU_SCOPES * 2, gpuFrames[frame].Queries);
+		initialized = false;
+	}
+
+	// moves the GPU ring to the next frame, first collecting the results that frame slot held
+	void BeginFrame()
+	{
+		if (!initialized)
+			return;
+		frameIndex = (frameIndex + 1) % GPU_FRAMES;
+		collectGpu(gpuFrames[frameIndex]);
+		gpuFrames[frameIndex].Count = 0;
+	}
+
+	// CPU scope: call EndCpu with the returned start time, usually through ProfileScope
+	int64_t BeginCpu() const
+	{
+		return FrameClock::Now();
+	}
+
+	void EndCpu(const char* name, int64_t start)
+	{
+		if (!Enabled)
+			return;
+		int64_t end = FrameClock::Now();
+		std::lock_guard<std::mutex> lock(mutex);
+		record(name, trackOf(std::this_thread::get_id()), start, end, cpuHistograms);
+	}
+
+	// GPU scope on the GL thread: returns a handle for EndGpu, or -1 when the frame is out of queries
+	int BeginGpu(const char* name)
+	{
+		GpuFrame& frame = gpuFrames[frameIndex];
+		if (!Enabled || !initialized || frame.Count >= MAX_GPU_SCOPES)
+			return -1;
+		int scope = frame.Count++;
+		frame.Names[scope] = name;
+		frame.Ended[scope] = false;
+		frame.Last = scope * 2;
+		glQueryCounter(frame.Queries[frame.Last], GL_TIMESTAMP);
+		return scope;
+	}
+
+	void EndGpu(int scope)
+	{
+		if (scope < 0)
+			return;
+		GpuFrame& frame = gpuFrames[frameIndex];
+		frame.Ended[scope] = true;
+		frame.Last = scope * 2 + 1;
+		glQueryCounter(frame.Queries[frame.Last], GL_TIMESTAMP);
+	}
+
+	// rolling timings of a scope, or nullptr when it never ran; call between frames, not while jobs record
+	const RollingHistogram* CpuHistogram(const std::string& name) const
+	{
+		std::map<std::string, RollingHistogram>::const_iterator found = cpuHistograms.find(name);
+		return found == cpuHistograms.end() ? nullptr : &found->second;
+	}
+
+	const RollingHistogram* GpuHistogram(const std::string& name) const
+	{
+		std::map<std::string, RollingHistogram>::const_iterator found = gpuHistograms.find(name);
+		return found == gpuHistograms.end() ? nullptr : &found->second;
+	}
+
+	// one line per scope: average, median, 95th percentile and worst of the recent samples
+	void PrintSummary(std::ostream& out)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		printHistograms(out, "cpu", cpuHistograms);
+		printHistograms(out, "gpu", gpuHistograms);
+	}
+
+	// writes the recorded events in the Chrome trace event format
+	bool WriteChromeTrace(const char* path)
+	{
+		FILE* file = fopen(path, "w");
+		if (!file)
+			return false;
+
+		std::lock_guard<std::mutex> lock(mutex);
+		fprintf(file, "{\"traceEvents\":[\n");
+		fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"GPU\"}}", GPU_TRACK);
+		for (std::map<std::thread::id, int>::const_iterator track = tracks.begin(); track != tracks.end(); ++track)
+			fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"CPU %d\"}}", track->second, track->second);
+		for (size_t i = 0; i < events.size(); i++)
+		{
+			const Event& event = events[i];
+			// trace timestamps are microseconds
+			fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+				event.Name, event.Track, event.Start / 1000.0, (event.End - event.Start) / 1000.0);
+		}
+		fprintf(file, "\n]}\n");
+		return fclose(file) == 0;
+	}
+
+private:
+	struct Event {
+		const char* Name;
+		int Track;
+		int64_t Start;  // nanoseconds on the frame clock
+		int64_t End;
+	};
+
+	struct GpuFrame {
+		GLuint Queries[MAX_GPU_SCOPES * 2];  // begin/end timestamp pairs
+		const char* Names[MAX_GPU_SCOPES];
+		bool Ended[MAX_GPU_SCOPES];
+		int Count;
+		int Last;  // query issued last; with nested scopes that is an outer scope's end, not the last pair's
+	};
+
+	GpuFrame gpuFrames[GPU_FRAMES];
+	int frameIndex;
+	int64_t gpuOffset;
+	bool initialized;
+
+	std::mutex mutex;
+	std::deque<Event> events;
+	std::map<std::thread::id, int> tracks;
+	std::map<std::string, RollingHistogram> cpuHistograms;
+	std::map<std::string, RollingHistogram> gpuHistograms;
+
+	// small stable ids for threads, in order of first appearance; the caller holds the lock
+	int trackOf(std::thread::id thread)
+	{
+		std::map<std::thread::id, int>::iterator found = tracks.find(thread);
+		if (found != tracks.end())
+			return found->second;
+		int track = (int)tracks.size();
+		tracks[thread] = track;
+		return track;
+	}
+
+	void record(const char* name, int track, int64_t start, int64_t end, std::map<std::string, RollingHistogram>& histograms)
+	{
+		Event event = { name, track, start, end };
+		events.push_back(event);
+		if (events.size() > TRACE_EVENTS)
+			events.pop_front();
+		histograms[name].Add((end - start) / 1e6);
+	}
+
+	void collectGpu(GpuFrame& frame)
+	{
+		if (frame.Count == 0)
+			return;
+		// queries complete in order, so the one issued last being available means all are
+		GLint available = 0;
+		glGetQueryObjectiv(frame.Queries[frame.Last], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available)
+		{
+			DroppedGpuScopes += frame.Count;
+			return;
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+		for (int scope = 0; scope < frame.Count; scope++)
+		{
+			// a scope left open has no end query to read
+			if (!frame.Ended[scope])
+			{
+				DroppedGpuScopes++;
+				continue;
+			}
+			GLuint64 begin = 0, end = 0;
+			glGetQueryObjectui64v(frame.Queries[scope * 2], GL_QUERY_RESULT, &begin);
+			glGetQueryObjectui64v(frame.Queries[scope * 2 + 1], GL_QUERY_RESULT, &end);
+			record(frame.Names[scope], GPU_TRACK, (int64_t)begin + gpuOffset, (int64_t)end + gpuOffset, gpuHistograms);
+		}
+	}
+
+	static void printHistograms(std::ostream& out, const char* kind, const std::map<std::string, RollingHistogram>& histograms)
+	{
+		char line[160];
+		for (std::map<std::string, RollingHistogram>::const_iterator scope = histograms.begin(); scope != histograms.end(); ++scope)
+		{
+			const RollingHistogram& histogram = scope->second;
+			snprintf(line, sizeof(line), "%s %-16s avg %7.3f ms  p50 %7.3f  p95 %7.3f  max %7.3f  (%d samples)",
+				kind, scope->first.c_str(), histogram.Average(), histogram.Percentile(0.5), histogram.Percentile(0.95), histogram.Percentile(1.0), histogram.Count());
+			out << line << std::endl;
+		}
+	}
+};
+
+// Times the enclosing block on the CPU, or up to an earlier End()
+class ProfileScope
+{
+public:
+	ProfileScope(Profiler& profiler, const char* name) : profiler(profiler), name(name), start(profiler.BeginCpu()), open(true)
+	{
+	}
+
+	~ProfileScope()
+	{
+		End();
+	}
+
+	void End()
+	{
+		if (!open)
+			return;
+		profiler.EndCpu(name, start);
+		open = false;
+	}
+
+private:
+	Profiler& profiler;
+	const char* name;
+	int64_t start;
+	bool open;
+};
+
+// Times the enclosing block, or up to an earlier End(), on both the CPU and the GPU; GL thread only
+class GpuProfileScope
+{
+public:
+	GpuProfileScope(Profiler& profiler, const char* name) : cpu(profiler, name), profiler(profiler), scope(profiler.BeginGpu(name))
+	{
+	}
+
+	~GpuProfileScope()
+	{
+		End();
+	}
+
+	void End()
+	{
+		profiler.EndGpu(scope);
+		scope = -1;
+		cpu.End();
+	}
+
+private:
+	ProfileScope cpu;
+	Profiler& profiler;
+	int scope;
+};
+#endif
@@ -0,0 +1,297 @@
+#ifndef REGRESSION_H
+#define REGRESSION_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// 8 bit RGB image, top row first
+struct RegressionImage {
+	int Width;
+	int Height;
+	std::vector<unsigned char> Pixels;
+
+	RegressionImage() : Width(0), Height(0)
+	{
+	}
+
+	// binary PPM (P6): dependency free and opens in most image viewers
+	bool WritePpm(const std::string& path) const
+	{
+		FILE* file = fopen(path.c_str(), "wb");
+		if (!file)
+			return false;
+		fprintf(file, "P6\n%d %d\n255\n", Width, Height);
+		fwrite(Pixels.data(), 1, Pixels.size(), file);
+		return fclose(file) == 0;
+	}
+
+	bool ReadPpm(const std::string& path)
+	{
+		FILE* file = fopen(path.c_str(), "rb");
+		if (!file)
+			return false;
+		int maxValue = 0;
+		bool valid = fscanf(file, "P6 %d %d %d", &Width, &Height, &maxValue) == 3 && maxValue == 255 && Width > 0 && Height > 0;
+		// exactly one whitespace character separates the header from the pixels
+		if (valid)
+		{
+			fgetc(file);
+			Pixels.resize((size_t)Width * Height * 3);
+			valid = fread(&Pixels[0], 1, Pixels.size(), file) == Pixels.size();
+		}
+		fclose(file);
+		return valid;
+	}
+};
+
+// How far a rendered image is from its golden
+struct ImageDiff {
+	bool SizeMatches;
+	int DifferentPixels;   // pixels with a channel off by more than the threshold
+	int MaxDifference;     // largest channel difference anywhere
+	double Psnr;           // peak signal to noise ratio in dB, infinite for identical images
+};
+
+inline ImageDiff CompareImages(const RegressionImage& image, const RegressionImage& golden, int threshold)
+{
+	ImageDiff diff = { image.Width == golden.Width && image.Height == golden.Height, 0, 0, INFINITY };
+	if (!diff.SizeMatches)
+		return diff;
+	double squaredError = 0.0;
+	for (size_t pixel = 0; pixel < image.Pixels.size(); pixel += 3)
+	{
+		int worst = 0;
+		for (int channel = 0; channel < 3; channel++)
+		{
+			int difference = std::abs(image.Pixels[pixel + channel] - golden.Pixels[pixel + channel]);
+			worst = std::max(worst, difference);
+			squaredError += difference * difference;
+		}
+		if (worst > threshold)
+			diff.DifferentPixels++;
+		diff.MaxDifference = std::max(diff.MaxDifference, worst);
+	}
+	if (squaredError > 0.0)
+		diff.Psnr = 10.0 * std::log10(255.0 * 255.0 * image.Pixels.size() / squaredError);
+	return diff;
+}
+
+// Distribution of one case's frame times in milliseconds
+struct FrameTimeStats {
+	double Mean;
+	double Median;
+	double P95;
+	double P99;
+	double Max;
+
+	static FrameTimeStats Of(std::vector<double> samples)
+	{
+		FrameTimeStats stats = { 0.0, 0.0, 0.0, 0.0, 0.0 };
+		if (samples.empty())
+			return stats;
+		std::sort(samples.begin(), samples.end());
+		for (size_t i = 0; i < samples.size(); i++)
+			stats.Mean += samples[i];
+		stats.Mean /= samples.size();
+		stats.Median = percentile(samples, 0.5);
+		stats.P95 = percentile(samples, 0.95);
+		stats.P99 = percentile(samples, 0.99);
+		stats.Max = samples.back();
+		return stats;
+	}
+
+private:
+	static double percentile(const std::vector<double>& sorted, double fraction)
+	{
+		return sorted[std::min((size_t)(fraction * (sorted.size() - 1) + 0.5), sorted.size() - 1)];
+	}
+};
+
+// Render regression gate. Every case (a resolution and light count) hands in its frame times and final
+// image; the image is checked against its golden and the frame times against the machine's performance
+// baseline. The image is also compared with the same frame rendered without occlusion culling, which
+// must look the same; that check doesn't depend on the goldens, so it still catches objects culled by
+// mistake when the goldens were recorded from broken output. The files are:
+//   <golden directory>/golden_<case>.ppm   expected image, kept in the source tree
+//   <results directory>/baselines.txt      one "<case> <median ms> <p95 ms>" line per case
+// Frame times only compare on the machine they were taken on, so baselines live with the results.
+// Nothing is recorded unless asked: a case without a golden fails, and one without a baseline passes
+// with its frame times unchecked. RecordGoldens and RecordBaselines write them after an intended change.
+// Finish writes report.txt, the frame_times.csv samples and any rendered image that failed as
+// actual_<case>.ppm into the results directory.
+class RegressionSuite
+{
+public:
+	// allowed slowdown of the median and 95th percentile over the baseline, as a fraction
+	double Tolerance;
+	// channel difference still counted as equal, absorbs rounding differences between rasterizer builds
+	int PixelThreshold;
+	// fraction of the pixels allowed to differ beyond the threshold
+	double MaxDifferentFraction;
+	// write the rendered images as the goldens instead of comparing against them
+	bool RecordGoldens;
+	// write the frame times as this machine's baselines instead of checking against them
+	bool RecordBaselines;
+
+	RegressionSuite(const std::string& goldenDirectory, const std::string& resultsDirectory) : Tolerance(0.25), PixelThreshold(2),
+		MaxDifferentFraction(0.001), RecordGoldens(false), RecordBaselines(false), goldenDirectory(goldenDirectory),
+		resultsDirectory(resultsDirectory), baselinesChanged(false)
+	{
+		std::ifstream file(path("baselines.txt").c_str());
+		std::string line;
+		while (std::getline(file, line))
+		{
+			std::istringstream fields(line);
+			std::string name;
+			Baseline baseline;
+			if (line.empty() || line[0] == '#' || !(fields >> name >> baseline.Median >> baseline.P95))
+				continue;
+			baselines[name] = baseline;
+		}
+	}
+
+	// checks one case and returns whether it passed; unculled is the frame rendered without occlusion culling
+	bool Check(const std::string& name, const std::vector<double>& frameTimes, const RegressionImage& image, const RegressionImage& unculled)
+	{
+		Result result;
+		result.Name = name;
+		result.FrameTimes = frameTimes;
+		result.Stats = FrameTimeStats::Of(frameTimes);
+		result.Passed = true;
+
+		std::map<std::string, Baseline>::iterator baseline = baselines.find(name);
+		if (RecordBaselines)
+		{
+			Baseline recorded = { result.Stats.Median, result.Stats.P95 };
+			baselines[name] = recorded;
+			baselinesChanged = true;
+			result.Notes += " perf baseline recorded;";
+		}
+		else if (baseline == baselines.end())
+		{
+			result.Notes += " perf unchecked, no baseline;";
+		}
+		else if (result.Stats.Median > baseline->second.Median * (1.0 + Tolerance) || result.Stats.P95 > baseline->second.P95 * (1.0 + Tolerance))
+		{
+			char note[128];
+			snprintf(note, sizeof(note), " SLOWER than baseline (median %.3f ms, p95 %.3f ms);", baseline->second.Median, baseline->second.P95);
+			result.Notes += note;
+			result.Passed = false;
+		}
+
+		std::string goldenPath = goldenDirectory + "/golden_" + name + ".ppm";
+		RegressionImage golden;
+		if (RecordGoldens)
+		{
+			if (image.WritePpm(goldenPath))
+				result.Notes += " golden recorded;";
+			else
+			{
+				result.Notes += " FAILED to write golden;";
+				result.Passed = false;
+			}
+		}
+		else if (!golden.ReadPpm(goldenPath))
+		{
+			result.Notes += " NO GOLDEN;";
+			image.WritePpm(path("actual_" + name + ".ppm"));
+			result.Passed = false;
+		}
+		else
+		{
+			ImageDiff diff = CompareImages(image, golden, PixelThreshold);
+			char note[128];
+			if (!diff.SizeMatches)
+				snprintf(note, sizeof(note), " IMAGE size %dx%d, golden %dx%d;", image.Width, image.Height, golden.Width, golden.Height);
+			else
+				snprintf(note, sizeof(note), " image %d pixels differ (max %d, psnr %.1f dB);", diff.DifferentPixels, diff.MaxDifference, diff.Psnr);
+			result.Notes += note;
+			if (!diff.SizeMatches || diff.DifferentPixels > MaxDifferentFraction * image.Width * image.Height)
+			{
+				result.Notes += " IMAGE MISMATCH;";
+				image.WritePpm(path("actual_" + name + ".ppm"));
+				result.Passed = false;
+			}
+		}
+
+		// culling may only skip what wouldn't be seen; this is checked even while re-recording the goldens
+		ImageDiff culled = CompareImages(image, unculled, PixelThreshold);
+		if (!culled.SizeMatches || culled.DifferentPixels > MaxDifferentFraction * image.Width * image.Height)
+		{
+			char note[96];
+			snprintf(note, sizeof(note), " CULLING changed %d pixels;", culled.DifferentPixels);
+			result.Notes += note;
+			image.WritePpm(path("actual_" + name + ".ppm"));
+			unculled.WritePpm(path("unculled_" + name + ".ppm"));
+			result.Passed = false;
+		}
+
+		results.push_back(result);
+		return result.Passed;
+	}
+
+	// writes the report, the samples and changed baselines; returns whether every case passed
+	bool Finish(std::ostream& out)
+	{
+		bool passed = true;
+		std::ofstream report(path("report.txt").c_str());
+		std::ofstream samples(path("frame_times.csv").c_str());
+		samples << "case,frame,ms\n";
+		for (size_t i = 0; i < results.size(); i++)
+		{
+			const Result& result = results[i];
+			char line[512];
+			snprintf(line, sizeof(line), "%s %-20s mean %7.3f  p50 %7.3f  p95 %7.3f  p99 %7.3f  max %7.3f ms |%s",
+				result.Passed ? "PASS" : "FAIL", result.Name.c_str(), result.Stats.Mean, result.Stats.Median, result.Stats.P95,
+				result.Stats.P99, result.Stats.Max, result.Notes.c_str());
+			out << line << std::endl;
+			report << line << "\n";
+			for (size_t frame = 0; frame < result.FrameTimes.size(); frame++)
+				samples << result.Name << "," << frame << "," << result.FrameTimes[frame] << "\n";
+			passed = passed && result.Passed;
+		}
+
+		if (baselinesChanged)
+		{
+			std::ofstream file(path("baselines.txt").c_str());
+			file << "# case median_ms p95_ms\n";
+			for (std::map<std::string, Baseline>::const_iterator baseline = baselines.begin(); baseline != baselines.end(); ++baseline)
+				file << baseline->first << " " << baseline->second.Median << " " << baseline->second.P95 << "\n";
+		}
+		return passed;
+	}
+
+private:
+	struct Baseline {
+		double Median;
+		double P95;
+	};
+
+	struct Result {
+		std::string Name;
+		std::vector<double> FrameTimes;
+		FrameTimeStats Stats;
+		std::string Notes;
+		bool Passed;
+	};
+
+	std::string goldenDirectory;
+	std::string resultsDirectory;
+	std::map<std::string, Baseline> baselines;
+	bool baselinesChanged;
+	std::vector<Result> results;
+
+	std::string path(const std::string& file) const
+	{
+		return resultsDirectory + "/" + file;
+	}
+};
+#endif
@@ -0,0 +1,113 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include "gl_loader.h"
+
+#include <glm/glm.hpp>
+
+#include "jobs.h"
+
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+// Everything the GL thread needs to issue one draw, recorded without touching GL
+struct DrawPacket {
+	unsigned long long SortKey;  // packets are replayed in ascending key order
+	glm::mat4 Model;
+	GLuint Vao;
+	GLuint Texture;
+	GLuint FirstIndex;           // first index (or vertex for unindexed draws)
+	GLuint Count;                // index (or vertex) count
+	int Node;                    // scene node the packet draws
+	unsigned char Flags;
+};
+
+// Packet flags
+const unsigned char DRAW_PACKET_LAMP = 1;      // unlit lamp shader, unindexed
+const unsigned char DRAW_PACKET_HIDDEN = 2;    // found occluded while recording, submitted with no instances
+
+// Builds a sort key grouping packets by pass, then texture, then vertex array, then front to back. With
+// frontToBack the opaque packets are ordered front to back first, so the depth test rejects hidden fragments
+// before they are shaded, at the price of more state changes.
+inline unsigned long long MakeSortKey(bool lamp, GLuint texture, GLuint vao, float viewDepth, bool frontToBack = false)
+{
+	// depth quantized over [0, 128) world units, farther objects clamp to the last bucket
+	float depth = std::min(std::max(viewDepth, 0.0f) * 512.0f, 65535.0f);
+	if (frontToBack && !lamp)
+	{
+		return ((unsigned long long)depth << 47)
+			| ((unsigned long long)(texture & 0xFFFFFF) << 23)
+			| (unsigned long long)(vao & 0x7FFFFF);
+	}
+	return ((unsigned long long)(lamp ? 1 : 0) << 63)
+		| ((unsigned long long)(texture & 0xFFFFFF) << 39)
+		| ((unsigned long long)(vao & 0x7FFFFF) << 16)
+		| (unsigned long long)depth;
+}
+
+// Records draw packets on the job system's threads and hands the GL thread one sorted list to replay.
+// Every thread appends to its own packet list, so recording needs no locks, and the lists are merged
+// once all tasks are finished.
+class RenderQueue
+{
+public:
+	// callback recording one task; slot identifies the thread for per-thread scratch data
+	typedef std::function<void(int task, int slot, std::vector<DrawPacket>& packets)> RecordFunction;
+
+	// merged packets of the last Record, sorted by key
+	std::vector<DrawPacket> Packets;
+
+	RenderQueue() : jobs(nullptr)
+	{
+	}
+
+	// records on the given job system; without one all recording stays on the calling thread
+	void Init(JobSystem* jobSystem)
+	{
+		jobs = jobSystem;
+	}
+
+	// threads that may record packets
+	int SlotCount() const
+	{
+		return jobs ? jobs->ThreadCount() : 1;
+	}
+
+	// runs record for every task in [0, count) and blocks until all are done
+	void Record(int count, const RecordFunction& record)
+	{
+		slotPackets.resize(SlotCount());
+		for (size_t i = 0; i < slotPackets.size(); i++)
+			slotPackets[i].clear();
+
+		if (jobs)
+		{
+			jobs->ParallelFor(count, 1, [this, &record](int begin, int end)
+			{
+				int slot = JobSystem::CurrentThread();
+				for (int task = begin; task < end; task++)
+					record(task, slot, slotPackets[slot]);
+			});
+		}
+		else
+		{
+			for (int task = 0; task < count; task++)
+				record(task, 0, slotPackets[0]);
+		}
+
+		Packets.clear();
+		for (size_t i = 0; i < slotPackets.size(); i++)
+			Packets.insert(Packets.end(), slotPackets[i].begin(), slotPackets[i].end());
+		// ties are broken by node so the order doesn't depend on which thread recorded what
+		std::sort(Packets.begin(), Packets.end(), [](const DrawPacket& a, const DrawPacket& b)
+		{
+			return a.SortKey != b.SortKey ? a.SortKey < b.SortKey : a.Node < b.Node;
+		});
+	}
+
+private:
+	JobSystem* jobs;
+	std::vector<std::vector<DrawPacket> > slotPackets;
+};
+#endif
@@ -0,0 +1,180 @@
+#ifndef RESOLUTION_H
+#define RESOLUTION_H
+
+#include "gl_loader.h"
+
+#include "framebuffers.h"
+#include "glstats.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Picks the render scale from the measured GPU frame time with a PID controller. It controls the fraction
+// of the output's pixels that are rendered (GPU time grows about linearly with it) and reports the matching
+// scale per axis, in steps so small errors don't resize the render target every frame.
+class ResolutionController
+{
+public:
+	float MinScale;
+	float MaxScale;
+	float StepSize;             // the scale moves in multiples of this
+	// gains on the error as a fraction of the target time; the update is incremental, so the output
+	// limits stop the integral from winding up
+	float Proportional, Integral, Derivative;
+	float Headroom;             // the target is this fraction of the frame budget
+	float Deadband;             // errors below this fraction of the target are ignored
+
+	ResolutionController() : MinScale(0.5f), MaxScale(1.0f), StepSize(0.05f), Proportional(0.2f), Integral(0.05f), Derivative(0.05f),
+		Headroom(0.9f), Deadband(0.05f), area(1.0f), lastError(0.0f), lastLastError(0.0f)
+	{
+	}
+
+	// feeds one GPU frame time measurement against a frame budget, both in milliseconds
+	void Update(double gpuMilliseconds, double budgetMilliseconds)
+	{
+		double target = budgetMilliseconds * Headroom;
+		if (target <= 0.0 || gpuMilliseconds <= 0.0)
+			return;
+		float error = (float)((target - gpuMilliseconds) / target);
+		if (std::fabs(error) < Deadband)
+			error = 0.0f;
+		area += Proportional * (error - lastError) + Integral * error + Derivative * (error - 2.0f * lastError + lastLastError);
+		area = std::min(std::max(area, MinScale * MinScale), MaxScale * MaxScale);
+		lastLastError = lastError;
+		lastError = error;
+	}
+
+	// starts again from the full resolution
+	void Reset()
+	{
+		area = MaxScale * MaxScale;
+		lastError = lastLastError = 0.0f;
+	}
+
+	// scale per axis, rounded down to a step
+	float Scale() const
+	{
+		float steps = std::floor(std::sqrt(area) / StepSize + 0.001f);
+		return std::min(std::max(steps * StepSize, MinScale), MaxScale);
+	}
+
+private:
+	float area;
+	float lastError, lastLastError;
+};
+
+// Offscreen color and depth target for rendering at a fraction of the output resolution. The textures come
+// from the framebuffer manager at the output's size class and the scene renders into the lower left
+// RenderWidth x RenderHeight of them, so changing the scale never reallocates. Upscale then fills the default
+// framebuffer with a Catmull-Rom bicubic filter, which keeps edges sharper than a bilinear stretch.
+class ScaledRenderTarget
+{
+public:
+	int RenderWidth, RenderHeight;
+
+	ScaledRenderTarget() : RenderWidth(0), RenderHeight(0), framebuffers(nullptr), outputWidth(0), outputHeight(0), width(0), height(0), fbo(0),
+		colorTexture(0), depthTexture(0), emptyVao(0)
+	{
+	}
+
+	// the program draws a fullscreen triangle from gl_VertexID and takes a sampler2D "source", a vec2
+	// "sourceSize" (the rendered size) and a vec2 "outputSize"
+	void Init(GLuint upscaleProgram, FramebufferManager& framebufferManager)
+	{
+		program = upscaleProgram;
+		framebuffers = &framebufferManager;
+		sourceSizeLoc = glGetUniformLocation(program, "sourceSize");
+		outputSizeLoc = glGetUniformLocation(program, "outputSize");
+		GLStats::UseProgram(program);
+		GLStats::Uniform1i(glGetUniformLocation(program, "source"), 0);
+		GLStats::UseProgram(0);
+		glGenVertexArrays(1, &emptyVao);
+		glGenFramebuffers(1, &fbo);
+	}
+
+	void Destroy()
+	{
+		release();
+		glDeleteVertexArrays(1, &emptyVao);
+		glDeleteFramebuffers(1, &fbo);
+	}
+
+	// binds the target (with new textures when the output size moved to another size class) with a viewport
+	// of the output size times scale, and clears it
+	void Begin(int framebufferWidth, int framebufferHeight, float scale)
+	{
+		if (FramebufferManager::SizeClass(framebufferWidth) != width || FramebufferManager::SizeClass(framebufferHeight) != height)
+			allocate(framebufferWidth, framebufferHeight);
+		outputWidth = framebufferWidth;
+		outputHeight = framebufferHeight;
+		RenderWidth = std::max(1, (int)(outputWidth * scale + 0.5f));
+		RenderHeight = std::max(1, (int)(outputHeight * scale + 0.5f));
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+		glViewport(0, 0, RenderWidth, RenderHeight);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	}
+
+	// draws the rendered region over the whole default framebuffer; leaves it bound with the output viewport
+	void Upscale()
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		glViewport(0, 0, outputWidth, outputHeight);
+		glDisable(GL_DEPTH_TEST);
+		GLStats::UseProgram(program);
+		GLStats::BindVertexArray(emptyVao);
+		glActiveTexture(GL_TEXTURE0);
+		GLStats::BindTexture(GL_TEXTURE_2D, colorTexture);
+		GLStats::Uniform2f(sourceSizeLoc, (float)RenderWidth, (float)RenderHeight);
+		GLStats::Uniform2f(outputSizeLoc, (float)outputWidth, (float)outputHeight);
+		GLStats::DrawArrays(GL_TRIANGLES, 0, 3);
+		GLStats::BindTexture(GL_TEXTURE_2D, 0);
+		GLStats::BindVertexArray(0);
+		GLStats::UseProgram(0);
+		glEnable(GL_DEPTH_TEST);
+	}
+
+	GLuint Framebuffer() const
+	{
+		return fbo;
+	}
+
+private:
+	FramebufferManager* framebuffers;
+	int outputWidth, outputHeight;
+	int width, height;          // size classes of the textures
+	GLuint fbo;
+	GLuint colorTexture, depthTexture;
+	GLuint emptyVao;
+	GLuint program;
+	GLint sourceSizeLoc, outputSizeLoc;
+
+	void release()
+	{
+		if (colorTexture != 0)
+			framebuffers->Release(colorTexture);
+		if (depthTexture != 0)
+			framebuffers->Release(depthTexture);
+		colorTexture = depthTexture = 0;
+	}
+
+	void allocate(int framebufferWidth, int framebufferHeight)
+	{
+		release();
+		width = FramebufferManager::SizeClass(framebufferWidth);
+		height = FramebufferManager::SizeClass(framebufferHeight);
+
+		// bilinear taps do most of the bicubic filter; depth matches the default framebuffer's so the
+		// deferred and Hi-Z depth blits work from either
+		colorTexture = framebuffers->Acquire(GL_RGBA8, width, height);
+		GLStats::BindTexture(GL_TEXTURE_2D, colorTexture);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		GLStats::BindTexture(GL_TEXTURE_2D, 0);
+		depthTexture = framebuffers->Acquire(GL_DEPTH24_STENCIL8, width, height);
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTexture, 0);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+};
+#endif
@@ -0,0 +1,186 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "bounds.h"
+#include "bvh.h"
+#include "jobs.h"
+#include "transforms.h"
+
+#include <string>
+#include <vector>
+
+// A node of the scene graph. Nodes with a Renderable index are leaves of the culling BVH,
+// nodes without one only group their children under a shared transform.
+// The node's transform is entry [node index] of the scene's TransformStore.
+struct SceneNode {
+	std::string Name;
+	int Parent;
+	std::vector<int> Children;
+	BoundingBox LocalBounds;
+	// result of the last Update
+	BoundingBox WorldBounds;
+	// index into the application's renderable table, -1 for pure transform groups
+	int Renderable;
+	// BVH item of this node, -1 when it has no bounds of its own
+	int Item;
+};
+
+// Scene graph with a BVH over the renderable nodes, rebuilt when the structure changes
+// and refit when transforms change.
+class Scene
+{
+public:
+	std::vector<SceneNode> Nodes;
+	// local transforms and world matrices of the nodes, same indices
+	TransformStore Transforms;
+	Bvh Hierarchy;
+
+	// adds a node under the given parent (-1 for a root) and returns its index
+	int AddNode(const std::string& name, int parent, glm::vec3 position, glm::vec3 scale, float rotationAngle, glm::vec3 rotationAxis, int renderable = -1, const BoundingBox& localBounds = BoundingBox())
+	{
+		SceneNode node;
+		node.Name = name;
+		node.Parent = parent;
+		node.LocalBounds = localBounds;
+		node.Renderable = renderable;
+		node.Item = -1;
+
+		int index = (int)Nodes.size();
+		Nodes.push_back(node);
+		Transforms.Add(position, rotation(rotationAngle, rotationAxis), scale, parent);
+		if (parent >= 0)
+			Nodes[parent].Children.push_back(index);
+		structureChanged = true;
+		return index;
+	}
+
+	// moves a node; its subtree is recomputed and refit on the next Update
+	void SetTransform(int node, glm::vec3 position, glm::vec3 scale, float rotationAngle, glm::vec3 rotationAxis)
+	{
+		Transforms.Set(node, position, rotation(rotationAngle, rotationAxis), scale);
+	}
+
+	// world matrix of a node as of the last Update
+	const glm::mat4& World(int node) const
+	{
+		return Transforms.World[node];
+	}
+
+	// Recomputes world matrices of dirty subtrees in one SoA pass over the transform store, then their world
+	// bounds (spread over the job system when there is one) and rebuilds or refits the BVH.
+	// When instances is given, every node's world matrix is also written to instances[node].
+	void Update(JobSystem* jobs = nullptr, glm::mat4* instances = nullptr)
+	{
+		Transforms.Compose(instances);
+		const std::vector<int>& changed = Transforms.Changed;
+
+		if (jobs && changed.size() > 256)
+		{
+			jobs->ParallelFor((int)changed.size(), 256, [this, &changed](int begin, int end)
+			{
+				for (int i = begin; i < end; i++)
+					updateBounds(changed[i]);
+			});
+		}
+		else
+		{
+			for (size_t i = 0; i < changed.size(); i++)
+				updateBounds(changed[i]);
+		}
+
+		movedItems.clear();
+		int moved = 0;
+		for (size_t i = 0; i < changed.size(); i++)
+		{
+			const SceneNode& node = Nodes[changed[i]];
+			if (node.LocalBounds.IsEmpty())
+				continue;
+			if (node.Item >= 0)
+				movedItems.push_back(node.Item);
+			moved++;
+		}
+
+		if (structureChanged)
+		{
+			// assign BVH items in node order so Item -> node lookup stays a flat array
+			itemNodes.clear();
+			itemBounds.clear();
+			for (size_t i = 0; i < Nodes.size(); i++)
+			{
+				Nodes[i].Item = -1;
+				if (Nodes[i].LocalBounds.IsEmpty())
+					continue;
+				Nodes[i].Item = (int)itemNodes.size();
+				itemNodes.push_back((int)i);
+				itemBounds.push_back(Nodes[i].WorldBounds);
+			}
+			Hierarchy.Build(itemBounds.data(), (int)itemBounds.size());
+			structureChanged = false;
+		}
+		else if (moved > 0)
+		{
+			for (size_t i = 0; i < movedItems.size(); i++)
+				itemBounds[movedItems[i]] = Nodes[itemNodes[movedItems[i]]].WorldBounds;
+			// a handful of moved objects is cheaper to refit along their paths than to sweep the whole tree
+			if (moved * 8 < (int)itemNodes.size())
+			{
+				for (size_t i = 0; i < movedItems.size(); i++)
+					Hierarchy.Refit(itemBounds.data(), movedItems[i]);
+			}
+			else
+				Hierarchy.RefitAll(itemBounds.data());
+		}
+	}
+
+	// BVH subtrees that together cover every renderable node, for culling on several threads
+	void CullRoots(int maxRoots, std::vector<int>& roots) const
+	{
+		Hierarchy.Split(maxRoots, roots);
+	}
+
+	// appends the visible nodes under one of the CullRoots; safe to call concurrently after Update
+	void CullSubtree(const Frustum& frustum, int root, std::vector<int>& visibleNodes) const
+	{
+		size_t first = visibleNodes.size();
+		CullStats leafStats = { 0, 0 };
+		Hierarchy.Query(frustum, itemBounds.data(), visibleNodes, leafStats, root);
+		for (size_t i = first; i < visibleNodes.size(); i++)
+			visibleNodes[i] = itemNodes[visibleNodes[i]];
+	}
+
+	// number of nodes with bounds, i.e. the objects a full cull tests
+	int ItemCount() const
+	{
+		return (int)itemNodes.size();
+	}
+
+	// returns the node hit first by the ray, or -1
+	int Pick(glm::vec3 origin, glm::vec3 direction, float& hitDistance) const
+	{
+		int item = Hierarchy.Raycast(itemBounds.data(), origin, direction, hitDistance);
+		return item < 0 ? -1 : itemNodes[item];
+	}
+
+private:
+	std::vector<int> itemNodes;
+	std::vector<BoundingBox> itemBounds;
+	std::vector<int> movedItems;
+	bool structureChanged = false;
+
+	// axis and angle as given to glm::rotate (which normalizes the axis) as a quaternion
+	static glm::quat rotation(float angle, glm::vec3 axis)
+	{
+		return glm::angleAxis(angle, glm::normalize(axis));
+	}
+
+	void updateBounds(int index)
+	{
+		SceneNode& node = Nodes[index];
+		if (!node.LocalBounds.IsEmpty())
+			node.WorldBounds = node.LocalBounds.Transform(Transforms.World[index]);
+	}
+};
+#endif
@@ -0,0 +1,284 @@
+#ifndef SHADOWS_H
+#define SHADOWS_H
+
+#include "gl_loader.h"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "bounds.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <vector>
+
+// array sizes of the shaders' ShadowUniforms block
+const int SHADOW_MAX_TILES = 16;
+const int SHADOW_MAX_LIGHTS = 4;
+
+// One shadow map of the atlas
+struct ShadowTile {
+	glm::mat4 ViewProjection;   // world to the tile's clip space
+	glm::vec4 Rect;             // atlas uv offset (xy) and size (zw)
+	bool Cached;                // the atlas holds this tile's depth for ViewProjection
+};
+
+// A light's tiles as the shaders read them (std140 ivec4)
+struct ShadowLight {
+	GLint FirstTile;
+	GLint TileCount;            // 0 when the light casts no shadows
+	GLint Point;                // 1: six cube faces in the order +x, -x, +y, -y, +z, -z; 0: cascades, nearest first
+	GLint Padding;
+};
+
+// Layout of the shaders' std140 ShadowUniforms block
+struct ShadowUniforms {
+	glm::mat4 Matrices[SHADOW_MAX_TILES];
+	glm::vec4 Rects[SHADOW_MAX_TILES];
+	ShadowLight Lights[SHADOW_MAX_LIGHTS];
+};
+
+// Shadow maps of every light in one depth atlas, sampled with hardware 2x2 PCF. Directional lights get
+// CASCADES orthographic tiles covering successive slices of the view frustum; point lights get six
+// perspective tiles, one per cube face. A tile is only re-rendered when its matrix changes (the light moved,
+// or the camera moved a cascade across a snap step) or when Invalidate reports moved objects, so a still
+// scene renders no shadow maps at all. Cascades are fitted to bounding spheres of their slices, which only
+// makes their size independent of the camera's rotation: a slice's center lies ahead of the camera and swings
+// with it, so turning re-renders a cascade whenever its center crosses a snap step of 64 texels.
+class ShadowAtlas
+{
+public:
+	static const int ATLAS_SIZE = 2048;
+	static const int TILE_SIZE = 512;
+	static const int CASCADES = 3;
+
+	// how far from the camera the cascades reach
+	float ShadowDistance;
+	// off: every tile is re-rendered every frame, to measure what the cache saves
+	bool CacheEnabled;
+	// tiles drawn by the last Render
+	int RenderedTiles;
+	std::vector<ShadowTile> Tiles;
+	std::vector<ShadowLight> Lights;
+
+	ShadowAtlas() : ShadowDistance(20.0f), CacheEnabled(true), RenderedTiles(0), texture(0), fbo(0)
+	{
+	}
+
+	void Init()
+	{
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT32F, ATLAS_SIZE, ATLAS_SIZE);
+		// linear filtering of a compared lookup averages the results of the four nearest texels
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		glGenFramebuffers(1, &fbo);
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, texture, 0);
+		const GLenum none = GL_NONE;
+		glDrawBuffers(1, &none);
+		glReadBuffer(GL_NONE);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+
+	void Destroy()
+	{
+		glDeleteTextures(1, &texture);
+		glDeleteFramebuffers(1, &fbo);
+	}
+
+	// adds a light and returns its index; false when the atlas has no room for its tiles
+	bool AddDirectionalLight(int& light)
+	{
+		return addLight(CASCADES, 0, light);
+	}
+
+	bool AddPointLight(int& light)
+	{
+		return addLight(6, 1, light);
+	}
+
+	// fits the light's cascades to the camera frustum (cameraViewProjection with its zNear and zFar). The
+	// depth range of every cascade spans the casters' bounds, so anything between a slice and the light
+	// casts into it.
+	void UpdateDirectional(int light, glm::vec3 direction, const glm::mat4& cameraViewProjection, float zNear, float zFar, const BoundingBox& casters)
+	{
+		if (casters.IsEmpty())
+			return;
+		// frustum corners, near plane then far plane
+		glm::mat4 inverse = glm::inverse(cameraViewProjection);
+		glm::vec3 nearCorners[4], farCorners[4];
+		for (int i = 0; i < 4; i++)
+		{
+			glm::vec2 ndc((i & 1) ? 1.0f : -1.0f, (i & 2) ? 1.0f : -1.0f);
+			glm::vec4 nearCorner = inverse * glm::vec4(ndc.x, ndc.y, -1.0f, 1.0f);
+			glm::vec4 farCorner = inverse * glm::vec4(ndc.x, ndc.y, 1.0f, 1.0f);
+			nearCorners[i] = glm::vec3(nearCorner) / nearCorner.w;
+			farCorners[i] = glm::vec3(farCorner) / farCorner.w;
+		}
+
+		direction = glm::normalize(direction);
+		glm::vec3 up = std::fabs(direction.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+		glm::mat4 lightView = glm::lookAt(glm::vec3(0.0f), direction, up);
+		float minZ = FLT_MAX, maxZ = -FLT_MAX;
+		for (int corner = 0; corner < 8; corner++)
+		{
+			glm::vec3 point((corner & 1) ? casters.Max.x : casters.Min.x, (corner & 2) ? casters.Max.y : casters.Min.y, (corner & 4) ? casters.Max.z : casters.Min.z);
+			float z = (lightView * glm::vec4(point, 1.0f)).z;
+			minZ = std::min(minZ, z);
+			maxZ = std::max(maxZ, z);
+		}
+
+		// split distances blend logarithmic and uniform splits
+		const float SPLIT_BLEND = 0.75f;
+		float distance = std::min(zFar, ShadowDistance);
+		float sliceStart = zNear;
+		for (int cascade = 0; cascade < CASCADES; cascade++)
+		{
+			float fraction = (float)(cascade + 1) / CASCADES;
+			float sliceEnd = SPLIT_BLEND * zNear * std::pow(distance / zNear, fraction) + (1.0f - SPLIT_BLEND) * (zNear + (distance - zNear) * fraction);
+
+			// corner rays are straight lines along which view depth is linear, in both projections
+			glm::vec3 corners[8];
+			glm::vec3 center(0.0f);
+			for (int i = 0; i < 8; i++)
+			{
+				float depth = i < 4 ? sliceStart : sliceEnd;
+				corners[i] = glm::mix(nearCorners[i % 4], farCorners[i % 4], (depth - zNear) / (zFar - zNear));
+				center += corners[i] / 8.0f;
+			}
+			float radius = 0.0f;
+			for (int i = 0; i < 8; i++)
+				radius = std::max(radius, glm::length(corners[i] - center));
+			radius = std::ceil(radius * 16.0f) / 16.0f;
+
+			// the tile reaches half a snap step past the sphere, and a snap step is 64 texels
+			float extent = radius * 8.0f / 7.0f;
+			float step = extent / 4.0f;
+			glm::vec3 lightCenter = glm::vec3(lightView * glm::vec4(center, 1.0f));
+			float x = std::floor(lightCenter.x / step + 0.5f) * step;
+			float y = std::floor(lightCenter.y / step + 0.5f) * step;
+			glm::mat4 projection = glm::ortho(x - extent, x + extent, y - extent, y + extent, -maxZ - 0.5f, -minZ + 0.5f);
+			setTile(Lights[light].FirstTile + cascade, projection * lightView);
+			sliceStart = sliceEnd;
+		}
+	}
+
+	// points the light's six cube faces out from its position, reaching range
+	void UpdatePoint(int light, glm::vec3 position, float range)
+	{
+		static const glm::vec3 directions[6] = {
+			glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(-1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f),
+			glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.0f, -1.0f)
+		};
+		static const glm::vec3 ups[6] = {
+			glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f),
+			glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f)
+		};
+		glm::mat4 projection = glm::perspective(glm::radians(90.0f), 1.0f, 0.05f, range);
+		for (int face = 0; face < 6; face++)
+			setTile(Lights[light].FirstTile + face, projection * glm::lookAt(position, position + directions[face], ups[face]));
+	}
+
+	// objects moved: every tile has to be drawn again
+	void Invalidate()
+	{
+		for (size_t i = 0; i < Tiles.size(); i++)
+			Tiles[i].Cached = false;
+	}
+
+	// draws the tiles that aren't cached; drawCasters(viewProjection) draws the shadow casters' depth. Restores
+	// the default framebuffer and viewport.
+	template <typename DrawCasters>
+	void Render(int framebufferWidth, int framebufferHeight, DrawCasters drawCasters)
+	{
+		RenderedTiles = 0;
+		for (size_t i = 0; i < Tiles.size(); i++)
+		{
+			ShadowTile& tile = Tiles[i];
+			if (tile.Cached)
+				continue;
+			if (RenderedTiles++ == 0)
+			{
+				glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+				glEnable(GL_SCISSOR_TEST);
+				// slope scaled bias against surfaces shadowing themselves
+				glEnable(GL_POLYGON_OFFSET_FILL);
+				glPolygonOffset(2.0f, 4.0f);
+			}
+			int x = (int)(tile.Rect.x * ATLAS_SIZE);
+			int y = (int)(tile.Rect.y * ATLAS_SIZE);
+			glViewport(x, y, TILE_SIZE, TILE_SIZE);
+			glScissor(x, y, TILE_SIZE, TILE_SIZE);
+			glClear(GL_DEPTH_BUFFER_BIT);
+			drawCasters(tile.ViewProjection);
+			tile.Cached = CacheEnabled;
+		}
+		if (RenderedTiles > 0)
+		{
+			glDisable(GL_POLYGON_OFFSET_FILL);
+			glDisable(GL_SCISSOR_TEST);
+			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+			glViewport(0, 0, framebufferWidth, framebufferHeight);
+		}
+	}
+
+	// the shaders' view of the atlas; lights cast no shadows when enabled is false
+	void FillUniforms(ShadowUniforms& uniforms, bool enabled) const
+	{
+		for (size_t i = 0; i < Tiles.size(); i++)
+		{
+			uniforms.Matrices[i] = Tiles[i].ViewProjection;
+			uniforms.Rects[i] = Tiles[i].Rect;
+		}
+		for (int i = 0; i < SHADOW_MAX_LIGHTS; i++)
+		{
+			ShadowLight none = { 0, 0, 0, 0 };
+			uniforms.Lights[i] = enabled && i < (int)Lights.size() ? Lights[i] : none;
+		}
+	}
+
+	GLuint Texture() const
+	{
+		return texture;
+	}
+
+private:
+	GLuint texture;
+	GLuint fbo;
+
+	bool addLight(int tileCount, int point, int& light)
+	{
+		const int tilesPerRow = ATLAS_SIZE / TILE_SIZE;
+		if ((int)Tiles.size() + tileCount > std::min(SHADOW_MAX_TILES, tilesPerRow * tilesPerRow) || (int)Lights.size() == SHADOW_MAX_LIGHTS)
+			return false;
+		ShadowLight added = { (GLint)Tiles.size(), tileCount, point, 0 };
+		for (int i = 0; i < tileCount; i++)
+		{
+			int index = (int)Tiles.size();
+			float size = (float)TILE_SIZE / ATLAS_SIZE;
+			ShadowTile tile = { glm::mat4(1.0f), glm::vec4((index % tilesPerRow) * size, (index / tilesPerRow) * size, size, size), false };
+			Tiles.push_back(tile);
+		}
+		light = (int)Lights.size();
+		Lights.push_back(added);
+		return true;
+	}
+
+	void setTile(int index, const glm::mat4& viewProjection)
+	{
+		ShadowTile& tile = Tiles[index];
+		if (viewProjection != tile.ViewProjection)
+			tile.Cached = false;
+		tile.ViewProjection = viewProjection;
+	}
+};
+#endif
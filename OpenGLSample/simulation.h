@@ -0,0 +1,246 @@
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include <glm/glm.hpp>
+
+#include "camera.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+// Single producer / single consumer triple buffer: the writer always has a free buffer to fill and the reader
+// always sees the most recent complete one, without either side ever waiting for the other
+template <typename T>
+class TripleBuffer
+{
+public:
+	TripleBuffer() : back(0), front(2)
+	{
+		middle = 1;
+	}
+
+	// buffer the writer may fill
+	T& Back()
+	{
+		return buffers[back];
+	}
+
+	// hands the filled buffer to the reader and takes the stale one back
+	void Publish()
+	{
+		back = middle.exchange(back | FRESH) & INDEX;
+	}
+
+	// switches to the newest published buffer, returns false when nothing new arrived
+	bool Update()
+	{
+		if (!(middle.load() & FRESH))
+			return false;
+		front = middle.exchange(front) & INDEX;
+		return true;
+	}
+
+	// newest buffer the reader switched to
+	const T& Front() const
+	{
+		return buffers[front];
+	}
+
+private:
+	static const int INDEX = 3;
+	static const int FRESH = 4;
+
+	T buffers[3];
+	int back;
+	std::atomic<int> middle;
+	int front;
+};
+
+// Input gathered on the main thread (GLFW only reports input there) between two simulation ticks
+struct InputState {
+	bool Forward, Backward, Left, Right, Up, Down;  // movement keys currently held
+	float MouseX, MouseY;                           // accumulated mouse movement, y pointing up
+	float Scroll;                                   // accumulated scroll, changes the movement speed
+};
+
+// Camera state after one tick
+struct SimulationState {
+	glm::vec3 Position;
+	float Yaw;
+	float Pitch;
+	float Zoom;
+	float MovementSpeed;
+};
+
+// What the simulation publishes every tick: the last two states, so the renderer can blend between them
+struct SimulationSnapshot {
+	SimulationState Previous;
+	SimulationState Current;
+	std::chrono::steady_clock::time_point TickTime;  // when Current was simulated
+	unsigned long long Tick;
+};
+
+// Fixed timestep simulation running on its own thread. Every tick consumes the input gathered since the
+// last one, advances the camera by exactly TICK_SECONDS and publishes a snapshot through a triple buffer.
+// The renderer shows the scene one tick behind, interpolated by how far it is into the next tick, so motion
+// is smooth at any frame rate and slow frames no longer stretch a single movement step.
+class Simulation
+{
+public:
+	static const int TICKS_PER_SECOND = 120;
+	static constexpr double TICK_SECONDS = 1.0 / TICKS_PER_SECOND;
+	// after a stall the simulation catches up at most this many ticks instead of spiralling
+	static const int MAX_CATCH_UP_TICKS = 8;
+
+	Simulation() : running(false), tick(0)
+	{
+		input = InputState();
+	}
+
+	~Simulation()
+	{
+		Stop();
+	}
+
+	// starts ticking from the given camera
+	void Start(const Camera& initial)
+	{
+		Stop();
+		camera = initial;
+		SimulationState state = stateOf(camera);
+		SimulationSnapshot& first = snapshots.Back();
+		first.Previous = first.Current = state;
+		first.TickTime = std::chrono::steady_clock::now();
+		first.Tick = tick = 0;
+		snapshots.Publish();
+		running = true;
+		thread = std::thread(&Simulation::run, this);
+	}
+
+	void Stop()
+	{
+		if (!running)
+			return;
+		running = false;
+		thread.join();
+	}
+
+	// main thread: latest held keys
+	void SetKeys(bool forward, bool backward, bool left, bool right, bool up, bool down)
+	{
+		std::lock_guard<std::mutex> lock(inputMutex);
+		input.Forward = forward;
+		input.Backward = backward;
+		input.Left = left;
+		input.Right = right;
+		input.Up = up;
+		input.Down = down;
+	}
+
+	// main thread: mouse and scroll events, accumulated until the next tick
+	void AddMouseMovement(float xoffset, float yoffset)
+	{
+		std::lock_guard<std::mutex> lock(inputMutex);
+		input.MouseX += xoffset;
+		input.MouseY += yoffset;
+	}
+
+	void AddScroll(float yoffset)
+	{
+		std::lock_guard<std::mutex> lock(inputMutex);
+		input.Scroll += yoffset;
+	}
+
+	// render thread: camera blended between the last two ticks for the current time
+	Camera Interpolate(std::chrono::steady_clock::time_point now)
+	{
+		snapshots.Update();
+		const SimulationSnapshot& snapshot = snapshots.Front();
+		double elapsed = std::chrono::duration<double>(now - snapshot.TickTime).count();
+		float alpha = (float)std::min(std::max(elapsed / TICK_SECONDS, 0.0), 1.0);
+
+		const SimulationState& a = snapshot.Previous;
+		const SimulationState& b = snapshot.Current;
+		Camera blended(glm::mix(a.Position, b.Position, alpha), glm::vec3(0.0f, 1.0f, 0.0f), a.Yaw + (b.Yaw - a.Yaw) * alpha, a.Pitch + (b.Pitch - a.Pitch) * alpha);
+		blended.Zoom = a.Zoom + (b.Zoom - a.Zoom) * alpha;
+		blended.MovementSpeed = b.MovementSpeed;
+		return blended;
+	}
+
+private:
+	std::thread thread;
+	std::atomic<bool> running;
+	std::mutex inputMutex;
+	InputState input;
+	TripleBuffer<SimulationSnapshot> snapshots;
+	// owned by the simulation thread while running
+	Camera camera;
+	unsigned long long tick;
+
+	static SimulationState stateOf(const Camera& camera)
+	{
+		SimulationState state = { camera.Position, camera.Yaw, camera.Pitch, camera.Zoom, camera.MovementSpeed };
+		return state;
+	}
+
+	void run()
+	{
+		const std::chrono::steady_clock::duration tickDuration = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(TICK_SECONDS));
+		std::chrono::steady_clock::time_point next = std::chrono::steady_clock::now() + tickDuration;
+		while (running)
+		{
+			std::this_thread::sleep_until(next);
+			std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+			int ticks = 0;
+			while (next <= now && ticks < MAX_CATCH_UP_TICKS)
+			{
+				advance(next);
+				next += tickDuration;
+				ticks++;
+			}
+			// too far behind: drop the backlog rather than run ever longer bursts
+			if (next <= now)
+				next = now + tickDuration;
+		}
+	}
+
+	// advances one tick simulated at the given time
+	void advance(std::chrono::steady_clock::time_point tickTime)
+	{
+		InputState frameInput;
+		{
+			std::lock_guard<std::mutex> lock(inputMutex);
+			frameInput = input;
+			input.MouseX = input.MouseY = input.Scroll = 0.0f;
+		}
+
+		SimulationState previous = stateOf(camera);
+		const float dt = (float)TICK_SECONDS;
+		if (frameInput.Forward)
+			camera.ProcessKeyboard(FORWARD, dt);
+		if (frameInput.Backward)
+			camera.ProcessKeyboard(BACKWARD, dt);
+		if (frameInput.Left)
+			camera.ProcessKeyboard(LEFT, dt);
+		if (frameInput.Right)
+			camera.ProcessKeyboard(RIGHT, dt);
+		if (frameInput.Up)
+			camera.Position += camera.WorldUp * camera.MovementSpeed * dt;
+		if (frameInput.Down)
+			camera.Position -= camera.WorldUp * camera.MovementSpeed * dt;
+		if (frameInput.MouseX != 0.0f || frameInput.MouseY != 0.0f)
+			camera.ProcessMouseMovement(frameInput.MouseX, frameInput.MouseY);
+		camera.MovementSpeed += frameInput.Scroll;
+
+		SimulationSnapshot& snapshot = snapshots.Back();
+		snapshot.Previous = previous;
+		snapshot.Current = stateOf(camera);
+		snapshot.TickTime = tickTime;
+		snapshot.Tick = ++tick;
+		snapshots.Publish();
+	}
+};
+#endif
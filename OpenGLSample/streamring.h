@@ -0,0 +1,146 @@
+#ifndef STREAMRING_H
+#define STREAMRING_H
+
+#include "gl_loader.h"
+
+// Ring of per-frame regions in one persistently mapped buffer (glBufferStorage, mapped once with
+// GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT) for data rewritten every frame: uniforms, instance data,
+// indirect commands, dynamic geometry. The CPU fills region N while the GPU still reads N-1 and N-2; a fence
+// per region tells when the GPU is done with it, so there is no orphaning copy in the driver and no implicit
+// sync on a buffer in use. GL thread only, apart from writing through pointers Allocate returned.
+class StreamRing
+{
+public:
+	static const int FRAMES = 3;
+
+	// the frame's region ran out; Allocate returned null for the rest of the frame
+	bool Overflowed;
+	// BeginFrame calls that had to wait for the GPU to release the region, since Init
+	unsigned int Waits;
+
+	StreamRing() : Overflowed(false), Waits(0), buffer(0), mapped(nullptr), regionSize(0), uniformAlignment(256), frame(0), used(0)
+	{
+		for (int i = 0; i < FRAMES; i++)
+			fences[i] = 0;
+	}
+
+	// size bytes per frame (rounded up to the uniform alignment)
+	void Init(GLsizeiptr size)
+	{
+		GLint alignment = 0;
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+		if (alignment > 256)
+			uniformAlignment = alignment;
+		regionSize = align(size, uniformAlignment);
+
+		const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glGenBuffers(1, &buffer);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+		glBufferStorage(GL_COPY_WRITE_BUFFER, regionSize * FRAMES, nullptr, flags);
+		mapped = (unsigned char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, regionSize * FRAMES, flags);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		frame = FRAMES - 1;
+		used = regionSize;
+	}
+
+	void Destroy()
+	{
+		for (int i = 0; i < FRAMES; i++)
+		{
+			if (fences[i])
+				glDeleteSync(fences[i]);
+			fences[i] = 0;
+		}
+		if (mapped)
+		{
+			glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+			glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+			mapped = nullptr;
+		}
+		glDeleteBuffers(1, &buffer);
+		buffer = 0;
+	}
+
+	// moves on to the next region, waiting for the GPU if it is still reading what was written there
+	// FRAMES frames ago (only happens when the GPU is that far behind)
+	void BeginFrame()
+	{
+		frame = (frame + 1) % FRAMES;
+		if (fences[frame])
+		{
+			GLenum status = glClientWaitSync(fences[frame], GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+			if (status == GL_TIMEOUT_EXPIRED)
+			{
+				Waits++;
+				do
+					status = glClientWaitSync(fences[frame], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+				while (status == GL_TIMEOUT_EXPIRED);
+			}
+			glDeleteSync(fences[frame]);
+			fences[frame] = 0;
+		}
+		used = 0;
+		Overflowed = false;
+	}
+
+	// fences the region after the last command reading from it was issued
+	void EndFrame()
+	{
+		fences[frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+
+	// size bytes of the current region at a multiple of alignment from the start of the buffer; offset
+	// receives that buffer offset. Returns null when the region is full.
+	void* Allocate(GLsizeiptr size, GLsizeiptr alignment, GLintptr& offset)
+	{
+		GLsizeiptr start = align(used, alignment);
+		if (start + size > regionSize)
+		{
+			Overflowed = true;
+			return nullptr;
+		}
+		used = start + size;
+		offset = frame * regionSize + start;
+		return mapped + offset;
+	}
+
+	// an allocation usable as a uniform block range
+	void* AllocateUniforms(GLsizeiptr size, GLintptr& offset)
+	{
+		return Allocate(size, uniformAlignment, offset);
+	}
+
+	GLuint Buffer() const
+	{
+		return buffer;
+	}
+
+	GLsizeiptr RegionSize() const
+	{
+		return regionSize;
+	}
+
+	// bytes allocated from the current region so far
+	GLsizeiptr Used() const
+	{
+		return used;
+	}
+
+private:
+	GLuint buffer;
+	unsigned char* mapped;
+	GLsizeiptr regionSize;
+	GLsizeiptr uniformAlignment;
+	int frame;
+	GLsizeiptr used;
+	GLsync fences[FRAMES];
+
+	// regions start at a multiple of the uniform alignment (256 or more), so an offset aligned within the
+	// region is aligned in the buffer for every alignment that divides it
+	static GLsizeiptr align(GLsizeiptr value, GLsizeiptr alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+};
+#endif
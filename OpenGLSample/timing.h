@@ -0,0 +1,144 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <timeapi.h>
+#pragma comment(lib, "winmm.lib")
+#endif
+
+// Monotonic frame clock counting integer nanoseconds. 64 bits cover centuries, so unlike a float of
+// glfwGetTime() the resolution stays the same after weeks of uptime; only per-frame deltas become doubles.
+class FrameClock
+{
+public:
+	FrameClock() : FrameCount(0), delta(0)
+	{
+		start = last = Now();
+	}
+
+	// frames ticked so far
+	uint64_t FrameCount;
+
+	// nanoseconds on the monotonic clock
+	static int64_t Now()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	static double Seconds(int64_t nanoseconds)
+	{
+		return nanoseconds * 1e-9;
+	}
+
+	// starts a new frame and returns the seconds since the previous one
+	double Tick()
+	{
+		int64_t now = Now();
+		delta = now - last;
+		last = now;
+		FrameCount++;
+		return Seconds(delta);
+	}
+
+	// restarts the clock from now, so the first Tick and Elapsed don't count the loading done before the first frame
+	void Start()
+	{
+		start = last = Now();
+		delta = 0;
+		FrameCount = 0;
+	}
+
+	// restarts the current frame's time from now, so a pause (waiting for input) isn't counted in the next Delta
+	void Resume()
+	{
+		last = Now();
+	}
+
+	// nanoseconds from the clock's start to the start of the current frame
+	int64_t Elapsed() const
+	{
+		return last - start;
+	}
+
+	// length of the previous frame in nanoseconds
+	int64_t Delta() const
+	{
+		return delta;
+	}
+
+private:
+	int64_t start;
+	int64_t last;
+	int64_t delta;
+};
+
+// Holds frames to a fixed rate independent of vsync. Deadlines advance by exactly one period, so the rate
+// doesn't drift with wakeup jitter. Each wait sleeps until shortly before the deadline, then spins for the
+// rest: sleeping frees the core, spinning makes the wakeup precise. The spin margin tracks how late the OS
+// actually wakes us, so it stays short where sleeps are precise.
+class FramePacer
+{
+public:
+	FramePacer() : TargetFps(0.0), deadline(0), spinMargin(1000000)
+	{
+#ifdef _WIN32
+		// the default 15.6 ms scheduler tick would turn most of every wait into spinning
+		timeBeginPeriod(1);
+#endif
+	}
+
+	~FramePacer()
+	{
+#ifdef _WIN32
+		timeEndPeriod(1);
+#endif
+	}
+
+	// frames per second to hold; 0 leaves pacing to the swap interval
+	double TargetFps;
+
+	void SetTarget(double fps)
+	{
+		TargetFps = fps;
+		deadline = 0;
+	}
+
+	// blocks until the next frame is due; call once per frame, after the swap
+	void Wait()
+	{
+		if (TargetFps <= 0.0)
+			return;
+
+		int64_t period = (int64_t)(1e9 / TargetFps);
+		int64_t now = FrameClock::Now();
+		deadline = deadline == 0 ? now + period : deadline + period;
+		// more than a frame late: start a new cadence instead of rushing frames to catch up
+		if (deadline < now - period)
+			deadline = now;
+
+		int64_t sleepUntil = deadline - spinMargin;
+		if (sleepUntil > now)
+		{
+			std::this_thread::sleep_for(std::chrono::nanoseconds(sleepUntil - now));
+			// keep the margin around twice the observed oversleep, between 0.2 ms and 4 ms
+			int64_t oversleep = FrameClock::Now() - sleepUntil;
+			spinMargin = std::min<int64_t>(std::max<int64_t>((spinMargin * 7 + oversleep * 2) / 8, 200000), 4000000);
+		}
+		while (FrameClock::Now() < deadline)
+			std::this_thread::yield();
+	}
+
+private:
+	int64_t deadline;
+	int64_t spinMargin;
+};
+#endif
@@ -0,0 +1,219 @@
+#ifndef TRANSFORMS_H
+#define TRANSFORMS_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// SSE is available on every x64 target and on x86 when /arch:SSE or higher is set
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define TRANSFORMS_USE_SSE 1
+#include <xmmintrin.h>
+#endif
+
+// Local transforms of many objects stored as structure of arrays (one array per component), so the
+// compose pass can build the matrices of four objects at once. Matrices are composed as
+// translate * scale * rotate like the rest of the project. Parents must be added before their children.
+class TransformStore
+{
+public:
+	std::vector<float> PositionX, PositionY, PositionZ;
+	std::vector<float> RotationX, RotationY, RotationZ, RotationW;  // unit quaternions
+	std::vector<float> ScaleX, ScaleY, ScaleZ;
+	std::vector<int> Parent;               // -1 for roots
+	std::vector<unsigned char> Dirty;      // set by Add and Set, cleared by Compose
+	// results of the last Compose
+	std::vector<glm::mat4> World;
+	std::vector<int> Changed;              // transforms whose world matrix Compose recomputed
+
+	int Count() const
+	{
+		return (int)Parent.size();
+	}
+
+	// adds a transform and returns its index
+	int Add(glm::vec3 position, glm::quat rotation, glm::vec3 scale, int parent = -1)
+	{
+		int index = Count();
+		PositionX.push_back(position.x);
+		PositionY.push_back(position.y);
+		PositionZ.push_back(position.z);
+		RotationX.push_back(rotation.x);
+		RotationY.push_back(rotation.y);
+		RotationZ.push_back(rotation.z);
+		RotationW.push_back(rotation.w);
+		ScaleX.push_back(scale.x);
+		ScaleY.push_back(scale.y);
+		ScaleZ.push_back(scale.z);
+		Parent.push_back(parent);
+		Dirty.push_back(1);
+		World.push_back(glm::mat4(1.0f));
+		return index;
+	}
+
+	void Set(int index, glm::vec3 position, glm::quat rotation, glm::vec3 scale)
+	{
+		PositionX[index] = position.x;
+		PositionY[index] = position.y;
+		PositionZ[index] = position.z;
+		RotationX[index] = rotation.x;
+		RotationY[index] = rotation.y;
+		RotationZ[index] = rotation.z;
+		RotationW[index] = rotation.w;
+		ScaleX[index] = scale.x;
+		ScaleY[index] = scale.y;
+		ScaleZ[index] = scale.z;
+		Dirty[index] = 1;
+	}
+
+	// Recomputes the world matrices of dirty transforms and of everything below them, lists them in Changed
+	// and returns how many there were. When destination is given, every world matrix (changed or not) is also
+	// written to destination[index] in the same pass, e.g. straight into a mapped instance buffer; the pass
+	// only ever writes there, so write-combined memory is fine.
+	int Compose(glm::mat4* destination = nullptr)
+	{
+		int count = Count();
+		Changed.clear();
+		// parents come first, so one forward sweep hands their dirty flags down to the whole subtree
+		for (int i = 0; i < count; i++)
+		{
+			if (Parent[i] >= 0 && Dirty[Parent[i]])
+				Dirty[i] = 1;
+		}
+
+		int i = 0;
+#ifdef TRANSFORMS_USE_SSE
+		for (; i + 4 <= count; i += 4)
+		{
+			uint32_t groupDirty;
+			memcpy(&groupDirty, &Dirty[i], sizeof(groupDirty));
+			if (groupDirty)
+			{
+				composeGroup(i);
+				for (int lane = 0; lane < 4; lane++)
+					finish(i + lane);
+			}
+			if (destination)
+				write(destination, i, 4);
+		}
+#endif
+		for (; i < count; i++)
+		{
+			if (Dirty[i])
+			{
+				composeLocal(i, World[i]);
+				finish(i);
+			}
+			if (destination)
+				write(destination, i, 1);
+		}
+#ifdef TRANSFORMS_USE_SSE
+		if (destination)
+			_mm_sfence();
+#endif
+		return (int)Changed.size();
+	}
+
+private:
+	// applies the parent and records the result of a dirty transform whose local matrix is in World
+	void finish(int index)
+	{
+		if (!Dirty[index])
+			return;
+		if (Parent[index] >= 0)
+			World[index] = World[Parent[index]] * World[index];
+		Dirty[index] = 0;
+		Changed.push_back(index);
+	}
+
+	void composeLocal(int i, glm::mat4& local) const
+	{
+		float x = RotationX[i], y = RotationY[i], z = RotationZ[i], w = RotationW[i];
+		float xx = x * x, yy = y * y, zz = z * z;
+		float xy = x * y, xz = x * z, yz = y * z;
+		float wx = w * x, wy = w * y, wz = w * z;
+		float sx = ScaleX[i], sy = ScaleY[i], sz = ScaleZ[i];
+		// rotation columns with each row scaled: scale * rotate
+		local[0] = glm::vec4(sx * (1.0f - 2.0f * (yy + zz)), sy * (2.0f * (xy + wz)), sz * (2.0f * (xz - wy)), 0.0f);
+		local[1] = glm::vec4(sx * (2.0f * (xy - wz)), sy * (1.0f - 2.0f * (xx + zz)), sz * (2.0f * (yz + wx)), 0.0f);
+		local[2] = glm::vec4(sx * (2.0f * (xz + wy)), sy * (2.0f * (yz - wx)), sz * (1.0f - 2.0f * (xx + yy)), 0.0f);
+		local[3] = glm::vec4(PositionX[i], PositionY[i], PositionZ[i], 1.0f);
+	}
+
+#ifdef TRANSFORMS_USE_SSE
+	// composeLocal for transforms first..first+3, one per lane; the local matrices of the dirty ones go to World
+	void composeGroup(int first)
+	{
+		__m128 x = _mm_loadu_ps(&RotationX[first]);
+		__m128 y = _mm_loadu_ps(&RotationY[first]);
+		__m128 z = _mm_loadu_ps(&RotationZ[first]);
+		__m128 w = _mm_loadu_ps(&RotationW[first]);
+		__m128 sx = _mm_loadu_ps(&ScaleX[first]);
+		__m128 sy = _mm_loadu_ps(&ScaleY[first]);
+		__m128 sz = _mm_loadu_ps(&ScaleZ[first]);
+		__m128 one = _mm_set1_ps(1.0f);
+		__m128 two = _mm_set1_ps(2.0f);
+
+		__m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+		__m128 xy = _mm_mul_ps(x, y), xz = _mm_mul_ps(x, z), yz = _mm_mul_ps(y, z);
+		__m128 wx = _mm_mul_ps(w, x), wy = _mm_mul_ps(w, y), wz = _mm_mul_ps(w, z);
+
+		// element [column][row] of each lane's matrix
+		__m128 m00 = _mm_mul_ps(sx, _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))));
+		__m128 m01 = _mm_mul_ps(sy, _mm_mul_ps(two, _mm_add_ps(xy, wz)));
+		__m128 m02 = _mm_mul_ps(sz, _mm_mul_ps(two, _mm_sub_ps(xz, wy)));
+		__m128 m10 = _mm_mul_ps(sx, _mm_mul_ps(two, _mm_sub_ps(xy, wz)));
+		__m128 m11 = _mm_mul_ps(sy, _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))));
+		__m128 m12 = _mm_mul_ps(sz, _mm_mul_ps(two, _mm_add_ps(yz, wx)));
+		__m128 m20 = _mm_mul_ps(sx, _mm_mul_ps(two, _mm_add_ps(xz, wy)));
+		__m128 m21 = _mm_mul_ps(sy, _mm_mul_ps(two, _mm_sub_ps(yz, wx)));
+		__m128 m22 = _mm_mul_ps(sz, _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))));
+		__m128 m03 = _mm_setzero_ps(), m13 = _mm_setzero_ps(), m23 = _mm_setzero_ps();
+		__m128 m30 = _mm_loadu_ps(&PositionX[first]);
+		__m128 m31 = _mm_loadu_ps(&PositionY[first]);
+		__m128 m32 = _mm_loadu_ps(&PositionZ[first]);
+		__m128 m33 = one;
+
+		// transposing turns "one element of four matrices" into "one column of one matrix"
+		_MM_TRANSPOSE4_PS(m00, m01, m02, m03);
+		_MM_TRANSPOSE4_PS(m10, m11, m12, m13);
+		_MM_TRANSPOSE4_PS(m20, m21, m22, m23);
+		_MM_TRANSPOSE4_PS(m30, m31, m32, m33);
+		__m128 columns[4][4] = {
+			{ m00, m10, m20, m30 },
+			{ m01, m11, m21, m31 },
+			{ m02, m12, m22, m32 },
+			{ m03, m13, m23, m33 }
+		};
+		for (int lane = 0; lane < 4; lane++)
+		{
+			if (!Dirty[first + lane])
+				continue;
+			float* target = &World[first + lane][0][0];
+			for (int column = 0; column < 4; column++)
+				_mm_storeu_ps(target + column * 4, columns[lane][column]);
+		}
+	}
+#endif
+
+	// copies count world matrices starting at first to destination
+	void write(glm::mat4* destination, int first, int count) const
+	{
+#ifdef TRANSFORMS_USE_SSE
+		// mapped buffers are at least 64 byte aligned; streaming stores skip reading the lines into the cache
+		float* target = &destination[first][0][0];
+		if (((uintptr_t)target & 15) == 0)
+		{
+			const float* source = &World[first][0][0];
+			for (int f = 0; f < count * 16; f += 4)
+				_mm_stream_ps(target + f, _mm_loadu_ps(source + f));
+			return;
+		}
+#endif
+		memcpy(&destination[first], &World[first], count * sizeof(glm::mat4));
+	}
+};
+#endif